@@ -0,0 +1,445 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "demoarchive.h"
+#include "demofilewriter.h"
+#include "snappy.h"
+#include "zstd.h"
+#include "zdict.h"
+
+// Upper bound on the amount of frame data handed to the dictionary trainer
+#define DEMOARCHIVE_TRAINING_SIZE	( 64 * 1024 * 1024 )
+
+// The dictionary is shared by every archive read or written by this process
+static std::string s_Dictionary;
+static ZSTD_DDict *s_pDDict = NULL;
+static uint32 s_nDictID = 0;
+
+/**
+ * Loads a dictionary made by TrainDemoArchiveDictionary(), it is used for all archives that follow
+ */ 
+bool LoadDemoArchiveDictionary( const char *filename )
+{
+	FILE *fp = fopen( filename, "rb" );
+	if( !fp )
+	{
+		fprintf( stderr, "LoadDemoArchiveDictionary: couldn't open %s.\n", filename );
+		return false;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	size_t Length = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	s_Dictionary.resize( Length );
+	bool bOk = Length && fread( &s_Dictionary[ 0 ], 1, Length, fp ) == Length;
+	fclose( fp );
+
+	if( s_pDDict )
+	{
+		ZSTD_freeDDict( s_pDDict );
+		s_pDDict = NULL;
+	}
+
+	if( bOk )
+	{
+		s_pDDict = ZSTD_createDDict( s_Dictionary.data(), s_Dictionary.size() );
+		s_nDictID = ZSTD_getDictID_fromDict( s_Dictionary.data(), s_Dictionary.size() );
+	}
+
+	if( !s_pDDict )
+	{
+		fprintf( stderr, "LoadDemoArchiveDictionary: %s is not a dictionary.\n", filename );
+		s_Dictionary.clear();
+		s_nDictID = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Reads the next frame and appends it to frameStream with its message decompressed
+ *
+ * @return the demo command of the frame, DEM_Error at the end of the file or on bad data
+ */ 
+static EDemoCommands AppendDecompressedFrame( CDemoFile& demofile, std::string& frameStream, int *pTick )
+{
+	bool bCompressed;
+	const char *pBuffer;
+	int size;
+
+	if( demofile.IsDone() )
+		return DEM_Error;
+
+	EDemoCommands DemoCommand = demofile.ReadMessageType( pTick, &bCompressed );
+
+	if( DemoCommand == DEM_Error || !demofile.ReadRawMessage( &pBuffer, &size ) )
+		return DEM_Error;
+
+	WriteVarInt32( frameStream, DemoCommand );
+	WriteVarInt32( frameStream, *pTick );
+
+	if( bCompressed )
+	{
+		size_t uDecompressedLen;
+
+		if( !snappy::GetUncompressedLength( pBuffer, size, &uDecompressedLen ) )
+		{
+			demofile.ReportError( DEMO_ERROR_DECOMPRESS );
+			return DEM_Error;
+		}
+
+		WriteVarInt32( frameStream, uDecompressedLen );
+
+		size_t nStart = frameStream.size();
+		frameStream.resize( nStart + uDecompressedLen );
+
+		if( !snappy::RawUncompress( pBuffer, size, &frameStream[ nStart ] ) )
+		{
+			demofile.ReportError( DEMO_ERROR_DECOMPRESS );
+			return DEM_Error;
+		}
+	}
+	else
+	{
+		WriteVarInt32( frameStream, size );
+		frameStream.append( pBuffer, size );
+	}
+
+	return DemoCommand;
+}
+
+/**
+ * Trains a zstd dictionary on the frames of a set of demos and writes it to outname
+ */ 
+bool TrainDemoArchiveDictionary( const char *outname, int numfiles, char *filenames[] )
+{
+	std::string samples;
+	std::vector< size_t > sampleSizes;
+	size_t nBudget = DEMOARCHIVE_TRAINING_SIZE / ( numfiles ? numfiles : 1 );
+
+	for( int i = 0; i < numfiles; i++ )
+	{
+		CDemoFile demofile;
+
+		if( !demofile.Open( filenames[ i ] ) )
+			continue;
+
+		// Spread the samples over the whole match, the frame stream is roughly twice the file size
+		size_t nStride = 1 + ( demofile.GetSize() * 2 ) / nBudget;
+		size_t nStart = samples.size();
+
+		for( int nFrame = 0; samples.size() - nStart < nBudget; nFrame++ )
+		{
+			int tick;
+			size_t nFrameStart = samples.size();
+
+			if( AppendDecompressedFrame( demofile, samples, &tick ) == DEM_Error )
+			{
+				samples.resize( nFrameStart );
+				break;
+			}
+
+			if( nFrame % nStride )
+				samples.resize( nFrameStart );
+			else
+				sampleSizes.push_back( samples.size() - nFrameStart );
+		}
+	}
+
+	if( sampleSizes.empty() )
+	{
+		fprintf( stderr, "TrainDemoArchiveDictionary: no frames to train on.\n" );
+		return false;
+	}
+
+	std::string dictionary( DEMOARCHIVE_DICT_SIZE, 0 );
+	size_t nDictSize = ZDICT_trainFromBuffer( &dictionary[ 0 ], dictionary.size(),
+		samples.data(), &sampleSizes[ 0 ], sampleSizes.size() );
+
+	if( ZDICT_isError( nDictSize ) )
+	{
+		fprintf( stderr, "TrainDemoArchiveDictionary: %s.\n", ZDICT_getErrorName( nDictSize ) );
+		return false;
+	}
+
+	FILE *fp = fopen( outname, "wb" );
+	bool bOk = fp && fwrite( dictionary.data(), 1, nDictSize, fp ) == nDictSize;
+	if( fp )
+		bOk = ( fclose( fp ) == 0 ) && bOk;
+
+	if( !bOk )
+	{
+		fprintf( stderr, "TrainDemoArchiveDictionary: couldn't write %s.\n", outname );
+	}
+	return bOk;
+}
+
+/**
+ * Rewrites a demo as an archive, using the dictionary from LoadDemoArchiveDictionary() if there is one
+ *
+ * @param level the zstd compression level
+ */ 
+bool TranscodeDemoToArchive( const char *inname, const char *outname, int level )
+{
+	CDemoFile demofile;
+
+	if( !demofile.Open( inname ) )
+		return false;
+
+	FILE *fp = fopen( outname, "wb" );
+	if( !fp )
+	{
+		fprintf( stderr, "TranscodeDemoToArchive: couldn't create file %s.\n", outname );
+		return false;
+	}
+
+	demoarchiveheader_t ArchiveHeader;
+
+	memset( &ArchiveHeader, 0, sizeof( ArchiveHeader ) );
+	strcpy( ArchiveHeader.archivestamp, DEMOARCHIVE_HEADER_ID );
+	ArchiveHeader.version = DEMOARCHIVE_VERSION;
+	strcpy( ArchiveHeader.demoheader.demofilestamp, PROTODEMO_HEADER_ID );
+
+	bool bOk = fwrite( &ArchiveHeader, 1, sizeof( ArchiveHeader ), fp ) == sizeof( ArchiveHeader );
+
+	ZSTD_CCtx *pCCtx = ZSTD_createCCtx();
+	ZSTD_CDict *pCDict = NULL;
+
+	if( !s_Dictionary.empty() )
+	{
+		pCDict = ZSTD_createCDict( s_Dictionary.data(), s_Dictionary.size(), level );
+		ArchiveHeader.dict_id = s_nDictID;
+	}
+
+	std::vector< demoarchiveblock_t > blocks;
+	std::string block;
+	std::string compressed;
+	demoarchiveblock_t Block = { 0, 0, 0, 0 };
+	uint64 nFrameStreamSize = 0;
+	size_t nFileSize = sizeof( ArchiveHeader );
+	bool bDone = false;
+
+	while( bOk && !bDone )
+	{
+		int tick = 0;
+		size_t nFrameStart = block.size();
+		EDemoCommands DemoCommand = AppendDecompressedFrame( demofile, block, &tick );
+
+		if( DemoCommand == DEM_Error )
+		{
+			block.resize( nFrameStart );
+			bDone = true;
+		}
+		else
+		{
+			if( DemoCommand == DEM_FileInfo )
+			{
+				ArchiveHeader.demoheader.fileinfo_offset = sizeof( protodemoheader_t ) + nFrameStreamSize + nFrameStart;
+			}
+
+			if( !Block.num_frames )
+				Block.first_tick = tick;
+			Block.num_frames++;
+		}
+
+		if( block.size() >= DEMOARCHIVE_BLOCK_SIZE || ( bDone && !block.empty() ) )
+		{
+			compressed.resize( ZSTD_compressBound( block.size() ) );
+
+			size_t nCompressed = pCDict ?
+				ZSTD_compress_usingCDict( pCCtx, &compressed[ 0 ], compressed.size(), block.data(), block.size(), pCDict ) :
+				ZSTD_compressCCtx( pCCtx, &compressed[ 0 ], compressed.size(), block.data(), block.size(), level );
+
+			if( ZSTD_isError( nCompressed ) )
+			{
+				fprintf( stderr, "TranscodeDemoToArchive: %s.\n", ZSTD_getErrorName( nCompressed ) );
+				bOk = false;
+				break;
+			}
+
+			bOk = fwrite( compressed.data(), 1, nCompressed, fp ) == nCompressed;
+
+			Block.compressed_size = nCompressed;
+			Block.uncompressed_size = block.size();
+			blocks.push_back( Block );
+
+			nFileSize += nCompressed;
+			nFrameStreamSize += block.size();
+			block.clear();
+			memset( &Block, 0, sizeof( Block ) );
+		}
+	}
+
+	// DEM_Error is also what a corrupt frame gives, the archive would silently miss the rest of the demo
+	bool bCorrupt = !demofile.IsDone() || demofile.GetErrorCount();
+
+	ArchiveHeader.numblocks = blocks.size();
+	ArchiveHeader.blockindex_offset = nFileSize;
+	ArchiveHeader.framestream_size = nFrameStreamSize;
+
+	if( bOk && !blocks.empty() )
+	{
+		bOk = fwrite( &blocks[ 0 ], sizeof( demoarchiveblock_t ), blocks.size(), fp ) == blocks.size();
+	}
+
+	bOk = bOk && fseek( fp, 0, SEEK_SET ) == 0;
+	bOk = bOk && fwrite( &ArchiveHeader, 1, sizeof( ArchiveHeader ), fp ) == sizeof( ArchiveHeader );
+	bOk = ( fclose( fp ) == 0 ) && bOk;
+
+	ZSTD_freeCDict( pCDict );
+	ZSTD_freeCCtx( pCCtx );
+
+	if( !bOk )
+	{
+		fprintf( stderr, "TranscodeDemoToArchive: couldn't write %s.\n", outname );
+	}
+	else if( bCorrupt )
+	{
+		fprintf( stderr, "TranscodeDemoToArchive: %s is corrupt, %s only has the frames before the error.\n", inname, outname );
+		demofile.PrintErrors();
+	}
+	return bOk && !bCorrupt;
+}
+
+/**
+ * Reads an archive and decompresses its blocks in parallel into frameStream
+ *
+ * @param DemoHeader Will receive the header of the original demo
+ */ 
+bool ReadDemoArchive( FILE *fp, const char *name, std::string& frameStream, protodemoheader_t& DemoHeader )
+{
+	demoarchiveheader_t ArchiveHeader;
+
+	fseek( fp, 0, SEEK_END );
+	size_t Length = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	if( Length < sizeof( ArchiveHeader ) ||
+		fread( &ArchiveHeader, 1, sizeof( ArchiveHeader ), fp ) != sizeof( ArchiveHeader ) ||
+		strcmp( ArchiveHeader.archivestamp, DEMOARCHIVE_HEADER_ID ) ||
+		ArchiveHeader.version != DEMOARCHIVE_VERSION ||
+		ArchiveHeader.numblocks < 0 ||
+		ArchiveHeader.blockindex_offset < ( int32 )sizeof( ArchiveHeader ) ||
+		ArchiveHeader.blockindex_offset + ArchiveHeader.numblocks * sizeof( demoarchiveblock_t ) > Length )
+	{
+		fprintf( stderr, "ReadDemoArchive: bad archive header. %s.\n", name );
+		return false;
+	}
+
+	if( ArchiveHeader.dict_id && ArchiveHeader.dict_id != s_nDictID )
+	{
+		fprintf( stderr, "ReadDemoArchive: %s needs dictionary %u, load it with -dict.\n", name, ArchiveHeader.dict_id );
+		return false;
+	}
+
+	std::vector< demoarchiveblock_t > blocks( ArchiveHeader.numblocks );
+	std::string compressed( ArchiveHeader.blockindex_offset - sizeof( ArchiveHeader ), 0 );
+
+	if( ( !compressed.empty() && fread( &compressed[ 0 ], 1, compressed.size(), fp ) != compressed.size() ) ||
+		( !blocks.empty() && fread( &blocks[ 0 ], sizeof( demoarchiveblock_t ), blocks.size(), fp ) != blocks.size() ) )
+	{
+		fprintf( stderr, "ReadDemoArchive: file truncated. %s.\n", name );
+		return false;
+	}
+
+	// Every block knows where its input and output start, so they can be done in any order
+	std::vector< size_t > compressedOffsets( blocks.size() );
+	std::vector< size_t > uncompressedOffsets( blocks.size() );
+	size_t nCompressed = 0;
+	uint64 nUncompressed = 0;
+
+	bool bBlocksOk = true;
+
+	for( size_t i = 0; bBlocksOk && i < blocks.size(); i++ )
+	{
+		// The sizes come from the file, each block has to hold as much as its zstd frame says before
+		// the frame stream is allocated from them
+		bBlocksOk = blocks[ i ].compressed_size <= compressed.size() - nCompressed &&
+			ZSTD_getFrameContentSize( &compressed[ nCompressed ], blocks[ i ].compressed_size ) == blocks[ i ].uncompressed_size;
+
+		compressedOffsets[ i ] = nCompressed;
+		uncompressedOffsets[ i ] = nUncompressed;
+		nCompressed += blocks[ i ].compressed_size;
+		nUncompressed += blocks[ i ].uncompressed_size;
+	}
+
+	if( !bBlocksOk || nCompressed != compressed.size() || nUncompressed != ArchiveHeader.framestream_size )
+	{
+		fprintf( stderr, "ReadDemoArchive: block index doesn't match the file. %s.\n", name );
+		return false;
+	}
+
+	frameStream.resize( nUncompressed );
+
+	std::atomic< int > nextBlock( 0 );
+	std::atomic< bool > bFailed( false );
+	std::vector< std::thread > workers;
+	int numWorkers = std::min< int >( std::max( 1u, std::thread::hardware_concurrency() ), blocks.size() );
+
+	for( int i = 0; i < numWorkers; i++ )
+	{
+		workers.push_back( std::thread( [ & ]()
+		{
+			ZSTD_DCtx *pDCtx = ZSTD_createDCtx();
+
+			for( int iBlock = nextBlock++; iBlock < ( int )blocks.size() && !bFailed; iBlock = nextBlock++ )
+			{
+				const demoarchiveblock_t& Block = blocks[ iBlock ];
+				size_t nResult = ZSTD_decompress_usingDDict( pDCtx,
+					&frameStream[ uncompressedOffsets[ iBlock ] ], Block.uncompressed_size,
+					&compressed[ compressedOffsets[ iBlock ] ], Block.compressed_size, s_pDDict );
+
+				if( ZSTD_isError( nResult ) || nResult != Block.uncompressed_size )
+				{
+					bFailed = true;
+				}
+			}
+
+			ZSTD_freeDCtx( pDCtx );
+		} ) );
+	}
+
+	for( size_t i = 0; i < workers.size(); i++ )
+	{
+		workers[ i ].join();
+	}
+
+	if( bFailed )
+	{
+		fprintf( stderr, "ReadDemoArchive: block decompression failed. %s.\n", name );
+		frameStream.clear();
+		return false;
+	}
+
+	DemoHeader = ArchiveHeader.demoheader;
+	return true;
+}
@@ -0,0 +1,75 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOARCHIVE_H
+#define DEMOARCHIVE_H
+
+#include <stdio.h>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Archival container for demos.
+//
+// The frame stream of a demo is stored with every frame decompressed, grouped
+// into blocks of about DEMOARCHIVE_BLOCK_SIZE bytes, and each block is
+// compressed on its own with zstd, optionally against a dictionary trained
+// on a corpus of demos. A block index at the end of the file lets readers
+// decompress all blocks in parallel straight into their final place.
+//
+// CDemoFile::Open() reads archives transparently; the resulting frame stream
+// is the same as the original except that no frame is flagged compressed.
+//-----------------------------------------------------------------------------
+
+#define DEMOARCHIVE_HEADER_ID		"PBUFDMA"
+#define DEMOARCHIVE_VERSION			1
+#define DEMOARCHIVE_BLOCK_SIZE		( 1024 * 1024 )
+#define DEMOARCHIVE_DICT_SIZE		( 112 * 1024 )
+#define DEMOARCHIVE_DEFAULT_LEVEL	19
+
+struct demoarchiveheader_t
+{
+	char archivestamp[ 8 ]; // DEMOARCHIVE_HEADER_ID
+	int32 version;
+	uint32 dict_id;			// 0 if the blocks were compressed without a dictionary
+	int32 numblocks;
+	int32 blockindex_offset;
+	uint64 framestream_size;
+	protodemoheader_t demoheader; // fileinfo_offset points into the decompressed frame stream
+};
+
+struct demoarchiveblock_t
+{
+	int32 first_tick;
+	int32 num_frames;
+	uint32 compressed_size;
+	uint32 uncompressed_size;
+};
+
+bool	LoadDemoArchiveDictionary( const char *filename );
+bool	TrainDemoArchiveDictionary( const char *outname, int numfiles, char *filenames[] );
+bool	TranscodeDemoToArchive( const char *inname, const char *outname, int level );
+
+bool	ReadDemoArchive( FILE *fp, const char *name, std::string& frameStream, protodemoheader_t& DemoHeader );
+
+#endif // DEMOARCHIVE_H
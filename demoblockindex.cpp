@@ -0,0 +1,570 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "demoblockindex.h"
+#include "demofiledump.h"
+#include "schemacache.h"
+
+#include "generated_proto/usermessages.pb.h"
+#include "generated_proto/dota_usermessages.pb.h"
+#include "generated_proto/flatdecoders.h"
+
+static const int s_nBitmapWords[ DEMOBLOCKINDEX_BITMAP_MAX ] = { DEMOBLOCKINDEX_MESSAGE_WORDS, DEMOBLOCKINDEX_USER_WORDS, DEMOBLOCKINDEX_EVENT_WORDS };
+
+static const uint64 *GetBitmap( const demoblock_t& Block, EDemoBlockIndexBitmap bitmap )
+{
+	switch( bitmap )
+	{
+	case DEMOBLOCKINDEX_MESSAGE:		return Block.messages;
+	case DEMOBLOCKINDEX_USER_MESSAGE:	return Block.user_messages;
+	default:							return Block.game_events;
+	}
+}
+
+static uint32 GetBit( EDemoBlockIndexBitmap bitmap, int id )
+{
+	return ( uint32 )id % ( s_nBitmapWords[ bitmap ] * 64 );
+}
+
+/**
+ * Reads an int32 field without decoding the rest of the message, false if it isn't there
+ */ 
+bool ReadInt32Field( const char *pData, int size, uint32 field, int32 *pValue )
+{
+	CFlatReader reader( pData, size );
+	bool bFound = false;
+
+	while( !reader.AtEnd() )
+	{
+		uint32_t tag;
+		uint64_t value;
+
+		if( !reader.ReadTag( &tag ) )
+			return false;
+
+		if( ( tag >> 3 ) == field && ( tag & 7 ) == 0 )
+		{
+			if( !reader.ReadVarint64( &value ) )
+				return false;
+
+			*pValue = ( int32 )value;
+			bFound = true;
+		}
+		else if( !reader.SkipField( tag ) )
+		{
+			return false;
+		}
+	}
+
+	return bFound;
+}
+
+void CDemoBlockIndex::BeginBuild()
+{
+	m_blocks.clear();
+	m_eventList.clear();
+}
+
+/**
+ * Starts a new block every DEMOBLOCKINDEX_FRAMES frames, the packets that follow go into it
+ */ 
+void CDemoBlockIndex::AddFrame( size_t nFramePos, size_t nEndPos, int nFrameNumber, int tick )
+{
+	if( m_blocks.empty() || nFrameNumber - m_blocks.back().first_frame >= DEMOBLOCKINDEX_FRAMES )
+	{
+		demoblock_t Block;
+
+		memset( &Block, 0, sizeof( Block ) );
+		Block.frame_pos = nFramePos;
+		Block.first_frame = nFrameNumber;
+		Block.first_tick = tick;
+		m_blocks.push_back( Block );
+	}
+
+	demoblock_t& Block = m_blocks.back();
+	Block.end_pos = nEndPos;
+	Block.last_tick = std::max( Block.last_tick, tick );
+}
+
+void CDemoBlockIndex::AddPacket( const char *pData, int size )
+{
+	CFlatReader reader( pData, size );
+	demoblock_t& Block = m_blocks.back();
+
+	while( !reader.AtEnd() )
+	{
+		uint64_t Cmd;
+		std::string_view msg;
+		int32 id;
+
+		if( !reader.ReadVarint64( &Cmd ) || !reader.ReadBytes( &msg ) )
+			return;
+
+		uint32 bit = GetBit( DEMOBLOCKINDEX_MESSAGE, ( int )Cmd );
+		Block.messages[ bit / 64 ] |= 1ULL << ( bit % 64 );
+
+		if( Cmd == svc_UserMessage && ReadInt32Field( msg.data(), ( int )msg.size(), CSVCMsg_UserMessage::kMsgTypeFieldNumber, &id ) )
+		{
+			bit = GetBit( DEMOBLOCKINDEX_USER_MESSAGE, id );
+			Block.user_messages[ bit / 64 ] |= 1ULL << ( bit % 64 );
+		}
+		else if( Cmd == svc_GameEvent && ReadInt32Field( msg.data(), ( int )msg.size(), CSVCMsg_GameEvent::kEventidFieldNumber, &id ) )
+		{
+			bit = GetBit( DEMOBLOCKINDEX_GAME_EVENT, id );
+			Block.game_events[ bit / 64 ] |= 1ULL << ( bit % 64 );
+		}
+		else if( Cmd == svc_GameEventList )
+		{
+			AddGameEventList( msg.data(), ( int )msg.size() );
+		}
+	}
+}
+
+void CDemoBlockIndex::AddGameEventList( const char *pData, int size )
+{
+	m_eventList.assign( pData, size );
+}
+
+bool CDemoBlockIndex::MayContain( int nBlock, EDemoBlockIndexBitmap bitmap, int id ) const
+{
+	uint32 bit = GetBit( bitmap, id );
+	const uint64 *pWords = GetBitmap( m_blocks[ nBlock ], bitmap );
+
+	return ( pWords[ bit / 64 ] >> ( bit % 64 ) ) & 1;
+}
+
+bool CDemoBlockIndex::Write( const char *filename, CDemoFile& demofile )
+{
+	demoblockindexheader_t Header;
+
+	memset( &Header, 0, sizeof( Header ) );
+	memcpy( Header.blockindexstamp, DEMOBLOCKINDEX_HEADER_ID, sizeof( Header.blockindexstamp ) );
+	Header.version = DEMOBLOCKINDEX_VERSION;
+	Header.frames_per_block = DEMOBLOCKINDEX_FRAMES;
+	Header.demo_size = demofile.GetSize();
+	Header.fileinfo_offset = demofile.GetFileInfoOffset();
+	Header.num_blocks = ( uint32 )m_blocks.size();
+	Header.event_list_size = ( uint32 )m_eventList.size();
+	GetDemoFileHash( demofile, &Header.demo_hash );
+
+	std::string tmpname = std::string( filename ) + ".tmp";
+	FILE *fp = fopen( tmpname.c_str(), "wb" );
+	if( !fp )
+	{
+		fprintf( stderr, "CDemoBlockIndex::Write: couldn't open %s.\n", tmpname.c_str() );
+		return false;
+	}
+
+	bool bOk = fwrite( &Header, sizeof( Header ), 1, fp ) == 1;
+	bOk = bOk && ( m_blocks.empty() || fwrite( m_blocks.data(), sizeof( demoblock_t ), m_blocks.size(), fp ) == m_blocks.size() );
+	bOk = bOk && ( m_eventList.empty() || fwrite( m_eventList.data(), 1, m_eventList.size(), fp ) == m_eventList.size() );
+	bOk = ( fclose( fp ) == 0 ) && bOk;
+
+	if( !bOk || rename( tmpname.c_str(), filename ) != 0 )
+	{
+		fprintf( stderr, "CDemoBlockIndex::Write: couldn't write %s.\n", filename );
+		remove( tmpname.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+bool CDemoBlockIndex::Build( const char *filename )
+{
+	CDemoFile demofile;
+
+	if( !demofile.Open( filename ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
+
+	BeginBuild();
+
+	for( int nFrameNumber = 0; !demofile.IsDone(); nFrameNumber++ )
+	{
+		int tick = 0;
+		bool bCompressed;
+		bool bFrameOk = false;
+		size_t nFramePos = demofile.GetPos();
+		const char *pData;
+		int DataSize;
+
+		EDemoCommands DemoCommand = demofile.ReadMessageType( &tick, &bCompressed );
+
+		switch( DemoCommand )
+		{
+		case DEM_Packet:
+		case DEM_SignonPacket:
+		case DEM_FullPacket:
+			bFrameOk = demofile.ReadMessageData( bCompressed, &pData, &DataSize );
+			break;
+
+		case DEM_Error:
+			break;
+
+		default:
+			bFrameOk = demofile.ReadRawMessage( NULL, NULL );
+			break;
+		}
+
+		if( !bFrameOk )
+		{
+			if( !demofile.Resync( nFramePos ) )
+				break;
+			continue;
+		}
+
+		AddFrame( nFramePos, demofile.GetPos(), nFrameNumber, tick );
+
+		if( DemoCommand == DEM_FullPacket )
+		{
+			StringTableList_t Tables;
+			CDemoPacket Packet;
+
+			if( ParseFullPacketInterned( pData, DataSize, Tables, Packet ) )
+				AddPacket( Packet.data().data(), ( int )Packet.data().size() );
+		}
+		else if( DemoCommand == DEM_Packet || DemoCommand == DEM_SignonPacket )
+		{
+			CFlat_CDemoPacket Packet;
+
+			if( Packet.Decode( pData, DataSize ) )
+				AddPacket( Packet.data().data(), ( int )Packet.data().size() );
+		}
+	}
+
+	return Finish( filename, demofile );
+}
+
+bool CDemoBlockIndex::Finish( const char *filename, CDemoFile& demofile )
+{
+	bool bOk = Write( ( std::string( filename ) + DEMOBLOCKINDEX_FILE_EXTENSION ).c_str(), demofile );
+
+	fprintf( stderr, "%s: %d blocks of %d frames.\n", filename, ( int )m_blocks.size(), DEMOBLOCKINDEX_FRAMES );
+	return bOk;
+}
+
+bool CDemoBlockIndex::Load( const char *filename, CDemoFile& demofile )
+{
+	std::string bidxname = std::string( filename ) + DEMOBLOCKINDEX_FILE_EXTENSION;
+	FILE *fp = fopen( bidxname.c_str(), "rb" );
+
+	m_blocks.clear();
+	m_eventList.clear();
+
+	if( !fp )
+		return false;
+
+	demoblockindexheader_t Header;
+	bool bOk = fread( &Header, sizeof( Header ), 1, fp ) == 1 &&
+		!memcmp( Header.blockindexstamp, DEMOBLOCKINDEX_HEADER_ID, sizeof( Header.blockindexstamp ) ) &&
+		Header.version == DEMOBLOCKINDEX_VERSION;
+
+	if( bOk )
+	{
+		fseek( fp, 0, SEEK_END );
+		uint64 nFileSize = ftell( fp );
+		fseek( fp, sizeof( Header ), SEEK_SET );
+
+		bOk = ( nFileSize == sizeof( Header ) + ( uint64 )Header.num_blocks * sizeof( demoblock_t ) + Header.event_list_size );
+	}
+
+	if( bOk )
+	{
+		m_blocks.resize( Header.num_blocks );
+		m_eventList.resize( Header.event_list_size );
+
+		bOk = ( m_blocks.empty() || fread( m_blocks.data(), sizeof( demoblock_t ), m_blocks.size(), fp ) == m_blocks.size() ) &&
+			( m_eventList.empty() || fread( &m_eventList[ 0 ], 1, m_eventList.size(), fp ) == m_eventList.size() );
+	}
+
+	fclose( fp );
+
+	for( size_t i = 0; bOk && i < m_blocks.size(); i++ )
+		bOk = m_blocks[ i ].frame_pos <= m_blocks[ i ].end_pos && m_blocks[ i ].end_pos <= Header.demo_size;
+
+	if( !bOk )
+	{
+		fprintf( stderr, "CDemoBlockIndex::Load: %s is not a version %d block index.\n", bidxname.c_str(), DEMOBLOCKINDEX_VERSION );
+		m_blocks.clear();
+		m_eventList.clear();
+		return false;
+	}
+
+	uint64 hash;
+	if( Header.demo_size != demofile.GetSize() || Header.fileinfo_offset != demofile.GetFileInfoOffset() ||
+		!GetDemoFileHash( demofile, &hash ) || hash != Header.demo_hash )
+	{
+		fprintf( stderr, "CDemoBlockIndex::Load: %s is for a different version of %s.\n", bidxname.c_str(), filename );
+		m_blocks.clear();
+		m_eventList.clear();
+		return false;
+	}
+
+	return true;
+}
+
+struct find_query_t
+{
+	std::vector< int > ids[ DEMOBLOCKINDEX_BITMAP_MAX ];
+};
+
+/**
+ * Turns a term value into an id: a number, or a name looked up with Lookup
+ */ 
+template < class LOOKUP >
+static bool ParseFindId( const char *pValue, LOOKUP Lookup, int *pId )
+{
+	char *pEnd;
+	long id = strtol( pValue, &pEnd, 10 );
+
+	if( *pValue && !*pEnd )
+	{
+		*pId = ( int )id;
+		return true;
+	}
+
+	return Lookup( pValue, pId );
+}
+
+static bool ParseFindTerms( int nTerms, char **ppTerms, const CGameEventSchema *pSchema, find_query_t& Query )
+{
+	for( int i = 0; i < nTerms; i++ )
+	{
+		const char *pTerm = ppTerms[ i ];
+		int id = 0;
+		bool bOk = false;
+
+		if( !strncmp( pTerm, "msg=", 4 ) )
+		{
+			bOk = ParseFindId( pTerm + 4, []( const char *pName, int *pId )
+			{
+				NET_Messages NetMsg;
+				SVC_Messages SvcMsg;
+
+				if( NET_Messages_Parse( pName, &NetMsg ) )
+					*pId = NetMsg;
+				else if( SVC_Messages_Parse( pName, &SvcMsg ) )
+					*pId = SvcMsg;
+				else
+					return false;
+				return true;
+			}, &id );
+			Query.ids[ DEMOBLOCKINDEX_MESSAGE ].push_back( id );
+		}
+		else if( !strncmp( pTerm, "um=", 3 ) )
+		{
+			bOk = ParseFindId( pTerm + 3, []( const char *pName, int *pId )
+			{
+				EBaseUserMessages BaseMsg;
+				EDotaUserMessages DotaMsg;
+
+				if( EBaseUserMessages_Parse( pName, &BaseMsg ) )
+					*pId = BaseMsg;
+				else if( EDotaUserMessages_Parse( pName, &DotaMsg ) )
+					*pId = DotaMsg;
+				else
+					return false;
+				return true;
+			}, &id );
+			Query.ids[ DEMOBLOCKINDEX_USER_MESSAGE ].push_back( id );
+		}
+		else if( !strncmp( pTerm, "event=", 6 ) )
+		{
+			bOk = ParseFindId( pTerm + 6, [pSchema]( const char *pName, int *pId )
+			{
+				const CSVCMsg_GameEventList *pList = pSchema ? &pSchema->m_GameEventList : NULL;
+
+				for( int j = 0; pList && j < pList->descriptors_size(); j++ )
+				{
+					if( pList->descriptors( j ).name() == pName )
+					{
+						*pId = pList->descriptors( j ).eventid();
+						return true;
+					}
+				}
+				return false;
+			}, &id );
+			Query.ids[ DEMOBLOCKINDEX_GAME_EVENT ].push_back( id );
+		}
+
+		if( !bOk )
+		{
+			fprintf( stderr, "Unknown find term '%s', expected msg=, um= or event= with a name or id.\n", pTerm );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Prints the messages in a packet that are in the query
+ */ 
+static int FindInPacket( CDemoFileDump& Dump, const find_query_t& Query, const char *pData, int size, int nFrameNumber, int tick )
+{
+	CFlatReader reader( pData, size );
+	int nFound = 0;
+
+	while( !reader.AtEnd() )
+	{
+		uint64_t Cmd;
+		std::string_view msg;
+		int32 id;
+
+		if( !reader.ReadVarint64( &Cmd ) || !reader.ReadBytes( &msg ) )
+			break;
+
+		const std::vector< int > *pIds = &Query.ids[ DEMOBLOCKINDEX_MESSAGE ];
+		bool bMatch = std::find( pIds->begin(), pIds->end(), ( int )Cmd ) != pIds->end();
+
+		if( !bMatch && Cmd == svc_UserMessage && ReadInt32Field( msg.data(), ( int )msg.size(), CSVCMsg_UserMessage::kMsgTypeFieldNumber, &id ) )
+		{
+			pIds = &Query.ids[ DEMOBLOCKINDEX_USER_MESSAGE ];
+			bMatch = std::find( pIds->begin(), pIds->end(), id ) != pIds->end();
+		}
+		else if( !bMatch && Cmd == svc_GameEvent && ReadInt32Field( msg.data(), ( int )msg.size(), CSVCMsg_GameEvent::kEventidFieldNumber, &id ) )
+		{
+			pIds = &Query.ids[ DEMOBLOCKINDEX_GAME_EVENT ];
+			bMatch = std::find( pIds->begin(), pIds->end(), id ) != pIds->end();
+		}
+
+		if( bMatch )
+		{
+			printf( "==== #%d: Tick:%d ====\n", nFrameNumber, tick );
+			Dump.DumpNetMessage( ( int )Cmd, msg.data(), ( int )msg.size() );
+			nFound++;
+		}
+	}
+
+	return nFound;
+}
+
+/**
+ * Reads only the blocks whose bitmaps say they may have one of the messages asked for
+ */ 
+bool FindInDemo( const char *filename, int nTerms, char **ppTerms )
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CDemoFileDump Dump;
+	CDemoBlockIndex Index;
+
+	if( !Dump.Open( filename ) )
+		return false;
+
+	if( !Index.Load( filename, Dump.m_demofile ) )
+	{
+		fprintf( stderr, "No block index for '%s', make one with -blockindex.\n", filename );
+		return false;
+	}
+
+	const std::string& EventList = Index.GetGameEventList();
+	Dump.m_pGameEventSchema = CSchemaCache< CGameEventSchema >::Intern( EventList.data(), ( int )EventList.size() );
+
+	find_query_t Query;
+	if( !ParseFindTerms( nTerms, ppTerms, Dump.m_pGameEventSchema.get(), Query ) )
+		return false;
+
+	int nBlocksRead = 0;
+	int nFound = 0;
+
+	for( int nBlock = 0; nBlock < Index.GetBlockCount(); nBlock++ )
+	{
+		bool bMayContain = false;
+
+		for( int bitmap = 0; bitmap < DEMOBLOCKINDEX_BITMAP_MAX && !bMayContain; bitmap++ )
+		{
+			for( size_t i = 0; i < Query.ids[ bitmap ].size() && !bMayContain; i++ )
+				bMayContain = Index.MayContain( nBlock, ( EDemoBlockIndexBitmap )bitmap, Query.ids[ bitmap ][ i ] );
+		}
+
+		if( !bMayContain )
+			continue;
+
+		const demoblock_t& Block = Index.GetBlock( nBlock );
+		CDemoFile& demofile = Dump.m_demofile;
+
+		demofile.SetPos( Block.frame_pos );
+		nBlocksRead++;
+
+		for( int nFrameNumber = Block.first_frame; demofile.GetPos() < Block.end_pos && !demofile.IsDone(); nFrameNumber++ )
+		{
+			int tick = 0;
+			bool bCompressed;
+			size_t nFramePos = demofile.GetPos();
+			const char *pData;
+			int DataSize;
+
+			EDemoCommands DemoCommand = demofile.ReadMessageType( &tick, &bCompressed );
+			bool bFrameOk = false;
+
+			switch( DemoCommand )
+			{
+			case DEM_Packet:
+			case DEM_SignonPacket:
+				{
+					CFlat_CDemoPacket Packet;
+
+					bFrameOk = demofile.ReadMessageData( bCompressed, &pData, &DataSize ) && Packet.Decode( pData, DataSize );
+					if( bFrameOk )
+						nFound += FindInPacket( Dump, Query, Packet.data().data(), ( int )Packet.data().size(), nFrameNumber, tick );
+				}
+				break;
+
+			case DEM_FullPacket:
+				{
+					StringTableList_t Tables;
+					CDemoPacket Packet;
+
+					bFrameOk = demofile.ReadMessageData( bCompressed, &pData, &DataSize ) && ParseFullPacketInterned( pData, DataSize, Tables, Packet );
+					if( bFrameOk )
+						nFound += FindInPacket( Dump, Query, Packet.data().data(), ( int )Packet.data().size(), nFrameNumber, tick );
+				}
+				break;
+
+			case DEM_Error:
+				break;
+
+			default:
+				bFrameOk = demofile.ReadRawMessage( NULL, NULL );
+				break;
+			}
+
+			if( !bFrameOk && !demofile.Resync( nFramePos ) )
+				break;
+		}
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	fprintf( stderr, "%d matches, read %d of %d blocks in %.2f ms.\n", nFound, nBlocksRead, Index.GetBlockCount(),
+		std::chrono::duration< double, std::milli >( end - start ).count() );
+	return true;
+}
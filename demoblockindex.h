@@ -0,0 +1,130 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOBLOCKINDEX_H
+#define DEMOBLOCKINDEX_H
+
+#include <string>
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Side file (filename.dem.bidx) that splits a demo into blocks of frames and
+// records which net messages, user messages and game events each block
+// contains, as bitmaps. Searching for a rare message then only has to read
+// the blocks whose bitmap has its bit set instead of the whole demo.
+//
+// Ids are folded into the bitmaps modulo their size, so a set bit may be a
+// false positive but a clear bit never misses anything.
+//-----------------------------------------------------------------------------
+
+#define DEMOBLOCKINDEX_HEADER_ID		"DEMOBIDX"
+#define DEMOBLOCKINDEX_VERSION			1
+#define DEMOBLOCKINDEX_FILE_EXTENSION	".bidx"
+#define DEMOBLOCKINDEX_FRAMES			64		// frames per block, a couple of seconds of game
+
+#define DEMOBLOCKINDEX_MESSAGE_WORDS	1		// NET_Messages and SVC_Messages
+#define DEMOBLOCKINDEX_USER_WORDS		4		// EBaseUserMessages and EDotaUserMessages
+#define DEMOBLOCKINDEX_EVENT_WORDS		8		// game event ids
+
+enum EDemoBlockIndexBitmap
+{
+	DEMOBLOCKINDEX_MESSAGE = 0,
+	DEMOBLOCKINDEX_USER_MESSAGE,
+	DEMOBLOCKINDEX_GAME_EVENT,
+
+	DEMOBLOCKINDEX_BITMAP_MAX
+};
+
+struct demoblockindexheader_t
+{
+	char blockindexstamp[ 8 ];	// DEMOBLOCKINDEX_HEADER_ID
+	int32 version;
+	int32 frames_per_block;
+
+	// The demo the index is for, see GetDemoFileHash()
+	uint64 demo_size;
+	uint64 demo_hash;
+	int32 fileinfo_offset;
+
+	uint32 num_blocks;			// demoblock_t
+	uint32 event_list_size;		// encoded CSVCMsg_GameEventList after the blocks, to look events up by name
+	uint32 reserved;
+};
+
+struct demoblock_t
+{
+	uint64 frame_pos;			// CDemoFile::GetPos() of the first frame
+	uint64 end_pos;				// and of the frame after the last one
+	int32 first_frame;
+	int32 first_tick;
+	int32 last_tick;
+	int32 reserved;
+
+	uint64 messages[ DEMOBLOCKINDEX_MESSAGE_WORDS ];
+	uint64 user_messages[ DEMOBLOCKINDEX_USER_WORDS ];
+	uint64 game_events[ DEMOBLOCKINDEX_EVENT_WORDS ];
+};
+
+class CDemoBlockIndex
+{
+public:
+	CDemoBlockIndex() {}
+	~CDemoBlockIndex() {}
+
+	// Building, call AddFrame() for every frame read and AddPacket() for the packets in it
+	void	BeginBuild();
+	void	AddFrame( size_t nFramePos, size_t nEndPos, int nFrameNumber, int tick );
+	void	AddPacket( const char *pData, int size );
+	void	AddGameEventList( const char *pData, int size );
+	bool	Write( const char *filename, CDemoFile& demofile );
+
+	// Writes filename.bidx for the frames added since BeginBuild(), demofile is filename still open
+	bool	Finish( const char *filename, CDemoFile& demofile );
+
+	// Parses filename and writes filename.bidx, for when the frames aren't read anyway (see CDemoFileDump::SetBlockIndex())
+	bool	Build( const char *filename );
+
+	// Reads filename.bidx, false if there isn't one or it is for a different demo
+	bool	Load( const char *filename, CDemoFile& demofile );
+
+	int		GetBlockCount() const							{ return ( int )m_blocks.size(); }
+	const demoblock_t& GetBlock( int nBlock ) const			{ return m_blocks[ nBlock ]; }
+	const std::string& GetGameEventList() const				{ return m_eventList; }
+
+	// Could the block contain id, see EDemoBlockIndexBitmap
+	bool	MayContain( int nBlock, EDemoBlockIndexBitmap bitmap, int id ) const;
+
+private:
+	std::vector< demoblock_t > m_blocks;
+	std::string m_eventList;
+};
+
+// Reads an int32 field out of an encoded message without decoding the rest of it
+bool	ReadInt32Field( const char *pData, int size, uint32 field, int32 *pValue );
+
+// The -find mode, prints the messages that match the msg=, um= and event= terms
+bool	FindInDemo( const char *filename, int nTerms, char **ppTerms );
+
+#endif // DEMOBLOCKINDEX_H
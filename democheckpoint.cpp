@@ -0,0 +1,629 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <string.h>
+#include "democheckpoint.h"
+#include "snappy.h"
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
+#include "generated_proto/flatdecoders.h"
+
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+/**
+ * Returns the string table called name for changing it, copied first unless the state is the only
+ * one holding on to it. A table only the state holds was copied or created here, so it isn't const.
+ */ 
+static CDemoStringTables::table_t *GetWritableStringTable( StringTableList_t& Tables, const std::string& name )
+{
+	for( size_t i = 0; i < Tables.size(); i++ )
+	{
+		if( Tables[ i ]->table_name() != name )
+			continue;
+
+		if( Tables[ i ].use_count() != 1 )
+			Tables[ i ] = std::make_shared< CDemoStringTables::table_t >( *Tables[ i ] );
+
+		return const_cast< CDemoStringTables::table_t * >( Tables[ i ].get() );
+	}
+
+	std::shared_ptr< CDemoStringTables::table_t > pTable = std::make_shared< CDemoStringTables::table_t >();
+
+	pTable->set_table_name( name );
+	Tables.push_back( pTable );
+	return pTable.get();
+}
+
+/**
+ * The key history of later updates needs the keys the tables have now, after a snapshot replaced them
+ */ 
+static void SyncStringTableKeys( demo_parser_state_t& State )
+{
+	for( size_t i = 0; i < State.StringTableInfo.size(); i++ )
+	{
+		demo_string_table_info_t& Info = State.StringTableInfo[ i ];
+
+		for( size_t j = 0; j < State.StringTables.size(); j++ )
+		{
+			if( State.StringTables[ j ]->table_name() != Info.name )
+				continue;
+
+			Info.keys.resize( State.StringTables[ j ]->items_size() );
+			for( int k = 0; k < State.StringTables[ j ]->items_size(); k++ )
+				Info.keys[ k ] = State.StringTables[ j ]->items( k ).str();
+			break;
+		}
+	}
+}
+
+/**
+ * Applies the entries of svc_CreateStringTable or svc_UpdateStringTable. A table whose entries
+ * can't be decoded is left as of the last snapshot.
+ */ 
+static void UpdateStringTable( demo_parser_state_t& State, demo_string_table_info_t& Info, const char *pData, int size, int nEntries )
+{
+	std::vector< demo_string_table_entry_t > Entries;
+
+	if( !DecodeStringTableEntries( Info, pData, size, nEntries, Entries ) || Entries.empty() )
+		return;
+
+	CDemoStringTables::table_t *pTable = GetWritableStringTable( State.StringTables, Info.name );
+
+	for( size_t i = 0; i < Entries.size(); i++ )
+	{
+		const demo_string_table_entry_t& Entry = Entries[ i ];
+
+		while( pTable->items_size() <= Entry.index )
+			pTable->add_items();
+
+		CDemoStringTables::items_t *pItem = pTable->mutable_items( Entry.index );
+
+		if( Entry.bHaveStr )
+			pItem->set_str( Entry.str );
+		if( Entry.bHaveData )
+			pItem->set_data( Entry.data );
+	}
+}
+
+/**
+ * Follows the messages in a packet that change the state
+ */ 
+static bool UpdateParserStateFromPacket( demo_parser_state_t& State, const char *pData, int size )
+{
+	CFlatReader reader( pData, size );
+
+	while( !reader.AtEnd() )
+	{
+		uint64_t Cmd;
+		std::string_view msg;
+
+		if( !reader.ReadVarint64( &Cmd ) || !reader.ReadBytes( &msg ) )
+			return false;
+
+		if( Cmd == svc_ServerInfo )
+		{
+			std::shared_ptr< const CSVCMsg_ServerInfo > pServerInfo = CSchemaCache< CSVCMsg_ServerInfo >::Intern( msg.data(), ( int )msg.size() );
+
+			if( pServerInfo )
+				State.pServerInfo = pServerInfo;
+		}
+		else if( Cmd == svc_GameEventList )
+		{
+			std::shared_ptr< const CGameEventSchema > pSchema = CSchemaCache< CGameEventSchema >::Intern( msg.data(), ( int )msg.size() );
+
+			if( pSchema )
+				State.pGameEventSchema = pSchema;
+		}
+		else if( Cmd == svc_CreateStringTable )
+		{
+			CSVCMsg_CreateStringTable CreateMsg;
+
+			// Table ids are the create order, a table that doesn't parse still takes one
+			State.StringTableInfo.push_back( demo_string_table_info_t() );
+
+			demo_string_table_info_t& Info = State.StringTableInfo.back();
+			Info.max_entries = 0;
+			Info.user_data_fixed_size = false;
+			Info.user_data_size_bits = 0;
+
+			if( !CreateMsg.ParseFromArray( msg.data(), ( int )msg.size() ) )
+				continue;
+
+			Info.name = CreateMsg.name();
+			Info.max_entries = CreateMsg.max_entries();
+			Info.user_data_fixed_size = CreateMsg.user_data_fixed_size();
+			Info.user_data_size_bits = CreateMsg.user_data_size_bits();
+
+			UpdateStringTable( State, Info, CreateMsg.string_data().data(), ( int )CreateMsg.string_data().size(), CreateMsg.num_entries() );
+		}
+		else if( Cmd == svc_UpdateStringTable )
+		{
+			CFlat_CSVCMsg_UpdateStringTable UpdateMsg;
+
+			if( !UpdateMsg.Decode( msg.data(), ( int )msg.size() ) ||
+				UpdateMsg.table_id() < 0 || UpdateMsg.table_id() >= ( int )State.StringTableInfo.size() )
+				continue;
+
+			UpdateStringTable( State, State.StringTableInfo[ UpdateMsg.table_id() ], UpdateMsg.string_data().data(),
+				( int )UpdateMsg.string_data().size(), UpdateMsg.num_changed_entries() );
+		}
+	}
+
+	return true;
+}
+
+bool UpdateParserState( demo_parser_state_t& State, EDemoCommands DemoCommand, const char *pData, int size )
+{
+	switch( DemoCommand )
+	{
+	case DEM_SendTables:
+		{
+			std::shared_ptr< const CDemoSendTables > pSendTables = CSchemaCache< CDemoSendTables >::Intern( pData, size );
+
+			if( !pSendTables )
+				return false;
+			State.pSendTables = pSendTables;
+		}
+		return true;
+
+	case DEM_ClassInfo:
+		{
+			std::shared_ptr< const CDemoClassInfo > pClassInfo = CSchemaCache< CDemoClassInfo >::Intern( pData, size );
+
+			if( !pClassInfo )
+				return false;
+			State.pClassInfo = pClassInfo;
+		}
+		return true;
+
+	case DEM_StringTables:
+		if( !ParseStringTablesInterned( pData, size, State.StringTables ) )
+			return false;
+
+		SyncStringTableKeys( State );
+		return true;
+
+	case DEM_FullPacket:
+		{
+			CDemoPacket Packet;
+
+			if( !ParseFullPacketInterned( pData, size, State.StringTables, Packet ) )
+				return false;
+
+			SyncStringTableKeys( State );
+
+			return UpdateParserStateFromPacket( State, Packet.data().data(), ( int )Packet.data().size() );
+		}
+
+	case DEM_Packet:
+	case DEM_SignonPacket:
+		{
+			CFlat_CDemoPacket Packet;
+
+			if( !Packet.Decode( pData, size ) )
+				return false;
+
+			return UpdateParserStateFromPacket( State, Packet.data().data(), ( int )Packet.data().size() );
+		}
+
+	default:
+		return true;
+	}
+}
+
+/**
+ * Adds the serialized object as a blob, unless an identical one is already there
+ */ 
+template < class T >
+void CDemoCheckpoints::AddBlob( EDemoCheckpointBlob type, const std::shared_ptr< const T >& pObject, const ::google::protobuf::Message& Msg )
+{
+	std::unordered_map< const void *, uint32 >::const_iterator it = m_objectBlobs.find( pObject.get() );
+
+	if( it != m_objectBlobs.end() )
+	{
+		m_refs.push_back( it->second );
+		return;
+	}
+
+	m_objectBlobs[ pObject.get() ] = AddBlob( type, Msg );
+	m_objects.push_back( pObject );
+}
+
+/**
+ * Adds the serialized message as a blob, unless one with the same content is already there
+ */ 
+uint32 CDemoCheckpoints::AddBlob( EDemoCheckpointBlob type, const ::google::protobuf::Message& Msg )
+{
+	std::string data;
+	std::string compressed;
+
+	Msg.SerializeToString( &data );
+	snappy::Compress( data.data(), data.size(), &compressed );
+
+	uint64 hash = HashBytes64( compressed.data(), compressed.size(), type );
+	uint32 nBlob = ( uint32 )m_blobs.size();
+
+	auto range = m_blobsByHash.equal_range( hash );
+	for( auto itHash = range.first; itHash != range.second; ++itHash )
+	{
+		const democheckpointblob_t& Blob = m_blobs[ itHash->second ];
+
+		if( Blob.type == ( uint32 )type && Blob.size == compressed.size() && !memcmp( &m_data[ Blob.offset ], compressed.data(), Blob.size ) )
+		{
+			nBlob = itHash->second;
+			break;
+		}
+	}
+
+	if( nBlob == m_blobs.size() )
+	{
+		democheckpointblob_t Blob;
+
+		Blob.type = type;
+		Blob.size = ( uint32 )compressed.size();
+		Blob.offset = m_data.size();
+		m_blobs.push_back( Blob );
+		m_blobsByHash.insert( std::make_pair( hash, nBlob ) );
+		m_data += compressed;
+	}
+
+	m_refs.push_back( nBlob );
+	return nBlob;
+}
+
+void CDemoCheckpoints::AddCheckpoint( const demo_parser_state_t& State )
+{
+	democheckpoint_t Checkpoint;
+
+	Checkpoint.tick = State.tick;
+	Checkpoint.frame_number = State.frame_number;
+	Checkpoint.frame_pos = State.frame_pos;
+	Checkpoint.first_ref = ( uint32 )m_refs.size();
+
+	if( State.pSendTables )
+		AddBlob( DEMOCHECKPOINT_BLOB_SEND_TABLES, State.pSendTables, *State.pSendTables );
+	if( State.pClassInfo )
+		AddBlob( DEMOCHECKPOINT_BLOB_CLASS_INFO, State.pClassInfo, *State.pClassInfo );
+	if( State.pServerInfo )
+		AddBlob( DEMOCHECKPOINT_BLOB_SERVER_INFO, State.pServerInfo, *State.pServerInfo );
+	if( State.pGameEventSchema )
+		AddBlob( DEMOCHECKPOINT_BLOB_GAME_EVENT_LIST, State.pGameEventSchema, State.pGameEventSchema->m_GameEventList );
+
+	for( size_t i = 0; i < State.StringTables.size(); i++ )
+		AddBlob( DEMOCHECKPOINT_BLOB_STRING_TABLE, State.StringTables[ i ], *State.StringTables[ i ] );
+
+	for( size_t i = 0; i < State.StringTableInfo.size(); i++ )
+	{
+		CSVCMsg_CreateStringTable Info;
+
+		Info.set_name( State.StringTableInfo[ i ].name );
+		Info.set_max_entries( State.StringTableInfo[ i ].max_entries );
+		Info.set_user_data_fixed_size( State.StringTableInfo[ i ].user_data_fixed_size );
+		Info.set_user_data_size_bits( State.StringTableInfo[ i ].user_data_size_bits );
+		AddBlob( DEMOCHECKPOINT_BLOB_STRING_TABLE_INFO, Info );
+	}
+
+	Checkpoint.num_refs = ( uint32 )m_refs.size() - Checkpoint.first_ref;
+	m_checkpoints.push_back( Checkpoint );
+}
+
+/**
+ * Reads the whole demo, taking a checkpoint before the first frame of every nInterval ticks
+ */ 
+bool CDemoCheckpoints::Build( const char *filename, int nInterval )
+{
+	CDemoFile demofile;
+	demo_parser_state_t State;
+
+	if( !demofile.Open( filename ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
+
+	*this = CDemoCheckpoints();
+
+	State.tick = 0;
+	State.frame_number = 0;
+	State.frame_pos = 0;
+
+	int nNextTick = nInterval;
+
+	for( int nFrameNumber = 0; !demofile.IsDone(); nFrameNumber++ )
+	{
+		int tick = 0;
+		bool bCompressed;
+		bool bFrameOk = false;
+		size_t nFramePos = demofile.GetPos();
+
+		EDemoCommands DemoCommand = demofile.ReadMessageType( &tick, &bCompressed );
+
+		// Checkpoints go before the first frame of a tick, with the state before it, so restoring
+		// the one at a tick resumes at all of that tick's frames
+		if( tick >= nNextTick && DemoCommand != DEM_Error && DemoCommand != DEM_Stop && DemoCommand != DEM_FileInfo )
+		{
+			State.tick = tick;
+			State.frame_number = nFrameNumber;
+			State.frame_pos = nFramePos;
+			AddCheckpoint( State );
+
+			nNextTick = tick + nInterval;
+		}
+
+		switch( DemoCommand )
+		{
+		case DEM_SendTables:
+		case DEM_ClassInfo:
+		case DEM_StringTables:
+		case DEM_FullPacket:
+		case DEM_Packet:
+		case DEM_SignonPacket:
+			{
+				const char *pData;
+				int DataSize;
+
+				bFrameOk = demofile.ReadMessageData( bCompressed, &pData, &DataSize ) &&
+					UpdateParserState( State, DemoCommand, pData, DataSize );
+			}
+			break;
+
+		case DEM_Error:
+			break;
+
+		default:
+			bFrameOk = demofile.ReadRawMessage( NULL, NULL );
+			break;
+		}
+
+		if( !bFrameOk && !demofile.Resync( nFramePos ) )
+			break;
+	}
+
+	bool bOk = Write( ( std::string( filename ) + DEMOCHECKPOINT_FILE_EXTENSION ).c_str(), demofile, nInterval );
+
+	fprintf( stderr, "%s: %d checkpoints, %d blobs, %zu bytes.\n", filename, ( int )m_checkpoints.size(), ( int )m_blobs.size(), m_data.size() );
+
+	m_objectBlobs.clear();
+	m_objects.clear();
+	m_blobsByHash.clear();
+	return bOk;
+}
+
+bool CDemoCheckpoints::Write( const char *filename, CDemoFile& demofile, int nInterval )
+{
+	democheckpointheader_t Header;
+
+	memset( &Header, 0, sizeof( Header ) );
+	memcpy( Header.checkpointstamp, DEMOCHECKPOINT_HEADER_ID, sizeof( Header.checkpointstamp ) );
+	Header.version = DEMOCHECKPOINT_VERSION;
+	Header.interval = nInterval;
+	Header.demo_size = demofile.GetSize();
+	Header.fileinfo_offset = demofile.GetFileInfoOffset();
+	Header.num_checkpoints = ( uint32 )m_checkpoints.size();
+	Header.num_refs = ( uint32 )m_refs.size();
+	Header.num_blobs = ( uint32 )m_blobs.size();
+	Header.data_size = m_data.size();
+	GetDemoFileHash( demofile, &Header.demo_hash );
+
+	std::string tmpname = std::string( filename ) + ".tmp";
+	FILE *fp = fopen( tmpname.c_str(), "wb" );
+	if( !fp )
+	{
+		fprintf( stderr, "CDemoCheckpoints::Write: couldn't open %s.\n", tmpname.c_str() );
+		return false;
+	}
+
+	bool bOk = fwrite( &Header, sizeof( Header ), 1, fp ) == 1;
+	bOk = bOk && ( m_checkpoints.empty() || fwrite( m_checkpoints.data(), sizeof( democheckpoint_t ), m_checkpoints.size(), fp ) == m_checkpoints.size() );
+	bOk = bOk && ( m_refs.empty() || fwrite( m_refs.data(), sizeof( uint32 ), m_refs.size(), fp ) == m_refs.size() );
+	bOk = bOk && ( m_blobs.empty() || fwrite( m_blobs.data(), sizeof( democheckpointblob_t ), m_blobs.size(), fp ) == m_blobs.size() );
+	bOk = bOk && ( m_data.empty() || fwrite( m_data.data(), 1, m_data.size(), fp ) == m_data.size() );
+	bOk = ( fclose( fp ) == 0 ) && bOk;
+
+	if( !bOk || rename( tmpname.c_str(), filename ) != 0 )
+	{
+		fprintf( stderr, "CDemoCheckpoints::Write: couldn't write %s.\n", filename );
+		remove( tmpname.c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Reads the side file of a demo that is open in demofile
+ */ 
+bool CDemoCheckpoints::Load( const char *filename, CDemoFile& demofile )
+{
+	std::string ckptname = std::string( filename ) + DEMOCHECKPOINT_FILE_EXTENSION;
+	FILE *fp = fopen( ckptname.c_str(), "rb" );
+
+	*this = CDemoCheckpoints();
+
+	if( !fp )
+		return false;
+
+	democheckpointheader_t Header;
+	bool bOk = fread( &Header, sizeof( Header ), 1, fp ) == 1 &&
+		!memcmp( Header.checkpointstamp, DEMOCHECKPOINT_HEADER_ID, sizeof( Header.checkpointstamp ) ) &&
+		Header.version == DEMOCHECKPOINT_VERSION;
+
+	// Sizes come from the file, don't trust them beyond what is actually there
+	if( bOk )
+	{
+		fseek( fp, 0, SEEK_END );
+		uint64 nFileSize = ftell( fp );
+		fseek( fp, sizeof( Header ), SEEK_SET );
+
+		uint64 nExpected = sizeof( Header ) + ( uint64 )Header.num_checkpoints * sizeof( democheckpoint_t ) +
+			( uint64 )Header.num_refs * sizeof( uint32 ) + ( uint64 )Header.num_blobs * sizeof( democheckpointblob_t ) + Header.data_size;
+		bOk = ( nExpected == nFileSize );
+	}
+
+	if( bOk )
+	{
+		m_checkpoints.resize( Header.num_checkpoints );
+		m_refs.resize( Header.num_refs );
+		m_blobs.resize( Header.num_blobs );
+		m_data.resize( Header.data_size );
+
+		bOk = ( m_checkpoints.empty() || fread( m_checkpoints.data(), sizeof( democheckpoint_t ), m_checkpoints.size(), fp ) == m_checkpoints.size() ) &&
+			( m_refs.empty() || fread( m_refs.data(), sizeof( uint32 ), m_refs.size(), fp ) == m_refs.size() ) &&
+			( m_blobs.empty() || fread( m_blobs.data(), sizeof( democheckpointblob_t ), m_blobs.size(), fp ) == m_blobs.size() ) &&
+			( m_data.empty() || fread( &m_data[ 0 ], 1, m_data.size(), fp ) == m_data.size() );
+	}
+
+	fclose( fp );
+
+	for( size_t i = 0; bOk && i < m_checkpoints.size(); i++ )
+		bOk = m_checkpoints[ i ].first_ref <= m_refs.size() && m_checkpoints[ i ].num_refs <= m_refs.size() - m_checkpoints[ i ].first_ref;
+	for( size_t i = 0; bOk && i < m_refs.size(); i++ )
+		bOk = m_refs[ i ] < m_blobs.size();
+	for( size_t i = 0; bOk && i < m_blobs.size(); i++ )
+		bOk = m_blobs[ i ].offset <= m_data.size() && m_blobs[ i ].size <= m_data.size() - m_blobs[ i ].offset;
+
+	if( !bOk )
+	{
+		fprintf( stderr, "CDemoCheckpoints::Load: %s is not a version %d checkpoint file.\n", ckptname.c_str(), DEMOCHECKPOINT_VERSION );
+		*this = CDemoCheckpoints();
+		return false;
+	}
+
+	// The demo may have been replaced since, or still be growing when the checkpoints were made
+	uint64 hash;
+	if( Header.demo_size != demofile.GetSize() || Header.fileinfo_offset != demofile.GetFileInfoOffset() ||
+		!GetDemoFileHash( demofile, &hash ) || hash != Header.demo_hash )
+	{
+		fprintf( stderr, "CDemoCheckpoints::Load: %s is for a different version of %s.\n", ckptname.c_str(), filename );
+		*this = CDemoCheckpoints();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Parses the blobs of the checkpoint. They go through the schema cache, so restoring a checkpoint
+ * that shares them with one restored before doesn't parse them again.
+ */ 
+bool CDemoCheckpoints::Restore( int tick, demo_parser_state_t& State ) const
+{
+	State = demo_parser_state_t();
+	State.tick = 0;
+	State.frame_number = 0;
+	State.frame_pos = 0;
+
+	// Last checkpoint at or before tick, none means starting from the beginning
+	int nCheckpoint = -1;
+	for( int lo = 0, hi = ( int )m_checkpoints.size() - 1; lo <= hi; )
+	{
+		int mid = lo + ( hi - lo ) / 2;
+
+		if( m_checkpoints[ mid ].tick <= tick )
+		{
+			nCheckpoint = mid;
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	if( nCheckpoint < 0 )
+		return true;
+
+	const democheckpoint_t& Checkpoint = m_checkpoints[ nCheckpoint ];
+	std::string tables;
+	std::string data;
+
+	for( uint32 i = 0; i < Checkpoint.num_refs; i++ )
+	{
+		const democheckpointblob_t& Blob = m_blobs[ m_refs[ Checkpoint.first_ref + i ] ];
+		const char *pBlob = &m_data[ Blob.offset ];
+
+		if( !snappy::Uncompress( pBlob, Blob.size, &data ) )
+			return false;
+
+		bool bOk = true;
+		switch( Blob.type )
+		{
+		case DEMOCHECKPOINT_BLOB_SEND_TABLES:
+			bOk = !!( State.pSendTables = CSchemaCache< CDemoSendTables >::Intern( data.data(), ( int )data.size() ) );
+			break;
+		case DEMOCHECKPOINT_BLOB_CLASS_INFO:
+			bOk = !!( State.pClassInfo = CSchemaCache< CDemoClassInfo >::Intern( data.data(), ( int )data.size() ) );
+			break;
+		case DEMOCHECKPOINT_BLOB_SERVER_INFO:
+			bOk = !!( State.pServerInfo = CSchemaCache< CSVCMsg_ServerInfo >::Intern( data.data(), ( int )data.size() ) );
+			break;
+		case DEMOCHECKPOINT_BLOB_GAME_EVENT_LIST:
+			bOk = !!( State.pGameEventSchema = CSchemaCache< CGameEventSchema >::Intern( data.data(), ( int )data.size() ) );
+			break;
+		case DEMOCHECKPOINT_BLOB_STRING_TABLE_INFO:
+			{
+				CSVCMsg_CreateStringTable Msg;
+				demo_string_table_info_t Info;
+
+				bOk = Msg.ParseFromArray( data.data(), ( int )data.size() );
+				Info.name = Msg.name();
+				Info.max_entries = Msg.max_entries();
+				Info.user_data_fixed_size = Msg.user_data_fixed_size();
+				Info.user_data_size_bits = Msg.user_data_size_bits();
+				State.StringTableInfo.push_back( Info );
+			}
+			break;
+		case DEMOCHECKPOINT_BLOB_STRING_TABLE:
+			{
+				// Put back together as a CDemoStringTables so volatile tables stay out of the cache
+				StringOutputStream Output( &tables );
+				CodedOutputStream Stream( &Output );
+
+				Stream.WriteTag( WireFormatLite::MakeTag( CDemoStringTables::kTablesFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED ) );
+				Stream.WriteVarint32( ( uint32 )data.size() );
+				Stream.WriteRaw( data.data(), ( int )data.size() );
+			}
+			break;
+		}
+
+		if( !bOk )
+			return false;
+	}
+
+	if( !ParseStringTablesInterned( tables.data(), ( int )tables.size(), State.StringTables ) )
+		return false;
+
+	SyncStringTableKeys( State );
+
+	State.tick = Checkpoint.tick;
+	State.frame_number = Checkpoint.frame_number;
+	State.frame_pos = Checkpoint.frame_pos;
+	return true;
+}
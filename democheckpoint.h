@@ -0,0 +1,158 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOCHECKPOINT_H
+#define DEMOCHECKPOINT_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "demofile.h"
+#include "demostringtables.h"
+#include "schemacache.h"
+
+//-----------------------------------------------------------------------------
+// Checkpoints of the parser state, written every so many ticks to a side file
+// next to the demo (filename.dem.ckpt). Restoring one and continuing at its
+// frame gives the same state as parsing the demo from the start, so a seek
+// only has to read from the checkpoint before the target tick.
+//
+// The state is everything that is derived from earlier frames: the send
+// tables, class info, server info, game event list and the string tables,
+// which are the last snapshot with the svc_CreateStringTable and
+// svc_UpdateStringTable changes since applied. A table whose changes can't be
+// decoded (dictionary encoded) stays as of the last snapshot. Each piece is
+// stored once, compressed, and shared by all the checkpoints that have the
+// same copy of it. Most of it never changes after signon so the file stays
+// small.
+//-----------------------------------------------------------------------------
+
+#define DEMOCHECKPOINT_HEADER_ID		"DEMOCKPT"
+#define DEMOCHECKPOINT_VERSION			2
+#define DEMOCHECKPOINT_FILE_EXTENSION	".ckpt"
+#define DEMOCHECKPOINT_DEFAULT_INTERVAL	1800		// ticks, a minute of game time
+
+enum EDemoCheckpointBlob
+{
+	DEMOCHECKPOINT_BLOB_SEND_TABLES = 0,		// CDemoSendTables
+	DEMOCHECKPOINT_BLOB_CLASS_INFO,				// CDemoClassInfo
+	DEMOCHECKPOINT_BLOB_SERVER_INFO,			// CSVCMsg_ServerInfo
+	DEMOCHECKPOINT_BLOB_GAME_EVENT_LIST,		// CSVCMsg_GameEventList
+	DEMOCHECKPOINT_BLOB_STRING_TABLE,			// CDemoStringTables::table_t
+	DEMOCHECKPOINT_BLOB_STRING_TABLE_INFO,		// CSVCMsg_CreateStringTable without the entries, by table id
+
+	DEMOCHECKPOINT_BLOB_MAX
+};
+
+struct democheckpointheader_t
+{
+	char checkpointstamp[ 8 ];	// DEMOCHECKPOINT_HEADER_ID
+	int32 version;
+	int32 interval;
+
+	// The demo the checkpoints are for
+	uint64 demo_size;			// of the frame stream
+	uint64 demo_hash;			// of the DEM_FileHeader frame
+	int32 fileinfo_offset;
+
+	uint32 num_checkpoints;		// democheckpoint_t
+	uint32 num_refs;			// uint32 blob indices
+	uint32 num_blobs;			// democheckpointblob_t
+	uint64 data_size;			// compressed blob data, after the blob table
+};
+
+struct democheckpoint_t
+{
+	int32 tick;					// of the frame the checkpoint resumes at, the first one with it
+	int32 frame_number;			// of the frame the checkpoint resumes at
+	uint64 frame_pos;			// CDemoFile::GetPos() of that frame
+	uint32 first_ref;
+	uint32 num_refs;
+};
+
+struct democheckpointblob_t
+{
+	uint32 type;				// EDemoCheckpointBlob
+	uint32 size;
+	uint64 offset;				// into the blob data
+};
+
+/**
+ * Everything a parser has to remember from the frames it already read
+ */ 
+struct demo_parser_state_t
+{
+	int tick;
+	int frame_number;			// of the next frame
+	size_t frame_pos;			// of the next frame
+
+	std::shared_ptr< const CDemoSendTables > pSendTables;
+	std::shared_ptr< const CDemoClassInfo > pClassInfo;
+	std::shared_ptr< const CSVCMsg_ServerInfo > pServerInfo;
+	std::shared_ptr< const CGameEventSchema > pGameEventSchema;
+	StringTableList_t StringTables;
+	std::vector< demo_string_table_info_t > StringTableInfo;	// by table id, for svc_UpdateStringTable
+};
+
+class CDemoCheckpoints
+{
+public:
+	CDemoCheckpoints() {}
+	~CDemoCheckpoints() {}
+
+	// Parses filename and writes filename.ckpt with a checkpoint every nInterval ticks
+	bool	Build( const char *filename, int nInterval );
+
+	// Reads filename.ckpt, false if there isn't one or it is for a different demo
+	bool	Load( const char *filename, CDemoFile& demofile );
+
+	int		GetCheckpointCount() const		{ return ( int )m_checkpoints.size(); }
+
+	// Restores the last checkpoint at or before tick
+	bool	Restore( int tick, demo_parser_state_t& State ) const;
+
+private:
+	template < class T >
+	void	AddBlob( EDemoCheckpointBlob type, const std::shared_ptr< const T >& pObject, const ::google::protobuf::Message& Msg );
+	uint32	AddBlob( EDemoCheckpointBlob type, const ::google::protobuf::Message& Msg );
+	void	AddCheckpoint( const demo_parser_state_t& State );
+	bool	Write( const char *filename, CDemoFile& demofile, int nInterval );
+
+	std::vector< democheckpoint_t > m_checkpoints;
+	std::vector< uint32 > m_refs;
+	std::vector< democheckpointblob_t > m_blobs;
+	std::string m_data;
+
+	// Building only, blob index by the object it was serialized from and by its content. The
+	// objects are held on to so their addresses stay unique.
+	std::unordered_map< const void *, uint32 > m_objectBlobs;
+	std::vector< std::shared_ptr< const void > > m_objects;
+	std::unordered_multimap< uint64, uint32 > m_blobsByHash;
+};
+
+// Reads the state changes out of a frame, pData is the uncompressed message of a DEM_ command
+bool	UpdateParserState( demo_parser_state_t& State, EDemoCommands DemoCommand, const char *pData, int size );
+
+#endif // DEMOCHECKPOINT_H
@@ -0,0 +1,736 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <algorithm>
+#include "demodaemon.h"
+#include "demoblockindex.h"
+#include "democheckpoint.h"
+
+#include "generated_proto/usermessages.pb.h"
+#include "generated_proto/dota_usermessages.pb.h"
+#include "generated_proto/flatdecoders.h"
+
+static volatile sig_atomic_t s_bStopRequested = 0;
+
+static void DaemonSignalHandler( int )
+{
+	s_bStopRequested = 1;
+}
+
+static bool RecvAll( int fd, void *pBuffer, size_t size )
+{
+	char *pData = ( char * )pBuffer;
+
+	while( size > 0 )
+	{
+		ssize_t nRead = recv( fd, pData, size, 0 );
+
+		if( nRead < 0 && errno == EINTR )
+			continue;
+		if( nRead <= 0 )
+			return false;
+
+		pData += nRead;
+		size -= nRead;
+	}
+	return true;
+}
+
+static bool SendAll( int fd, const char *pData, size_t size )
+{
+	while( size > 0 )
+	{
+		ssize_t nSent = send( fd, pData, size, MSG_NOSIGNAL );
+
+		if( nSent < 0 && errno == EINTR )
+			continue;
+		if( nSent <= 0 )
+			return false;
+
+		pData += nSent;
+		size -= nSent;
+	}
+	return true;
+}
+
+static bool HasId( const ::google::protobuf::RepeatedField< int32 >& Ids, int32 id )
+{
+	return std::find( Ids.begin(), Ids.end(), id ) != Ids.end();
+}
+
+/**
+ * Name of a net message or user message, as in the NET_Messages, SVC_Messages and user message enums
+ */ 
+static std::string GetMessageEnumName( int Cmd, int UserMsg )
+{
+	if( UserMsg >= 0 )
+	{
+		if( EBaseUserMessages_IsValid( UserMsg ) )
+			return EBaseUserMessages_Name( ( EBaseUserMessages )UserMsg );
+		if( EDotaUserMessages_IsValid( UserMsg ) )
+			return EDotaUserMessages_Name( ( EDotaUserMessages )UserMsg );
+		return "UM_???";
+	}
+
+	if( NET_Messages_IsValid( Cmd ) )
+		return NET_Messages_Name( ( NET_Messages )Cmd );
+	if( SVC_Messages_IsValid( Cmd ) )
+		return SVC_Messages_Name( ( SVC_Messages )Cmd );
+	return "NETMSG_???";
+}
+
+/**
+ * The generated message class for an enum name, e.g. CSVCMsg_ServerInfo for svc_ServerInfo
+ */ 
+static const ::google::protobuf::Message *GetMessagePrototype( const std::string& EnumName )
+{
+	static const struct
+	{
+		const char *pEnumPrefix;
+		const char *pTypePrefix;
+	} s_Prefixes[] =
+	{
+		{ "net_", "CNETMsg_" },
+		{ "svc_", "CSVCMsg_" },
+		{ "UM_", "CUserMsg_" },
+		{ "DOTA_UM_", "CDOTAUserMsg_" },
+	};
+
+	for( size_t i = 0; i < sizeof( s_Prefixes ) / sizeof( s_Prefixes[ 0 ] ); i++ )
+	{
+		size_t len = strlen( s_Prefixes[ i ].pEnumPrefix );
+
+		if( EnumName.compare( 0, len, s_Prefixes[ i ].pEnumPrefix ) )
+			continue;
+
+		std::string TypeName = s_Prefixes[ i ].pTypePrefix + EnumName.substr( len );
+		const ::google::protobuf::Descriptor *pDescriptor = ::google::protobuf::DescriptorPool::generated_pool()->FindMessageTypeByName( TypeName );
+
+		return pDescriptor ? ::google::protobuf::MessageFactory::generated_factory()->GetPrototype( pDescriptor ) : NULL;
+	}
+	return NULL;
+}
+
+/**
+ * Adds the messages of a packet that the request asks for to the response, returns their size
+ */ 
+static size_t AddPacketMessages( const CDaemonRequest& Request, const CGameEventSchema *pSchema, const char *pData, int size,
+	int nFrameNumber, int tick, CDaemonResponse& Response )
+{
+	bool bAll = !Request.net_messages_size() && !Request.user_messages_size() && !Request.game_events_size();
+	CFlatReader reader( pData, size );
+	size_t nAdded = 0;
+
+	while( !reader.AtEnd() )
+	{
+		uint64_t Cmd;
+		std::string_view msg;
+		int32 UserMsg = -1;
+		int32 EventId = -1;
+
+		if( !reader.ReadVarint64( &Cmd ) || !reader.ReadBytes( &msg ) )
+			break;
+
+		if( Cmd == svc_UserMessage )
+			ReadInt32Field( msg.data(), ( int )msg.size(), CSVCMsg_UserMessage::kMsgTypeFieldNumber, &UserMsg );
+		else if( Cmd == svc_GameEvent )
+			ReadInt32Field( msg.data(), ( int )msg.size(), CSVCMsg_GameEvent::kEventidFieldNumber, &EventId );
+
+		bool bMatch = bAll || HasId( Request.net_messages(), ( int32 )Cmd ) ||
+			( UserMsg >= 0 && HasId( Request.user_messages(), UserMsg ) ) ||
+			( EventId >= 0 && HasId( Request.game_events(), EventId ) );
+
+		if( !bMatch )
+			continue;
+
+		CDaemonMessage *pMessage = Response.add_messages();
+		std::string EnumName = GetMessageEnumName( ( int )Cmd, UserMsg );
+		std::string_view Payload = msg;
+
+		pMessage->set_frame( nFrameNumber );
+		pMessage->set_tick( tick );
+		pMessage->set_net_message( ( int32 )Cmd );
+
+		if( UserMsg >= 0 )
+		{
+			CFlat_CSVCMsg_UserMessage UserMessage;
+
+			pMessage->set_user_message( UserMsg );
+			if( UserMessage.Decode( msg.data(), ( int )msg.size() ) )
+				Payload = UserMessage.msg_data();
+		}
+
+		pMessage->set_name( EnumName );
+		if( EventId >= 0 )
+		{
+			const CSVCMsg_GameEventList::descriptor_t *pDescriptor = pSchema ? pSchema->FindDescriptor( EventId ) : NULL;
+
+			pMessage->set_game_event( EventId );
+			if( pDescriptor )
+				pMessage->set_name( pDescriptor->name() );
+		}
+
+		if( Request.format() == DAEMON_FORMAT_TEXT )
+		{
+			const ::google::protobuf::Message *pPrototype = GetMessagePrototype( EnumName );
+
+			if( pPrototype )
+			{
+				std::unique_ptr< ::google::protobuf::Message > pMsg( pPrototype->New() );
+
+				if( pMsg->ParseFromArray( Payload.data(), ( int )Payload.size() ) )
+					pMessage->set_text( pMsg->DebugString() );
+			}
+		}
+		else
+		{
+			pMessage->set_data( Payload.data(), Payload.size() );
+		}
+
+		nAdded += pMessage->data().size() + pMessage->text().size() + pMessage->name().size() + 16;
+	}
+
+	return nAdded;
+}
+
+CDemoDaemon::connection_t::~connection_t()
+{
+	close( fd );
+}
+
+CDemoDaemon::CDemoDaemon()
+	: m_nCacheSize( DEMODAEMON_DEFAULT_CACHE_SIZE )
+	, m_nMaxJobs( 0 )
+	, m_bStopping( false )
+{
+}
+
+CDemoDaemon::~CDemoDaemon()
+{
+}
+
+bool CDemoDaemon::Run( const char *socketname, int nWorkers, int nCacheSize )
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	if( strlen( socketname ) >= sizeof( addr.sun_path ) )
+	{
+		fprintf( stderr, "Socket path '%s' is too long.\n", socketname );
+		return false;
+	}
+	strcpy( addr.sun_path, socketname );
+
+	// A socket left behind by an earlier run
+	if( !stat( socketname, &st ) && S_ISSOCK( st.st_mode ) )
+		unlink( socketname );
+
+	int listenFd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( listenFd < 0 || bind( listenFd, ( struct sockaddr * )&addr, sizeof( addr ) ) || listen( listenFd, SOMAXCONN ) )
+	{
+		fprintf( stderr, "Couldn't listen on '%s': %s\n", socketname, strerror( errno ) );
+		if( listenFd >= 0 )
+			close( listenFd );
+		return false;
+	}
+
+	if( nWorkers <= 0 )
+		nWorkers = std::max( 1u, std::thread::hardware_concurrency() );
+
+	m_nCacheSize = std::max( 1, nCacheSize );
+	m_nMaxJobs = nWorkers * DEMODAEMON_JOBS_PER_WORKER;
+	m_bStopping = false;
+
+	// No SA_RESTART, poll() has to return so the loop sees the request
+	struct sigaction sa;
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sa_handler = DaemonSignalHandler;
+	sigemptyset( &sa.sa_mask );
+	sigaction( SIGINT, &sa, NULL );
+	sigaction( SIGTERM, &sa, NULL );
+	s_bStopRequested = 0;
+
+	for( int i = 0; i < nWorkers; i++ )
+		m_workers.emplace_back( &CDemoDaemon::WorkerThread, this );
+
+	fprintf( stderr, "Listening on '%s' with %d workers, caching %d replays.\n", socketname, nWorkers, m_nCacheSize );
+
+	while( !s_bStopRequested )
+	{
+		struct pollfd pfd = { listenFd, POLLIN, 0 };
+
+		if( poll( &pfd, 1, 500 ) <= 0 )
+			continue;
+
+		int fd = accept4( listenFd, NULL, NULL, SOCK_CLOEXEC );
+		if( fd < 0 )
+			continue;
+
+		// Responses are sent with the connection's write lock held, a client that stops reading
+		// mustn't hold up the worker forever
+		struct timeval SendTimeout = { DEMODAEMON_SEND_TIMEOUT, 0 };
+		setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &SendTimeout, sizeof( SendTimeout ) );
+
+		std::shared_ptr< connection_t > pConnection = std::make_shared< connection_t >();
+		pConnection->fd = fd;
+		pConnection->bBroken = false;
+
+		{
+			std::lock_guard< std::mutex > lock( m_connectionMutex );
+			m_connections.push_back( pConnection );
+		}
+		std::thread( &CDemoDaemon::ConnectionThread, this, pConnection ).detach();
+	}
+
+	close( listenFd );
+	unlink( socketname );
+
+	// Wake the workers and the connections waiting for space in the queue, then unblock the reads
+	{
+		std::lock_guard< std::mutex > lock( m_jobMutex );
+		m_bStopping = true;
+		m_jobs.clear();
+	}
+	m_jobCv.notify_all();
+	m_jobSpaceCv.notify_all();
+
+	{
+		std::unique_lock< std::mutex > lock( m_connectionMutex );
+
+		for( size_t i = 0; i < m_connections.size(); i++ )
+			shutdown( m_connections[ i ]->fd, SHUT_RDWR );
+		m_connectionCv.wait( lock, [this] { return m_connections.empty(); } );
+	}
+
+	for( size_t i = 0; i < m_workers.size(); i++ )
+		m_workers[ i ].join();
+	m_workers.clear();
+
+	std::lock_guard< std::mutex > lock( m_cacheMutex );
+	m_cache.clear();
+	m_lru.clear();
+
+	fprintf( stderr, "Stopped.\n" );
+	return true;
+}
+
+/**
+ * Reads the requests of a connection into the job queue
+ */ 
+void CDemoDaemon::ConnectionThread( std::shared_ptr< connection_t > pConnection )
+{
+	std::string buf;
+
+	for( ;; )
+	{
+		uint8_t SizeBytes[ 4 ];
+
+		if( !RecvAll( pConnection->fd, SizeBytes, sizeof( SizeBytes ) ) )
+			break;
+
+		uint32 size = SizeBytes[ 0 ] | ( SizeBytes[ 1 ] << 8 ) | ( SizeBytes[ 2 ] << 16 ) | ( ( uint32 )SizeBytes[ 3 ] << 24 );
+		if( size > DEMODAEMON_MAX_REQUEST_SIZE )
+		{
+			CDaemonResponse Response;
+
+			Response.set_done( true );
+			Response.set_error( "request too large" );
+			SendResponse( *pConnection, Response );
+			break;
+		}
+
+		buf.resize( size );
+		if( !RecvAll( pConnection->fd, &buf[ 0 ], size ) )
+			break;
+
+		job_t Job;
+		Job.pConnection = pConnection;
+
+		if( !Job.Request.ParseFromString( buf ) )
+		{
+			CDaemonResponse Response;
+
+			Response.set_done( true );
+			Response.set_error( "couldn't parse request" );
+			if( !SendResponse( *pConnection, Response ) )
+				break;
+			continue;
+		}
+
+		if( !PushJob( std::move( Job ) ) )
+			break;
+	}
+
+	std::lock_guard< std::mutex > lock( m_connectionMutex );
+	m_connections.erase( std::find( m_connections.begin(), m_connections.end(), pConnection ) );
+	m_connectionCv.notify_all();
+}
+
+/**
+ * Blocks while the queue is full, false once the daemon is stopping
+ */ 
+bool CDemoDaemon::PushJob( job_t&& Job )
+{
+	std::unique_lock< std::mutex > lock( m_jobMutex );
+
+	m_jobSpaceCv.wait( lock, [this] { return m_bStopping || m_jobs.size() < m_nMaxJobs; } );
+	if( m_bStopping )
+		return false;
+
+	m_jobs.push_back( std::move( Job ) );
+	m_jobCv.notify_one();
+	return true;
+}
+
+bool CDemoDaemon::PopJob( job_t& Job )
+{
+	std::unique_lock< std::mutex > lock( m_jobMutex );
+
+	m_jobCv.wait( lock, [this] { return m_bStopping || !m_jobs.empty(); } );
+	if( m_bStopping )
+		return false;
+
+	Job = std::move( m_jobs.front() );
+	m_jobs.pop_front();
+	m_jobSpaceCv.notify_one();
+	return true;
+}
+
+void CDemoDaemon::WorkerThread()
+{
+	job_t Job;
+
+	while( PopJob( Job ) )
+	{
+		RunJob( Job );
+		Job.pConnection.reset();
+	}
+}
+
+/**
+ * The cached replay for filename, loading it if it isn't cached or the file changed since
+ */ 
+std::shared_ptr< CDemoDaemon::replay_t > CDemoDaemon::GetReplay( const std::string& filename, bool *pbCacheHit, std::string *pError )
+{
+	struct stat st;
+	std::shared_ptr< replay_t > pReplay;
+
+	*pbCacheHit = false;
+	if( stat( filename.c_str(), &st ) )
+	{
+		*pError = "couldn't open " + filename + ": " + strerror( errno );
+		return NULL;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( m_cacheMutex );
+		std::unordered_map< std::string, std::list< std::shared_ptr< replay_t > >::iterator >::iterator it = m_cache.find( filename );
+
+		if( it != m_cache.end() )
+		{
+			if( ( *it->second )->size == st.st_size && ( *it->second )->mtime == st.st_mtime )
+			{
+				m_lru.splice( m_lru.begin(), m_lru, it->second );
+				pReplay = m_lru.front();
+				*pbCacheHit = true;
+			}
+			else
+			{
+				m_lru.erase( it->second );
+				m_cache.erase( it );
+			}
+		}
+
+		if( !pReplay )
+		{
+			pReplay = std::make_shared< replay_t >();
+			pReplay->filename = filename;
+			pReplay->size = st.st_size;
+			pReplay->mtime = st.st_mtime;
+			pReplay->bLoaded = false;
+			pReplay->nFileInfoOffset = 0;
+
+			m_lru.push_front( pReplay );
+			m_cache[ filename ] = m_lru.begin();
+
+			// Jobs still running on an evicted replay keep it until they finish
+			while( m_lru.size() > ( size_t )m_nCacheSize )
+			{
+				m_cache.erase( m_lru.back()->filename );
+				m_lru.pop_back();
+			}
+		}
+	}
+
+	{
+		// Other jobs for the same replay wait here for the first one to load it
+		std::lock_guard< std::mutex > lock( pReplay->loadMutex );
+
+		if( !pReplay->bLoaded && pReplay->error.empty() && !LoadReplay( *pReplay ) && pReplay->error.empty() )
+			pReplay->error = "couldn't load " + filename;
+
+		if( pReplay->error.empty() )
+			return pReplay;
+
+		*pError = pReplay->error;
+	}
+
+	// Don't keep the failure around, the next request tries again
+	std::lock_guard< std::mutex > lock( m_cacheMutex );
+	std::unordered_map< std::string, std::list< std::shared_ptr< replay_t > >::iterator >::iterator it = m_cache.find( filename );
+
+	if( it != m_cache.end() && *it->second == pReplay )
+	{
+		m_lru.erase( it->second );
+		m_cache.erase( it );
+	}
+	return NULL;
+}
+
+/**
+ * Reads the replay and indexes its frames by tick
+ */ 
+bool CDemoDaemon::LoadReplay( replay_t& Replay )
+{
+	std::unique_ptr< CDemoFile > pReader( new CDemoFile );
+	demo_parser_state_t State;
+	int nMaxTick = -1;
+
+	if( !pReader->Open( Replay.filename.c_str() ) )
+	{
+		Replay.error = "couldn't open " + Replay.filename;
+		return false;
+	}
+
+	for( int nFrameNumber = 0; !pReader->IsDone(); nFrameNumber++ )
+	{
+		int tick = 0;
+		bool bCompressed;
+		bool bFrameOk = false;
+		size_t nFramePos = pReader->GetPos();
+		const char *pData;
+		int DataSize;
+
+		EDemoCommands DemoCommand = pReader->ReadMessageType( &tick, &bCompressed );
+
+		switch( DemoCommand )
+		{
+		case DEM_SignonPacket:
+			// Only the signon has to be decompressed, for the game event list
+			bFrameOk = pReader->ReadMessageData( bCompressed, &pData, &DataSize ) && UpdateParserState( State, DemoCommand, pData, DataSize );
+			break;
+
+		case DEM_Error:
+			break;
+
+		default:
+			bFrameOk = pReader->ReadRawMessage( NULL, NULL );
+			break;
+		}
+
+		if( !bFrameOk )
+		{
+			if( !pReader->Resync( nFramePos ) )
+				break;
+			continue;
+		}
+
+		// One entry for the first frame of every tick. Signon frames don't have a real tick, the
+		// index is kept sorted by using the largest tick so far.
+		if( tick > nMaxTick || Replay.frames.empty() )
+		{
+			replay_frame_t Frame;
+
+			nMaxTick = std::max( nMaxTick, tick );
+			Frame.tick = nMaxTick;
+			Frame.frame_number = nFrameNumber;
+			Frame.pos = nFramePos;
+			Replay.frames.push_back( Frame );
+		}
+	}
+
+	Replay.pGameEventSchema = State.pGameEventSchema;
+	Replay.pFrameStream = pReader->ShareFrameStream();
+	Replay.nFileInfoOffset = pReader->GetFileInfoOffset();
+	Replay.bLoaded = true;
+	return true;
+}
+
+bool CDemoDaemon::SendResponse( connection_t& Connection, const CDaemonResponse& Response )
+{
+	std::string buf( 4, '\0' );
+	std::lock_guard< std::mutex > lock( Connection.writeMutex );
+
+	if( Connection.bBroken )
+		return false;
+
+	Response.AppendToString( &buf );
+
+	uint32 size = ( uint32 )( buf.size() - 4 );
+	buf[ 0 ] = ( char )size;
+	buf[ 1 ] = ( char )( size >> 8 );
+	buf[ 2 ] = ( char )( size >> 16 );
+	buf[ 3 ] = ( char )( size >> 24 );
+
+	// A failed or timed out send may have left part of the response behind, nothing more can follow
+	// it. Shutting the socket down also ends the connection's reads.
+	if( !SendAll( Connection.fd, buf.data(), buf.size() ) )
+	{
+		Connection.bBroken = true;
+		shutdown( Connection.fd, SHUT_RDWR );
+	}
+	return !Connection.bBroken;
+}
+
+/**
+ * Streams the messages of the requested tick range back in batches
+ */ 
+void CDemoDaemon::RunJob( job_t& Job )
+{
+	const CDaemonRequest& Request = Job.Request;
+	CDaemonResponse Response;
+	bool bCacheHit = false;
+	std::string error;
+	int nFramesRead = 0;
+
+	Response.set_request_id( Request.request_id() );
+
+	std::shared_ptr< replay_t > pReplay = GetReplay( Request.filename(), &bCacheHit, &error );
+	std::unique_ptr< CDemoFile > pReader;
+
+	// Jobs on the same replay all read its one frame stream, each from a position of its own
+	if( pReplay )
+	{
+		pReader.reset( new CDemoFile );
+		if( !pReader->OpenShared( pReplay->filename.c_str(), pReplay->pFrameStream, pReplay->nFileInfoOffset ) )
+		{
+			error = "couldn't open " + Request.filename();
+			pReader.reset();
+		}
+	}
+
+	if( pReader )
+	{
+		int nEndTick = Request.end_tick();
+		size_t nBatchSize = 0;
+
+		std::vector< replay_frame_t >::const_iterator it = pReplay->frames.begin();
+		if( Request.start_tick() > 0 )
+		{
+			it = std::lower_bound( pReplay->frames.begin(), pReplay->frames.end(), Request.start_tick(),
+				[]( const replay_frame_t& Frame, int tick ) { return Frame.tick < tick; } );
+		}
+
+		int nFrameNumber = it != pReplay->frames.end() ? it->frame_number : 0;
+		pReader->SetPos( it != pReplay->frames.end() ? it->pos : pReader->GetSize() );
+
+		for( ; !pReader->IsDone(); nFrameNumber++ )
+		{
+			int tick = 0;
+			bool bCompressed;
+			bool bFrameOk = false;
+			size_t nFramePos = pReader->GetPos();
+			const char *pData;
+			int DataSize;
+
+			EDemoCommands DemoCommand = pReader->ReadMessageType( &tick, &bCompressed );
+
+			if( nEndTick >= 0 && tick > nEndTick && DemoCommand != DEM_Error )
+				break;
+
+			switch( DemoCommand )
+			{
+			case DEM_Packet:
+			case DEM_SignonPacket:
+				{
+					CFlat_CDemoPacket Packet;
+
+					bFrameOk = pReader->ReadMessageData( bCompressed, &pData, &DataSize ) && Packet.Decode( pData, DataSize );
+					if( bFrameOk )
+					{
+						nBatchSize += AddPacketMessages( Request, pReplay->pGameEventSchema.get(), Packet.data().data(), ( int )Packet.data().size(),
+							nFrameNumber, tick, Response );
+					}
+				}
+				break;
+
+			case DEM_FullPacket:
+				{
+					StringTableList_t Tables;
+					CDemoPacket Packet;
+
+					bFrameOk = pReader->ReadMessageData( bCompressed, &pData, &DataSize ) && ParseFullPacketInterned( pData, DataSize, Tables, Packet );
+					if( bFrameOk )
+					{
+						nBatchSize += AddPacketMessages( Request, pReplay->pGameEventSchema.get(), Packet.data().data(), ( int )Packet.data().size(),
+							nFrameNumber, tick, Response );
+					}
+				}
+				break;
+
+			case DEM_Error:
+				break;
+
+			default:
+				bFrameOk = pReader->ReadRawMessage( NULL, NULL );
+				break;
+			}
+
+			if( !bFrameOk && !pReader->Resync( nFramePos ) )
+				break;
+			nFramesRead++;
+
+			if( nBatchSize >= DEMODAEMON_BATCH_SIZE )
+			{
+				if( !SendResponse( *Job.pConnection, Response ) )
+					break;
+
+				Response.Clear();
+				Response.set_request_id( Request.request_id() );
+				nBatchSize = 0;
+			}
+		}
+	}
+
+	Response.set_done( true );
+	Response.set_frames_read( nFramesRead );
+	Response.set_cache_hit( bCacheHit );
+	if( !error.empty() )
+		Response.set_error( error );
+	SendResponse( *Job.pConnection, Response );
+}
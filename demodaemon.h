@@ -0,0 +1,147 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#ifndef DEMODAEMON_H
+#define DEMODAEMON_H
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "demofile.h"
+#include "schemacache.h"
+
+#include "generated_proto/daemonmessages.pb.h"
+
+//-----------------------------------------------------------------------------
+// Long running parse service. Clients connect to a unix socket and send
+// CDaemonRequests for the messages of a tick range of a replay; the answers
+// are streamed back as CDaemonResponses. See daemonmessages.proto for the
+// framing.
+//
+// Replays stay loaded between requests in an LRU cache, together with an
+// index of their frames by tick and the game event list, so a request for a
+// replay that was asked for recently doesn't read the file again and starts
+// at the first frame of its range. Requests are run by a fixed pool of
+// workers; when all of them are busy and the queue is full the connections
+// stop reading further requests.
+//-----------------------------------------------------------------------------
+
+#define DEMODAEMON_DEFAULT_CACHE_SIZE	16			// replays
+#define DEMODAEMON_JOBS_PER_WORKER		4			// queued requests before the connections block
+#define DEMODAEMON_MAX_REQUEST_SIZE		( 64 * 1024 )
+#define DEMODAEMON_BATCH_SIZE			( 64 * 1024 )	// message bytes per response
+#define DEMODAEMON_SEND_TIMEOUT			30			// seconds a response can go without progress before the connection is dropped
+
+class CDemoDaemon
+{
+public:
+	CDemoDaemon();
+	~CDemoDaemon();
+
+	// Serves requests on socketname until SIGINT or SIGTERM, nWorkers 0 is one per core
+	bool	Run( const char *socketname, int nWorkers, int nCacheSize );
+
+private:
+	struct replay_frame_t
+	{
+		int32 tick;
+		int32 frame_number;
+		size_t pos;
+	};
+
+	// A cached replay, jobs for it run in parallel reading the same frame stream
+	struct replay_t
+	{
+		std::string filename;
+		off_t size;
+		time_t mtime;
+
+		std::mutex loadMutex;				// held while the file is read and indexed
+		bool bLoaded;
+		std::string error;
+
+		std::vector< replay_frame_t > frames;
+		std::shared_ptr< const CGameEventSchema > pGameEventSchema;
+
+		std::shared_ptr< const std::string > pFrameStream;	// see CDemoFile::ShareFrameStream()
+		int32 nFileInfoOffset;
+	};
+
+	struct connection_t
+	{
+		int fd;
+		std::mutex writeMutex;
+		bool bBroken;
+
+		~connection_t();
+	};
+
+	struct job_t
+	{
+		std::shared_ptr< connection_t > pConnection;
+		CDaemonRequest Request;
+	};
+
+	void	ConnectionThread( std::shared_ptr< connection_t > pConnection );
+	void	WorkerThread();
+	void	RunJob( job_t& Job );
+	bool	PushJob( job_t&& Job );
+	bool	PopJob( job_t& Job );
+
+	std::shared_ptr< replay_t > GetReplay( const std::string& filename, bool *pbCacheHit, std::string *pError );
+	bool	LoadReplay( replay_t& Replay );
+
+	bool	SendResponse( connection_t& Connection, const CDaemonResponse& Response );
+
+	int m_nCacheSize;
+	size_t m_nMaxJobs;
+	bool m_bStopping;
+
+	// Job queue
+	std::mutex m_jobMutex;
+	std::condition_variable m_jobCv;
+	std::condition_variable m_jobSpaceCv;
+	std::deque< job_t > m_jobs;
+	std::vector< std::thread > m_workers;
+
+	// Replay cache, most recently used first
+	std::mutex m_cacheMutex;
+	std::list< std::shared_ptr< replay_t > > m_lru;
+	std::unordered_map< std::string, std::list< std::shared_ptr< replay_t > >::iterator > m_cache;
+
+	// Connections that are still being read from
+	std::mutex m_connectionMutex;
+	std::condition_variable m_connectionCv;
+	std::vector< std::shared_ptr< connection_t > > m_connections;
+};
+
+#endif // DEMODAEMON_H
@@ -22,15 +22,31 @@
 // THE POSSIBILITY OF SUCH DAMAGE.
 //===========================================================================//
 
-#include <assert.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include "demofile.h"
+#include "demoarchive.h"
+#include "demoreadahead.h"
 #include "snappy.h"
 
+// In follow mode, how long to sleep between checks when inotify doesn't report anything (e.g. on NFS)
+#define DEMOFILE_FOLLOW_POLL_MS			250
+// ... and how long the file may stay unchanged before it is considered abandoned
+#define DEMOFILE_FOLLOW_IDLE_TIMEOUT_MS	( 5 * 60 * 1000 )
+
+// When resyncing, frames whose tick is further than this past the last good one are not believed
+#define DEMOFILE_RESYNC_MAX_TICK_GAP	( 30 * 60 )
+
 /**
  * Decodes a uint32 from the string of variable length and updates the index into the buffer
+ *
+ * @param pbError Optional Will be set to true if the data is corrupt or ends in the middle of the varint
  */ 
-uint32 ReadVarInt32( const std::string& buf, size_t& index )
+uint32 ReadVarInt32( const std::string& buf, size_t& index, bool *pbError )
 {
 	uint32 b;
 	int count = 0;
@@ -42,12 +58,14 @@ uint32 ReadVarInt32( const std::string& buf, size_t& index )
 		{
 			// If we get here it means that the fifth bit had its
 			// high bit set, which implies corrupt data.
-			assert( 0 );
+			if( pbError )
+				*pbError = true;
 			return result;
 		}
 		else if ( index >= buf.size() )
 		{
-			assert( 0 );
+			if( pbError )
+				*pbError = true;
 			return result;
 		}
 
@@ -59,9 +77,108 @@ uint32 ReadVarInt32( const std::string& buf, size_t& index )
 	return result;
 }
 
+/**
+ * 64 bit MurmurHash2 (MurmurHash64A), used to recognise identical blobs of data
+ */ 
+uint64 HashBytes64( const void *pData, size_t size, uint64 seed )
+{
+	const uint64 m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	const unsigned char *p = ( const unsigned char * )pData;
+	uint64 h = seed ^ ( size * m );
+
+	for( ; size >= 8; p += 8, size -= 8 )
+	{
+		uint64 k;
+
+		memcpy( &k, p, sizeof( k ) );
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	if( size )
+	{
+		for( size_t i = size; i-- > 0; )
+		{
+			h ^= ( uint64 )p[ i ] << ( 8 * i );
+		}
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+/**
+ * Hash of the DEM_FileHeader frame, it has the server, map and build of the demo. Side files
+ * made for a demo use it to notice when the demo has been replaced.
+ */ 
+bool GetDemoFileHash( CDemoFile& demofile, uint64 *pHash )
+{
+	int tick;
+	bool bCompressed;
+	const char *pBuffer;
+	int size;
+	size_t nPos = demofile.GetPos();
+
+	demofile.SetPos( 0 );
+
+	bool bOk = !demofile.IsDone() && demofile.ReadMessageType( &tick, &bCompressed ) == DEM_FileHeader &&
+		demofile.ReadRawMessage( &pBuffer, &size );
+
+	*pHash = bOk ? HashBytes64( pBuffer, size ) : 0;
+
+	demofile.SetPos( nPos );
+	return bOk;
+}
+
+/**
+ * Like ReadVarInt32 but doesn't complain about running out of data
+ *
+ * @return false if the buffer ends before the varint does
+ */ 
+static bool PeekVarInt32( const std::string& buf, size_t& index, uint32 *pValue )
+{
+	uint32 result = 0;
+
+	for( int count = 0; count < 5; count++ )
+	{
+		if( index >= buf.size() )
+			return false;
+
+		uint32 b = ( unsigned char )buf[ index++ ];
+		result |= ( b & 0x7F ) << ( 7 * count );
+
+		if( !( b & 0x80 ) )
+		{
+			*pValue = result;
+			return true;
+		}
+	}
+
+	*pValue = result;
+	return true;
+}
+
 CDemoFile::CDemoFile() :
+	m_nFileInfoOffset( 0 ),
+	m_fpFollow( NULL ),
+	m_inotifyFd( -1 ),
+	m_nFollowBytesRead( 0 ),
+	m_pReadAhead( NULL ),
+	m_nReadAheadFile( -1 ),
+	m_nLastCommand( DEM_Error ),
+	m_nLastTick( -1 ),
+	m_LastError( DEMO_ERROR_NONE ),
 	m_fileBufferPos( 0 )
 {
+	memset( m_nErrorCounts, 0, sizeof( m_nErrorCounts ) );
 }
 
 CDemoFile::~CDemoFile()
@@ -76,7 +193,115 @@ CDemoFile::~CDemoFile()
  */ 
 bool CDemoFile::IsDone()
 {
-	return m_fileBufferPos >= m_fileBuffer.size();
+	if( m_fpFollow )
+	{
+		// The file info is the last thing written, anything before it is still in progress
+		while( m_nLastCommand != DEM_FileInfo && !IsFrameAvailable() )
+		{
+			if( !WaitForFollowData() )
+				return true;
+		}
+
+		return m_nLastCommand == DEM_FileInfo;
+	}
+
+	// Pull in chunks until the next frame is complete or there is nothing more to come
+	while( m_pReadAhead && !IsFrameAvailable() && ReadAheadData() )
+	{
+	}
+
+	return m_fileBufferPos >= GetFrameStream().size();
+}
+
+/**
+ * Checks, without consuming anything, that a whole frame (header and message) is in the buffer
+ */ 
+bool CDemoFile::IsFrameAvailable()
+{
+	size_t index = m_fileBufferPos;
+	uint32 Cmd, Tick, Size;
+
+	if( !PeekVarInt32( m_fileBuffer, index, &Cmd ) ||
+		!PeekVarInt32( m_fileBuffer, index, &Tick ) ||
+		!PeekVarInt32( m_fileBuffer, index, &Size ) )
+	{
+		return false;
+	}
+
+	return index + Size <= m_fileBuffer.size();
+}
+
+/**
+ * Appends whatever has been written to the followed file since the last call
+ *
+ * @return false if nothing new was read
+ */ 
+bool CDemoFile::ReadFollowData()
+{
+	struct stat st;
+
+	if( fstat( fileno( m_fpFollow ), &st ) || ( size_t )st.st_size <= m_nFollowBytesRead )
+		return false;
+
+	size_t Length = st.st_size - m_nFollowBytesRead;
+	size_t nStart = m_fileBuffer.size();
+
+	m_fileBuffer.resize( nStart + Length );
+
+	clearerr( m_fpFollow );
+	fseek( m_fpFollow, m_nFollowBytesRead, SEEK_SET );
+	Length = fread( &m_fileBuffer[ nStart ], 1, Length, m_fpFollow );
+
+	m_fileBuffer.resize( nStart + Length );
+	m_nFollowBytesRead += Length;
+	return Length > 0;
+}
+
+/**
+ * Blocks until the followed file grows
+ *
+ * @return false if the file went away or stayed unchanged for DEMOFILE_FOLLOW_IDLE_TIMEOUT_MS
+ */ 
+bool CDemoFile::WaitForFollowData()
+{
+	int nIdleMs = 0;
+
+	while( !ReadFollowData() )
+	{
+		if( nIdleMs >= DEMOFILE_FOLLOW_IDLE_TIMEOUT_MS )
+		{
+			fprintf( stderr, "CDemoFile::WaitForFollowData: %s hasn't changed for %d seconds.\n",
+				m_szFileName.c_str(), nIdleMs / 1000 );
+			return false;
+		}
+
+		struct pollfd pfd = { m_inotifyFd, POLLIN, 0 };
+
+		if( m_inotifyFd < 0 || poll( &pfd, 1, DEMOFILE_FOLLOW_POLL_MS ) <= 0 )
+		{
+			if( m_inotifyFd < 0 )
+				usleep( DEMOFILE_FOLLOW_POLL_MS * 1000 );
+			nIdleMs += DEMOFILE_FOLLOW_POLL_MS;
+			continue;
+		}
+
+		char events[ 4096 ];
+		ssize_t nRead = read( m_inotifyFd, events, sizeof( events ) );
+
+		for( ssize_t i = 0; i < nRead; )
+		{
+			const struct inotify_event *pEvent = ( const struct inotify_event * )&events[ i ];
+
+			if( pEvent->mask & ( IN_DELETE_SELF | IN_MOVE_SELF ) )
+			{
+				// Pick up anything written just before it went away
+				return ReadFollowData();
+			}
+			i += sizeof( struct inotify_event ) + pEvent->len;
+		}
+	}
+
+	return true;
 }
 
 /**
@@ -88,21 +313,41 @@ bool CDemoFile::IsDone()
  */ 
 EDemoCommands CDemoFile::ReadMessageType( int *pTick, bool *pbCompressed )
 {
+	const std::string& Frames = GetFrameStream();
+	bool bError = false;
 
-	uint32 Cmd = ReadVarInt32( m_fileBuffer, m_fileBufferPos );
+	uint32 Cmd = ReadVarInt32( Frames, m_fileBufferPos, &bError );
 
 	if( pbCompressed )//This is a null check
 		*pbCompressed = !!( Cmd & DEM_IsCompressed );//Double negation to go from uint32 to bool without truncation issues.
 
 	Cmd = ( Cmd & ~DEM_IsCompressed );//the second three bits (0x70) are being used to say if it's compressed not sure why 3 bits. This may increase the total number of allowable values in overloaded field
 
-	int Tick = ReadVarInt32( m_fileBuffer, m_fileBufferPos );
+	int Tick = ReadVarInt32( Frames, m_fileBufferPos, &bError );
 	if( pTick )//Another null check
 		*pTick = Tick;
 
-	if( m_fileBufferPos >= m_fileBuffer.size() )//This would indicate that we'd finished the string already.
+	m_nLastCommand = ( EDemoCommands )Cmd;
+
+	if( m_fileBufferPos >= Frames.size() )//This would indicate that we'd finished the string already.
+	{
+		ReportError( DEMO_ERROR_TRUNCATED );
 		return DEM_Error;//If we'd actually gone > rather than = random memory would have been read.
+	}
+
+	if( bError )
+	{
+		ReportError( DEMO_ERROR_BAD_VARINT );
+		return DEM_Error;
+	}
 
+	if( Cmd >= DEM_Max )
+	{
+		ReportError( DEMO_ERROR_BAD_COMMAND );
+		return DEM_Error;
+	}
+
+	m_nLastTick = Tick;
 	return ( EDemoCommands )Cmd;
 }
 
@@ -113,7 +358,44 @@ EDemoCommands CDemoFile::ReadMessageType( int *pTick, bool *pbCompressed )
  */ 
 bool CDemoFile::ReadMessage( IDemoMessage *pMsg, bool bCompressed, int *pSize, int *pUncompressedSize )
 {
-	int Size = ReadVarInt32( m_fileBuffer, m_fileBufferPos );
+	if( pMsg )//we don't bother actually reading it if they don't care about the results.
+	{
+		const char *parseBuffer;
+		int parseSize;
+
+		if( !ReadMessageData( bCompressed, &parseBuffer, &parseSize, pSize, pUncompressedSize ) )
+			return false;
+
+		if( !pMsg->GetProtoMsg().ParseFromArray( parseBuffer, parseSize ) )
+		{
+			ReportError( DEMO_ERROR_PARSE );
+			return false;
+		}
+		return true;
+	}
+	else//even if they don't care about the message we still need to move past the message we were supposed to read
+	{
+		if( pUncompressedSize )
+		{
+			*pUncompressedSize = 0;
+		}
+		return ReadRawMessage( NULL, pSize );
+	}
+}
+
+/**
+ * Reads the next message and decompresses it if needed, but leaves the parsing to the caller
+ *
+ * @param ppData Will point at the encoded message, valid until the next read
+ * @param pDataSize Will be set to the size of the encoded message
+ * @param pSize Optional Will be set to the stored size of the message
+ * @param pUncompressedSize Optional Will be set to the decompressed size, 0 if the message wasn't compressed
+ */ 
+bool CDemoFile::ReadMessageData( bool bCompressed, const char **ppData, int *pDataSize, int *pSize, int *pUncompressedSize )
+{
+	const std::string& Frames = GetFrameStream();
+	bool bError = false;
+	uint32 Size = ReadVarInt32( Frames, m_fileBufferPos, &bError );
 
 	if( pSize )
 	{
@@ -124,65 +406,126 @@ bool CDemoFile::ReadMessage( IDemoMessage *pMsg, bool bCompressed, int *pSize, i
 		*pUncompressedSize = 0;
 	}
 
-	if( m_fileBufferPos + Size > m_fileBuffer.size() )
+	if( bError || Size > Frames.size() - m_fileBufferPos )
 	{
-		assert( 0 );
+		ReportError( DEMO_ERROR_TRUNCATED );
 		return false;
 	}
 
-	if( pMsg )//we don't bother actually reading it if they don't care about the results.
-	{
-		const char *parseBuffer = &m_fileBuffer[ m_fileBufferPos ];
-		m_fileBufferPos += Size;
+	const char *parseBuffer = Frames.data() + m_fileBufferPos;
+	m_fileBufferPos += Size;
 
-		if( bCompressed )
+	if( bCompressed )
+	{
+		if ( snappy::IsValidCompressedBuffer( parseBuffer, Size ) )
 		{
-			if ( snappy::IsValidCompressedBuffer( parseBuffer, Size ) )
+			size_t uDecompressedLen;
+
+			if ( snappy::GetUncompressedLength( parseBuffer, Size, &uDecompressedLen ) )
 			{
-				size_t uDecompressedLen;
+				if( pUncompressedSize )
+				{
+					*pUncompressedSize = uDecompressedLen;
+				}
+
+				m_parseBufferSnappy.resize( uDecompressedLen );//we checked how big it was now we give ourselves the space
+				char *parseBufferUncompressed = &m_parseBufferSnappy[ 0 ];
 
-				if ( snappy::GetUncompressedLength( parseBuffer, Size, &uDecompressedLen ) )
+				if ( snappy::RawUncompress( parseBuffer, Size, parseBufferUncompressed ) )
 				{
-					if( pUncompressedSize )
-					{
-						*pUncompressedSize = uDecompressedLen;
-					}
-
-					m_parseBufferSnappy.resize( uDecompressedLen );//we checked how big it was now we give ourselves the space
-					char *parseBufferUncompressed = &m_parseBufferSnappy[ 0 ];
-
-					if ( snappy::RawUncompress( parseBuffer, Size, parseBufferUncompressed ) )
-					{
-						if ( pMsg->GetProtoMsg().ParseFromArray( parseBufferUncompressed, uDecompressedLen ) )
-						{
-							return true;
-						}
-					}
+					*ppData = parseBufferUncompressed;
+					*pDataSize = uDecompressedLen;
+					return true;
 				}
 			}
-
-			assert( 0 );
-			fprintf( stderr, "CDemoFile::ReadMessage() snappy::RawUncompress failed.\n" );
-			return false;
 		}
 
-		return pMsg->GetProtoMsg().ParseFromArray( parseBuffer, Size ); //I would have put this in an else
+		ReportError( DEMO_ERROR_DECOMPRESS );
+		return false;
 	}
-	else//even if they don't care about the message we still need to move past the message we were supposed to read
+
+	*ppData = parseBuffer;
+	*pDataSize = Size;
+	return true;
+}
+
+/**
+ * Returns the next message exactly as it is stored in the file, without decompressing or parsing it
+ *
+ * @param ppBuffer Optional Will point into the file buffer at the (possibly compressed) message, valid until the next read (in follow mode the buffer grows and can move)
+ * @param pSize Optional Will be set to the stored size of the message
+ */ 
+bool CDemoFile::ReadRawMessage( const char **ppBuffer, int *pSize )
+{
+	const std::string& Frames = GetFrameStream();
+	bool bError = false;
+	uint32 Size = ReadVarInt32( Frames, m_fileBufferPos, &bError );
+
+	if( bError || Size > Frames.size() - m_fileBufferPos )
 	{
-		m_fileBufferPos += Size;
-		return true;
+		ReportError( DEMO_ERROR_TRUNCATED );
+		return false;
 	}
+
+	if( ppBuffer )
+		*ppBuffer = Frames.data() + m_fileBufferPos;
+	if( pSize )
+		*pSize = Size;
+
+	m_fileBufferPos += Size;
+	return true;
+}
+
+/**
+ * Hands out the frame stream so other CDemoFiles can read it with OpenShared() instead of
+ * reading the file again. This file carries on reading the shared copy.
+ *
+ * @return NULL in follow mode, the stream still grows then
+ */ 
+std::shared_ptr< const std::string > CDemoFile::ShareFrameStream()
+{
+	if( IsFollowing() )
+		return NULL;
+
+	FinishReadAhead();
+
+	if( !m_pSharedBuffer )
+	{
+		m_pSharedBuffer = std::make_shared< const std::string >( std::move( m_fileBuffer ) );
+		m_fileBuffer.clear();
+	}
+
+	return m_pSharedBuffer;
+}
+
+/**
+ * Reads a frame stream another CDemoFile shared, only the position and the errors are this file's own
+ */ 
+bool CDemoFile::OpenShared( const char *name, const std::shared_ptr< const std::string >& pFrameStream, int32 nFileInfoOffset )
+{
+	Close();
+
+	if( !pFrameStream || pFrameStream->empty() )
+		return false;
+
+	m_pSharedBuffer = pFrameStream;
+	m_nFileInfoOffset = nFileInfoOffset;
+	m_szFileName = name;
+	return true;
 }
 
 /**
  * Opens a file and reads the entire thing into memory and check that it appears to be the right type
  * @param name the name of the file to open
  */ 
-bool CDemoFile::Open( const char *name )
+bool CDemoFile::Open( const char *name, CDemoReadAhead *pReadAhead )
 {
 	Close();//Initializes the values
 
+	int nReadAheadFile = pReadAhead ? pReadAhead->FindFile( name ) : -1;
+	if( nReadAheadFile >= 0 )
+		return OpenReadAhead( name, pReadAhead, nReadAheadFile );
+
 	FILE *fp = fopen( name, "rb" );
 	if( fp )
 	{
@@ -193,29 +536,56 @@ bool CDemoFile::Open( const char *name )
 		Length = ftell( fp );
 		fseek( fp, 0, SEEK_SET );//This was just to get the size.
 
-		if( Length < sizeof( DotaDemoHeader ) )
+		if( Length < sizeof( DotaDemoHeader ) ||
+			fread( &DotaDemoHeader, 1, sizeof( DotaDemoHeader ), fp ) != sizeof( DotaDemoHeader ) )
 		{
 			fprintf( stderr, "CDemoFile::Open: file too small. %s.\n", name );
+			fclose( fp );
 			return false;
 		}
 
-		fread( &DotaDemoHeader, 1, sizeof( DotaDemoHeader ), fp );
 		Length -= sizeof( DotaDemoHeader );
 
-		if( strcmp( DotaDemoHeader.demofilestamp, PROTODEMO_HEADER_ID ) )
+		if( !memcmp( DotaDemoHeader.demofilestamp, DEMOARCHIVE_HEADER_ID, sizeof( DotaDemoHeader.demofilestamp ) ) )
+		{
+			// Archives come back as a plain frame stream with all frames decompressed
+			bool bOk = ReadDemoArchive( fp, name, m_fileBuffer, DotaDemoHeader );
+			fclose( fp );
+
+			if( !bOk )
+			{
+				Close();
+				return false;
+			}
+
+			m_nFileInfoOffset = DotaDemoHeader.fileinfo_offset;
+			m_fileBufferPos = 0;
+			m_szFileName = name;
+			return true;
+		}
+
+		if( memcmp( DotaDemoHeader.demofilestamp, PROTODEMO_HEADER_ID, sizeof( DotaDemoHeader.demofilestamp ) ) )
 		{
 			fprintf( stderr, "CDemoFile::Open: demofilestamp doesn't match. %s.\n", name );
+			fclose( fp );
 			return false;
 		}
 
+		m_nFileInfoOffset = DotaDemoHeader.fileinfo_offset;
+
 		m_fileBuffer.resize( Length );//apparently we read in the entire file into memory at once
-		fread( &m_fileBuffer[ 0 ], 1, Length, fp );
+		size_t nRead = Length ? fread( &m_fileBuffer[ 0 ], 1, Length, fp ) : 0;
 		fclose( fp );
 		fp = NULL;
+
+		// Keep what we got, the frames that made it are still worth reading
+		if( nRead != Length )
+		{
+			m_fileBuffer.resize( nRead );
+			ReportError( DEMO_ERROR_TRUNCATED );
+		}
 	}
 
-  //This is the wrong way to check the return value. They should be checking that
-  //they read in the expected length.
 	if ( !m_fileBuffer.size() )
 	{
 		fprintf( stderr, "CDemoFile::Open: couldn't open file %s.\n", name );
@@ -228,6 +598,171 @@ bool CDemoFile::Open( const char *name )
 	return true;
 }
 
+/**
+ * Open() for a file that pReadAhead is reading. Parsing can start as soon as the first chunk is in.
+ */ 
+bool CDemoFile::OpenReadAhead( const char *name, CDemoReadAhead *pReadAhead, int nFile )
+{
+	size_t Length;
+	protodemoheader_t DotaDemoHeader;
+
+	m_pReadAhead = pReadAhead;
+	m_nReadAheadFile = nFile;
+	m_szFileName = name;
+
+	if( !pReadAhead->GetFileSize( nFile, &Length ) )
+	{
+		fprintf( stderr, "CDemoFile::Open: couldn't open file %s.\n", name );
+		Close();
+		return false;
+	}
+
+	// All of it ends up in here, reserve so that appending never moves the frames
+	m_fileBuffer.reserve( Length );
+
+	while( m_fileBuffer.size() < sizeof( DotaDemoHeader ) && ReadAheadData() )
+	{
+	}
+
+	if( m_fileBuffer.size() < sizeof( DotaDemoHeader ) )
+	{
+		fprintf( stderr, "CDemoFile::Open: file too small. %s.\n", name );
+		Close();
+		return false;
+	}
+
+	memcpy( &DotaDemoHeader, m_fileBuffer.data(), sizeof( DotaDemoHeader ) );
+
+	if( !memcmp( DotaDemoHeader.demofilestamp, DEMOARCHIVE_HEADER_ID, sizeof( DotaDemoHeader.demofilestamp ) ) )
+	{
+		// Archives are decompressed as a whole, read the rest and hand it over as a FILE
+		std::string frameStream;
+
+		FinishReadAhead();
+		FILE *fp = fmemopen( &m_fileBuffer[ 0 ], m_fileBuffer.size(), "rb" );
+		bool bOk = fp && ReadDemoArchive( fp, name, frameStream, DotaDemoHeader );
+
+		if( fp )
+			fclose( fp );
+
+		if( !bOk )
+		{
+			Close();
+			return false;
+		}
+
+		m_fileBuffer.swap( frameStream );
+	}
+	else if( memcmp( DotaDemoHeader.demofilestamp, PROTODEMO_HEADER_ID, sizeof( DotaDemoHeader.demofilestamp ) ) )
+	{
+		fprintf( stderr, "CDemoFile::Open: demofilestamp doesn't match. %s.\n", name );
+		Close();
+		return false;
+	}
+	else
+	{
+		m_fileBuffer.erase( 0, sizeof( DotaDemoHeader ) );
+	}
+
+	m_nFileInfoOffset = DotaDemoHeader.fileinfo_offset;
+	m_fileBufferPos = 0;
+	return true;
+}
+
+/**
+ * Appends the next chunk from the read-ahead
+ *
+ * @return false once the whole file has been read
+ */ 
+bool CDemoFile::ReadAheadData()
+{
+	bool bError = false;
+
+	if( !m_pReadAhead )
+		return false;
+
+	bool bMore = m_pReadAhead->AppendChunk( m_nReadAheadFile, m_fileBuffer, &bError );
+
+	// Keep what we got, like Open() does when fread() comes up short
+	if( bError )
+		ReportError( DEMO_ERROR_TRUNCATED );
+
+	if( !bMore || bError )
+	{
+		m_pReadAhead->ReleaseFile( m_nReadAheadFile );
+		m_pReadAhead = NULL;
+		m_nReadAheadFile = -1;
+		return bMore;
+	}
+
+	return true;
+}
+
+/**
+ * Waits for the rest of the file, for the code that jumps around in it
+ */ 
+void CDemoFile::FinishReadAhead()
+{
+	while( ReadAheadData() )
+	{
+	}
+}
+
+/**
+ * Opens a demo that is still being recorded. Frames are read as they are written and the file
+ * is considered done once its DEM_FileInfo has been read.
+ *
+ * @param name the name of the file to follow
+ */ 
+bool CDemoFile::OpenFollow( const char *name )
+{
+	Close();
+
+	m_fpFollow = fopen( name, "rb" );
+	if( !m_fpFollow )
+	{
+		fprintf( stderr, "CDemoFile::OpenFollow: couldn't open file %s.\n", name );
+		return false;
+	}
+
+	m_szFileName = name;
+	m_inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+	if( m_inotifyFd >= 0 &&
+		inotify_add_watch( m_inotifyFd, name, IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF ) < 0 )
+	{
+		close( m_inotifyFd );
+		m_inotifyFd = -1;
+	}
+
+	// Wait for the header, the frames start right after it
+	protodemoheader_t DotaDemoHeader;
+
+	ReadFollowData();
+	while( m_fileBuffer.size() < sizeof( DotaDemoHeader ) )
+	{
+		if( !WaitForFollowData() )
+		{
+			fprintf( stderr, "CDemoFile::OpenFollow: file too small. %s.\n", name );
+			Close();
+			return false;
+		}
+	}
+
+	memcpy( &DotaDemoHeader, m_fileBuffer.data(), sizeof( DotaDemoHeader ) );
+
+	if( memcmp( DotaDemoHeader.demofilestamp, PROTODEMO_HEADER_ID, sizeof( DotaDemoHeader.demofilestamp ) ) )
+	{
+		fprintf( stderr, "CDemoFile::OpenFollow: demofilestamp doesn't match. %s.\n", name );
+		Close();
+		return false;
+	}
+
+	m_fileBuffer.erase( 0, sizeof( DotaDemoHeader ) );
+	m_fileBufferPos = 0;
+	return true;
+}
+
 /**
  * Initializes the per file values
  *
@@ -235,10 +770,175 @@ bool CDemoFile::Open( const char *name )
 void CDemoFile::Close()
 {
 	m_szFileName.clear();
+	m_nFileInfoOffset = 0;
+
+	if( m_fpFollow )
+	{
+		fclose( m_fpFollow );
+		m_fpFollow = NULL;
+	}
+	if( m_inotifyFd >= 0 )
+	{
+		close( m_inotifyFd );
+		m_inotifyFd = -1;
+	}
+	m_nFollowBytesRead = 0;
+
+	if( m_pReadAhead )
+	{
+		m_pReadAhead->ReleaseFile( m_nReadAheadFile );
+		m_pReadAhead = NULL;
+		m_nReadAheadFile = -1;
+	}
+
+	m_nLastCommand = DEM_Error;
+	m_nLastTick = -1;
+
+	m_LastError = DEMO_ERROR_NONE;
+	memset( m_nErrorCounts, 0, sizeof( m_nErrorCounts ) );
+	m_lostRanges.clear();
 
 	m_fileBufferPos = 0;
 	m_fileBuffer.clear();
+	m_pSharedBuffer.reset();
 
 	m_parseBufferSnappy.clear();
 }
 
+
+static const char *s_DemoErrorNames[ DEMO_ERROR_MAX ] =
+{
+	"none",
+	"bad varint",
+	"truncated",
+	"unknown demo command",
+	"decompression failed",
+	"parse failed",
+	"bad packet",
+};
+
+const char *GetDemoErrorName( EDemoError error )
+{
+	return ( error >= 0 && error < DEMO_ERROR_MAX ) ? s_DemoErrorNames[ error ] : "???";
+}
+
+/**
+ * Counts an error, it's up to the caller to carry on or to Resync()
+ */ 
+void CDemoFile::ReportError( EDemoError error )
+{
+	m_LastError = error;
+	m_nErrorCounts[ error ]++;
+}
+
+int CDemoFile::GetErrorCount() const
+{
+	int nCount = 0;
+
+	for( int i = DEMO_ERROR_NONE + 1; i < DEMO_ERROR_MAX; i++ )
+	{
+		nCount += m_nErrorCounts[ i ];
+	}
+	return nCount;
+}
+
+/**
+ * Checks whether a frame header plausibly starts at index, see Resync()
+ *
+ * @param pNext Will be set to where the frame's message ends
+ */ 
+bool CDemoFile::IsPlausibleFrame( size_t index, size_t *pNext, bool bCheckMessage )
+{
+	const std::string& Frames = GetFrameStream();
+	bool bError = false;
+	uint32 Cmd = ReadVarInt32( Frames, index, &bError );
+	uint32 Tick = ReadVarInt32( Frames, index, &bError );
+	uint32 Size = ReadVarInt32( Frames, index, &bError );
+
+	if( bError || Size > Frames.size() - index )
+		return false;
+
+	// The compressed flag is all three bits or none of them
+	if( ( Cmd & ~0x7F ) || ( ( Cmd & DEM_IsCompressed ) && ( Cmd & DEM_IsCompressed ) != DEM_IsCompressed ) ||
+		( Cmd & ~DEM_IsCompressed ) >= DEM_Max )
+	{
+		return false;
+	}
+
+	// Ticks never go backwards and don't jump far ahead
+	if( m_nLastTick >= 0 && ( ( int )Tick < m_nLastTick || ( int )Tick - m_nLastTick > DEMOFILE_RESYNC_MAX_TICK_GAP ) )
+		return false;
+
+	if( bCheckMessage && ( Cmd & DEM_IsCompressed ) && !snappy::IsValidCompressedBuffer( Frames.data() + index, Size ) )
+		return false;
+
+	*pNext = index + Size;
+	return true;
+}
+
+/**
+ * Skips past corrupt data to the next frame that looks valid. The frame that failed to read
+ * started at nBadFramePos; the skipped bytes are recorded in GetLostRanges().
+ *
+ * A candidate frame has to have a sane header and message, and has to be followed either by
+ * the end of the file or by another sane header.
+ *
+ * @return false if there is nothing left to read
+ */ 
+bool CDemoFile::Resync( size_t nBadFramePos )
+{
+	size_t nNext, nAfter;
+
+	// Looking for the next good frame may need any part of the rest of the file
+	FinishReadAhead();
+	const std::string& Frames = GetFrameStream();
+
+	// If only the message was bad, the frame itself was read fine and we can just carry on
+	size_t nResume = m_fileBufferPos;
+	bool bFrameIntact = ( m_LastError == DEMO_ERROR_DECOMPRESS || m_LastError == DEMO_ERROR_PARSE ) &&
+		nResume > nBadFramePos && ( nResume >= Frames.size() || IsPlausibleFrame( nResume, &nNext, true ) );
+
+	if( !bFrameIntact )
+	{
+		for( nResume = nBadFramePos + 1; nResume < Frames.size(); nResume++ )
+		{
+			if( IsPlausibleFrame( nResume, &nNext, true ) &&
+				( nNext == Frames.size() || IsPlausibleFrame( nNext, &nAfter, false ) ) )
+			{
+				break;
+			}
+		}
+	}
+
+	if( nResume > Frames.size() )
+		nResume = Frames.size();
+
+	demo_lost_range_t Range = { nBadFramePos + sizeof( protodemoheader_t ), nResume + sizeof( protodemoheader_t ) };
+	m_lostRanges.push_back( Range );
+
+	m_fileBufferPos = nResume;
+	return nResume < Frames.size();
+}
+
+/**
+ * Prints the error counts and the lost byte ranges to stderr, if there were any
+ */ 
+void CDemoFile::PrintErrors() const
+{
+	if( !GetErrorCount() )
+		return;
+
+	fprintf( stderr, "%s: %d errors\n", m_szFileName.c_str(), GetErrorCount() );
+
+	for( int i = DEMO_ERROR_NONE + 1; i < DEMO_ERROR_MAX; i++ )
+	{
+		if( m_nErrorCounts[ i ] )
+			fprintf( stderr, "    %s: %d\n", GetDemoErrorName( ( EDemoError )i ), m_nErrorCounts[ i ] );
+	}
+
+	for( size_t i = 0; i < m_lostRanges.size(); i++ )
+	{
+		fprintf( stderr, "    lost bytes %zu-%zu (%zu bytes)\n", m_lostRanges[ i ].start, m_lostRanges[ i ].end,
+			m_lostRanges[ i ].end - m_lostRanges[ i ].start );
+	}
+}
@@ -25,6 +25,9 @@
 #ifndef DEMOFILE_H
 #define DEMOFILE_H
 
+#include <memory>
+#include <string>
+#include <vector>
 #include "generated_proto/demo.pb.h"
 
 typedef int32_t             int32;
@@ -73,6 +76,31 @@ typedef struct player_info_s
 	unsigned char	filesDownloaded;
 } player_info_t;
 
+/**
+ * Things that can be wrong with a demo. None of them are fatal, they are counted by CDemoFile.
+ */ 
+enum EDemoError
+{
+	DEMO_ERROR_NONE = 0,
+	DEMO_ERROR_BAD_VARINT,		// varint longer than 5 bytes
+	DEMO_ERROR_TRUNCATED,		// data ends in the middle of a frame
+	DEMO_ERROR_BAD_COMMAND,		// frame header with an unknown demo command
+	DEMO_ERROR_DECOMPRESS,		// snappy refused the message
+	DEMO_ERROR_PARSE,			// protobuf refused the message
+	DEMO_ERROR_BAD_PACKET,		// message inside a packet runs past the end of the packet
+
+	DEMO_ERROR_MAX
+};
+
+// Part of the file that was skipped because it couldn't be read, [start, end) in file offsets
+struct demo_lost_range_t
+{
+	size_t start;
+	size_t end;
+};
+
+const char *GetDemoErrorName( EDemoError error );
+
 /**
  * Base class/interface for the wrapper classes around the autogenerated protobuf classes
  */ 
@@ -112,6 +140,8 @@ typedef CDemoMessagePB< DEM_UserCmd, CDemoUserCmd >							CDemoUserCmd_t;
 typedef CDemoMessagePB< DEM_FullPacket, CDemoFullPacket >					CDemoFullPacket_t;
 typedef CDemoMessagePB< DEM_Packet, CDemoPacket >							CDemoPacket_t;
 
+class CDemoReadAhead;
+
 //-----------------------------------------------------------------------------
 // Demo file 
 //-----------------------------------------------------------------------------
@@ -121,23 +151,76 @@ public:
 	CDemoFile();
 	~CDemoFile();
 
-	bool	Open(const char *name);
+	// With pReadAhead, a file queued there is parsed while the rest of it is still being read
+	bool	Open( const char *name, CDemoReadAhead *pReadAhead = NULL );
 	void	Close();
 	bool	IsDone();
 
+	// Follow mode reads a demo that is still being written, IsDone() waits for frames to arrive
+	bool	OpenFollow( const char *name );
+	bool	IsFollowing() const					{ return m_fpFollow != NULL; }
+	bool	IsFrameAvailable();
+
+	// Any number of CDemoFiles can read one frame stream, each with its own position
+	std::shared_ptr< const std::string > ShareFrameStream();
+	bool	OpenShared( const char *name, const std::shared_ptr< const std::string >& pFrameStream, int32 nFileInfoOffset );
+
 	EDemoCommands ReadMessageType( int *pTick, bool *pbCompressed );
 	bool	ReadMessage( IDemoMessage *pMsg, bool bCompressed, int *pSize = NULL, int *pUncompressedSize = NULL );
+	bool	ReadMessageData( bool bCompressed, const char **ppData, int *pDataSize, int *pSize = NULL, int *pUncompressedSize = NULL );
+	bool	ReadRawMessage( const char **ppBuffer, int *pSize );
+
+	// Error handling, see EDemoError
+	void	ReportError( EDemoError error );
+	bool	Resync( size_t nBadFramePos );
+	EDemoError GetLastError() const				{ return m_LastError; }
+	int		GetErrorCount( EDemoError error ) const	{ return m_nErrorCounts[ error ]; }
+	int		GetErrorCount() const;
+	const std::vector< demo_lost_range_t >& GetLostRanges() const { return m_lostRanges; }
+	void	PrintErrors() const;
+
+	// Offsets are relative to the end of the protodemoheader_t, i.e. into the frame stream.
+	// With read-ahead GetSize() only counts what has arrived so far.
+	size_t	GetPos() const						{ return m_fileBufferPos; }
+	size_t	GetSize() const						{ return GetFrameStream().size(); }
+	void	SetPos( size_t pos )				{ FinishReadAhead(); m_fileBufferPos = pos; }
+	int32	GetFileInfoOffset() const			{ return m_nFileInfoOffset; }
 
 private:
+	bool	OpenReadAhead( const char *name, CDemoReadAhead *pReadAhead, int nFile );
+	bool	ReadAheadData();
+	void	FinishReadAhead();
+	bool	ReadFollowData();
+	bool	WaitForFollowData();
+	bool	IsPlausibleFrame( size_t index, size_t *pNext, bool bCheckMessage );
+	const std::string& GetFrameStream() const	{ return m_pSharedBuffer ? *m_pSharedBuffer : m_fileBuffer; }
+
 	std::string m_szFileName;
+	int32 m_nFileInfoOffset;
+
+	FILE *m_fpFollow;
+	int m_inotifyFd;
+	size_t m_nFollowBytesRead;
+
+	CDemoReadAhead *m_pReadAhead;
+	int m_nReadAheadFile;
+	EDemoCommands m_nLastCommand;
+	int m_nLastTick;
+
+	EDemoError m_LastError;
+	int m_nErrorCounts[ DEMO_ERROR_MAX ];
+	std::vector< demo_lost_range_t > m_lostRanges;
 
 	size_t m_fileBufferPos;
 	std::string m_fileBuffer;
+	std::shared_ptr< const std::string > m_pSharedBuffer;	// read instead of m_fileBuffer when set
 
 	std::string m_parseBufferSnappy;
 };
 
-uint32 ReadVarInt32( const std::string& buf, size_t& index );
+uint32 ReadVarInt32( const std::string& buf, size_t& index, bool *pbError = NULL );
+uint64 HashBytes64( const void *pData, size_t size, uint64 seed = 0 );
+bool GetDemoFileHash( CDemoFile& demofile, uint64 *pHash );
 
 #endif // DEMOFILE_H
 
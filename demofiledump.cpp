@@ -24,6 +24,8 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <chrono>
+#include "democheckpoint.h"
 #include "demofile.h"
 #include "demofiledump.h"
 
@@ -36,27 +38,34 @@
 #include "generated_proto/dota_modifiers.pb.h"
 #include "generated_proto/dota_commonmessages.pb.h"
 #include "generated_proto/dota_usermessages.pb.h"
+#include "generated_proto/flatdecoders.h"
 
-void fatal_errorf( const char* fmt, ... )
+/**
+ * Passes to CDemoFile.Open() and does minor error checking
+ */ 
+bool CDemoFileDump::Open( const char *filename, CDemoReadAhead *pReadAhead )
 {
-    va_list  vlist;
-    char buf[ 1024 ];
+	m_pGameEventSchema.reset();
+	m_nFrameNumber = 0;
 
-    va_start( vlist, fmt);
-    vsnprintf( buf, sizeof( buf ), fmt, vlist );
-	buf[ sizeof( buf ) - 1 ] = 0;
-    va_end( vlist );
+	if ( !m_demofile.Open( filename, pReadAhead ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
 
-    fprintf( stderr, "\nERROR: %s\n", buf );
-    exit( -1 );
+	return true;
 }
 
 /**
- * Passes to CDemoFile.Open() and does minor error checking
+ * Same as Open() but for a demo that is still being recorded, see CDemoFile::OpenFollow()
  */ 
-bool CDemoFileDump::Open( const char *filename )
+bool CDemoFileDump::OpenFollow( const char *filename )
 {
-	if ( !m_demofile.Open( filename ) )
+	m_pGameEventSchema.reset();
+	m_nFrameNumber = 0;
+
+	if ( !m_demofile.OpenFollow( filename ) )
 	{
 		fprintf( stderr, "Couldn't open '%s'\n", filename );
 		return false;
@@ -65,6 +74,38 @@ bool CDemoFileDump::Open( const char *filename )
 	return true;
 }
 
+/**
+ * Restores the state from the last checkpoint at or before tick (see CDemoCheckpoints) so that
+ * DoDump() starts at the frame after it. filename is the demo that was passed to Open().
+ */ 
+bool CDemoFileDump::SeekToCheckpoint( const char *filename, int tick )
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CDemoCheckpoints Checkpoints;
+	demo_parser_state_t State;
+
+	if( !Checkpoints.Load( filename, m_demofile ) )
+	{
+		fprintf( stderr, "No checkpoints for '%s', make them with -checkpoint.\n", filename );
+		return false;
+	}
+
+	if( !Checkpoints.Restore( tick, State ) )
+	{
+		fprintf( stderr, "Couldn't restore the checkpoint before tick %d of '%s'.\n", tick, filename );
+		return false;
+	}
+
+	m_pGameEventSchema = State.pGameEventSchema;
+	m_nFrameNumber = State.frame_number;
+	m_demofile.SetPos( State.frame_pos );
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	fprintf( stderr, "Restored the checkpoint at tick %d, frame #%d in %.2f ms.\n", State.tick, State.frame_number,
+		std::chrono::duration< double, std::milli >( end - start ).count() );
+	return true;
+}
+
 /**
  * Prints out the typeof a message and then feeds text to printf..
  */ 
@@ -102,13 +143,14 @@ void PrintUserMessage( CDemoFileDump& Demo, const void *parseBuffer, int BufferS
  */ 
 void CDemoFileDump::DumpUserMessage( const void *parseBuffer, int BufferSize )
 {
-	CSVCMsg_UserMessage userMessage;
+	// The flat decoder points into the packet instead of copying the payload out
+	CFlat_CSVCMsg_UserMessage userMessage;
 
-	if( userMessage.ParseFromArray( parseBuffer, BufferSize ) )
+	if( userMessage.Decode( ( const char * )parseBuffer, BufferSize ) )
 	{
 		int Cmd = userMessage.msg_type();
 		int SizeUM = userMessage.msg_data().size();
-		const void *parseBufferUM = &userMessage.msg_data()[ 0 ];
+		const void *parseBufferUM = userMessage.msg_data().data();
 
 		switch( Cmd )
 		{
@@ -197,21 +239,97 @@ void PrintNetMessage( CDemoFileDump& Demo, const void *parseBuffer, int BufferSi
 
 	if( msg.ParseFromArray( parseBuffer, BufferSize ) )
 	{
-		if( msgType == svc_GameEventList )
-		{
-			Demo.m_GameEventList.CopyFrom( msg );//unclear why this isn't broken up into a separate class
-		}
-
 		Demo.MsgPrintf( msg, BufferSize, "%s", msg.DebugString().c_str() );
 	}
 }
 
+/**
+ * Same as PrintNetMessage but takes the message from the schema cache, for the ones that are the
+ * same in every replay of a game build
+ */ 
+template < class T >
+void PrintInternedNetMessage( CDemoFileDump& Demo, const void *parseBuffer, int BufferSize )
+{
+	std::shared_ptr< const T > pMsg = CSchemaCache< T >::Intern( parseBuffer, BufferSize );
+
+	if( pMsg )
+	{
+		Demo.MsgPrintf( *pMsg, BufferSize, "%s", pMsg->DebugString().c_str() );
+	}
+}
+
+template <>
+void PrintNetMessage< CSVCMsg_SendTable, svc_SendTable >( CDemoFileDump& Demo, const void *parseBuffer, int BufferSize )
+{
+	PrintInternedNetMessage< CSVCMsg_SendTable >( Demo, parseBuffer, BufferSize );
+}
+
+template <>
+void PrintNetMessage< CSVCMsg_ClassInfo, svc_ClassInfo >( CDemoFileDump& Demo, const void *parseBuffer, int BufferSize )
+{
+	PrintInternedNetMessage< CSVCMsg_ClassInfo >( Demo, parseBuffer, BufferSize );
+}
+
+/**
+ * Keeps the game event list as the demo state so that game events can be decoded
+ */ 
+template <>
+void PrintNetMessage< CSVCMsg_GameEventList, svc_GameEventList >( CDemoFileDump& Demo, const void *parseBuffer, int BufferSize )
+{
+	std::shared_ptr< const CGameEventSchema > pSchema = CSchemaCache< CGameEventSchema >::Intern( parseBuffer, BufferSize );
+
+	if( pSchema )
+	{
+		Demo.m_pGameEventSchema = pSchema;
+
+		Demo.MsgPrintf( pSchema->m_GameEventList, BufferSize, "%s", pSchema->m_GameEventList.DebugString().c_str() );
+	}
+}
+
 template <>
 void PrintNetMessage< CSVCMsg_UserMessage, svc_UserMessage >( CDemoFileDump& Demo, const void *parseBuffer, int BufferSize )
 {
 	Demo.DumpUserMessage( parseBuffer, BufferSize );
 }
 
+/**
+ * Prints the keys of a game event by the names in its descriptor, works with both the flat decoder and libprotobuf
+ */ 
+template < class T >
+static void PrintGameEvent( const CSVCMsg_GameEventList::descriptor_t& Descriptor, const T& msg )
+{
+	int numKeys = msg.keys().size();
+
+	printf( "%s eventid:%d %.*s\n", Descriptor.name().c_str(), msg.eventid(),
+		msg.has_event_name() ? ( int )msg.event_name().size() : 0, msg.event_name().data() );
+
+	for( int i = 0; i < numKeys; i++ )
+	{
+		const CSVCMsg_GameEventList::key_t& Key = Descriptor.keys( i );
+		const typename T::key_t& KeyValue = msg.keys( i );
+
+		printf(" %s: ", Key.name().c_str() );//It appears that the names for the keys are stored globally. Perhaps this
+    //is what the string tables are for. Communicated from the server as part of the loading screen perhaps?
+
+		if( KeyValue.has_val_string() )
+			printf( "%.*s ", ( int )KeyValue.val_string().size(), KeyValue.val_string().data() );
+		if( KeyValue.has_val_float() )
+			printf( "%f ", KeyValue.val_float() );
+		if( KeyValue.has_val_long() )
+			printf( "%d ", KeyValue.val_long() );
+		if( KeyValue.has_val_short() )
+			printf( "%d ", KeyValue.val_short() );
+		if( KeyValue.has_val_byte() )
+			printf( "%d ", KeyValue.val_byte() );
+		if( KeyValue.has_val_bool() )
+			printf( "%d ", KeyValue.val_bool() );
+		if( KeyValue.has_val_uint64() )
+			printf( "%lld ", KeyValue.val_uint64() );
+
+		printf( "\n" );
+	}
+}
+
 /**
  * Prints out a game event in more detail it appears
  * @param Demo a Reference to our state tracking class
@@ -221,57 +339,36 @@ void PrintNetMessage< CSVCMsg_UserMessage, svc_UserMessage >( CDemoFileDump& Dem
 template <>
 void PrintNetMessage< CSVCMsg_GameEvent, svc_GameEvent >( CDemoFileDump& Demo, const void *parseBuffer, int BufferSize )
 {
-	CSVCMsg_GameEvent msg;
+	CFlat_CSVCMsg_GameEvent flat;
 
-	if( msg.ParseFromArray( parseBuffer, BufferSize ) )
+	if( flat.Decode( ( const char * )parseBuffer, BufferSize ) )
 	{
-		int iDescriptor;
+		const CSVCMsg_GameEventList::descriptor_t *pDescriptor = Demo.m_pGameEventSchema ?
+			Demo.m_pGameEventSchema->FindDescriptor( flat.eventid() ) : NULL;
 
-		for( iDescriptor = 0; iDescriptor < Demo.m_GameEventList.descriptors().size(); iDescriptor++ )
+		if( pDescriptor )
 		{
-			const CSVCMsg_GameEventList::descriptor_t& Descriptor = Demo.m_GameEventList.descriptors( iDescriptor );
+			PrintGameEvent( *pDescriptor, flat );
+			return;
+		}
+	}
 
-			if( Descriptor.eventid() == msg.eventid() )
-				break;
-		}//We appear to be going through to find the corresponding game event currently stored for the demofile. It's not clear what these are yet.
+	// Events without a descriptor are printed as text, and ones with more keys than the flat
+	// decoder has room for end up here too
+	CSVCMsg_GameEvent msg;
 
-		if( iDescriptor == Demo.m_GameEventList.descriptors().size() )//If we didn't find one that matched.
+	if( msg.ParseFromArray( parseBuffer, BufferSize ) )
+	{
+		const CSVCMsg_GameEventList::descriptor_t *pDescriptor = Demo.m_pGameEventSchema ?
+			Demo.m_pGameEventSchema->FindDescriptor( msg.eventid() ) : NULL;
+
+		if( !pDescriptor )//If we didn't find one that matched.
 		{
 			printf( "%s", msg.DebugString().c_str() );
 		}
 		else
 		{
-			int numKeys = msg.keys().size();
-			const CSVCMsg_GameEventList::descriptor_t& Descriptor = Demo.m_GameEventList.descriptors( iDescriptor );
-
-			printf( "%s eventid:%d %s\n", Descriptor.name().c_str(), msg.eventid(),
-				msg.has_event_name() ? msg.event_name().c_str() : "" );
-
-			for( int i = 0; i < numKeys; i++ )
-			{
-				const CSVCMsg_GameEventList::key_t& Key = Descriptor.keys( i );
-				const CSVCMsg_GameEvent::key_t& KeyValue = msg.keys( i );
-
-				printf(" %s: ", Key.name().c_str() );//It appears that the names for the keys are stored globally. Perhaps this
-        //is what the string tables are for. Communicated from the server as part of the loading screen perhaps?
-
-				if( KeyValue.has_val_string() )
-					printf( "%s ", KeyValue.val_string().c_str() );
-				if( KeyValue.has_val_float() )
-					printf( "%f ", KeyValue.val_float() );
-				if( KeyValue.has_val_long() )
-					printf( "%d ", KeyValue.val_long() );
-				if( KeyValue.has_val_short() )
-					printf( "%d ", KeyValue.val_short() );
-				if( KeyValue.has_val_byte() )
-					printf( "%d ", KeyValue.val_byte() );
-				if( KeyValue.has_val_bool() )
-					printf( "%d ", KeyValue.val_bool() );
-				if( KeyValue.has_val_uint64() )
-					printf( "%lld ", KeyValue.val_uint64() );
-
-				printf( "\n" );
-			}
+			PrintGameEvent( *pDescriptor, msg );
 		}
 	}
 }
@@ -290,10 +387,61 @@ static std::string GetNetMsgName( int Cmd )
 		return SVC_Messages_Name( ( SVC_Messages )Cmd );
 	}
 
-	assert( 0 );
 	return "NETMSG_???";
 }
 
+/**
+ * Prints one message out of a packet
+ */ 
+void CDemoFileDump::DumpNetMessage( int Cmd, const char *pData, int Size )
+{
+	switch( Cmd )
+	{
+#define HANDLE_NetMsg( _x )		case net_ ## _x: PrintNetMessage< CNETMsg_ ## _x, net_ ## _x >( *this, pData, Size ); break
+#define HANDLE_SvcMsg( _x )		case svc_ ## _x: PrintNetMessage< CSVCMsg_ ## _x, svc_ ## _x >( *this, pData, Size ); break
+
+	default:
+		printf( "WARNING. DumpUserMessage(): Unknown netmessage %d.\n", Cmd );
+		break;
+
+	HANDLE_NetMsg( NOP );            	// 0
+	HANDLE_NetMsg( Disconnect );        // 1
+	HANDLE_NetMsg( File );              // 2
+	HANDLE_NetMsg( SplitScreenUser );   // 3
+	HANDLE_NetMsg( Tick );              // 4
+	HANDLE_NetMsg( StringCmd );         // 5
+	HANDLE_NetMsg( SetConVar );         // 6
+	HANDLE_NetMsg( SignonState );       // 7
+	HANDLE_SvcMsg( ServerInfo );        // 8
+	HANDLE_SvcMsg( SendTable );         // 9
+	HANDLE_SvcMsg( ClassInfo );         // 10
+	HANDLE_SvcMsg( SetPause );          // 11
+	HANDLE_SvcMsg( CreateStringTable ); // 12
+	HANDLE_SvcMsg( UpdateStringTable ); // 13
+	HANDLE_SvcMsg( VoiceInit );         // 14
+	HANDLE_SvcMsg( VoiceData );         // 15
+	HANDLE_SvcMsg( Print );             // 16
+	HANDLE_SvcMsg( Sounds );            // 17
+	HANDLE_SvcMsg( SetView );           // 18
+	HANDLE_SvcMsg( FixAngle );          // 19
+	HANDLE_SvcMsg( CrosshairAngle );    // 20
+	HANDLE_SvcMsg( BSPDecal );          // 21
+	HANDLE_SvcMsg( SplitScreen );       // 22
+	HANDLE_SvcMsg( UserMessage );       // 23
+	//$ HANDLE_SvcMsg( EntityMessage ); // 24
+	HANDLE_SvcMsg( GameEvent );         // 25 - This one might be the interesting one
+	HANDLE_SvcMsg( PacketEntities );    // 26
+	HANDLE_SvcMsg( TempEntities );      // 27
+	HANDLE_SvcMsg( Prefetch );          // 28
+	HANDLE_SvcMsg( Menu );              // 29
+	HANDLE_SvcMsg( GameEventList );     // 30
+	HANDLE_SvcMsg( GetCvarValue );      // 31
+
+#undef HANDLE_SvcMsg
+#undef HANDLE_NetMsg
+	}
+}
+
 /**
  * Demo packets apparently contain the other types of messages.
  */ 
@@ -304,62 +452,22 @@ void CDemoFileDump::DumpDemoPacket( const std::string& buf )
   //Just keep reading through until we run out of space for possible messages in the packet. They should add up precisely.
 	while( index < buf.size() )
 	{
-		int Cmd = ReadVarInt32( buf, index );
-		uint32 Size = ReadVarInt32( buf, index );
+		bool bError = false;
+		int Cmd = ReadVarInt32( buf, index, &bError );
+		uint32 Size = ReadVarInt32( buf, index, &bError );
     //Within a packet it appears that each message has it's type and then it's size
 
-		if( index + Size > buf.size() )
+		if( bError || Size > buf.size() - index )
 		{
 			const std::string& strName = GetNetMsgName( Cmd );
 
-			fatal_errorf( "buf.ReadBytes() failed. Cmd:%d '%s' \n", Cmd, strName.c_str() );
+			// The rest of the packet can't be trusted, but the frames after it are fine
+			fprintf( stderr, "WARNING. DumpDemoPacket(): buf.ReadBytes() failed. Cmd:%d '%s'\n", Cmd, strName.c_str() );
+			m_demofile.ReportError( DEMO_ERROR_BAD_PACKET );
+			return;
 		}//This is sensible error checking seeing that we won't read too far
 
-		switch( Cmd )
-		{
-#define HANDLE_NetMsg( _x )		case net_ ## _x: PrintNetMessage< CNETMsg_ ## _x, net_ ## _x >( *this, &buf[ index ], Size ); break
-#define HANDLE_SvcMsg( _x )		case svc_ ## _x: PrintNetMessage< CSVCMsg_ ## _x, svc_ ## _x >( *this, &buf[ index ], Size ); break
-
-		default:
-			printf( "WARNING. DumpUserMessage(): Unknown netmessage %d.\n", Cmd );
-			break;
-
-		HANDLE_NetMsg( NOP );            	// 0
-		HANDLE_NetMsg( Disconnect );        // 1
-		HANDLE_NetMsg( File );              // 2
-		HANDLE_NetMsg( SplitScreenUser );   // 3
-		HANDLE_NetMsg( Tick );              // 4
-		HANDLE_NetMsg( StringCmd );         // 5
-		HANDLE_NetMsg( SetConVar );         // 6
-		HANDLE_NetMsg( SignonState );       // 7
-		HANDLE_SvcMsg( ServerInfo );        // 8
-		HANDLE_SvcMsg( SendTable );         // 9
-		HANDLE_SvcMsg( ClassInfo );         // 10
-		HANDLE_SvcMsg( SetPause );          // 11
-		HANDLE_SvcMsg( CreateStringTable ); // 12
-		HANDLE_SvcMsg( UpdateStringTable ); // 13
-		HANDLE_SvcMsg( VoiceInit );         // 14
-		HANDLE_SvcMsg( VoiceData );         // 15
-		HANDLE_SvcMsg( Print );             // 16
-		HANDLE_SvcMsg( Sounds );            // 17
-		HANDLE_SvcMsg( SetView );           // 18
-		HANDLE_SvcMsg( FixAngle );          // 19
-		HANDLE_SvcMsg( CrosshairAngle );    // 20
-		HANDLE_SvcMsg( BSPDecal );          // 21
-		HANDLE_SvcMsg( SplitScreen );       // 22
-		HANDLE_SvcMsg( UserMessage );       // 23
-		//$ HANDLE_SvcMsg( EntityMessage ); // 24
-		HANDLE_SvcMsg( GameEvent );         // 25 - This one might be the interesting one
-		HANDLE_SvcMsg( PacketEntities );    // 26
-		HANDLE_SvcMsg( TempEntities );      // 27
-		HANDLE_SvcMsg( Prefetch );          // 28
-		HANDLE_SvcMsg( Menu );              // 29
-		HANDLE_SvcMsg( GameEventList );     // 30
-		HANDLE_SvcMsg( GetCvarValue );      // 31
-
-#undef HANDLE_SvcMsg
-#undef HANDLE_NetMsg
-		}
+		DumpNetMessage( Cmd, &buf[ index ], Size );
 
 		index += Size;
 	}
@@ -368,11 +476,11 @@ void CDemoFileDump::DumpDemoPacket( const std::string& buf )
 /**
  * Prints out a string table. The comment below is correct they are quite big.
  */ 
-static bool DumpDemoStringTable( CDemoFileDump& Demo, const CDemoStringTables& StringTables )
+static bool DumpDemoStringTable( CDemoFileDump& Demo, const StringTableList_t& StringTables )
 {
-	for( int i = 0; i < StringTables.tables().size(); i++ )
+	for( int i = 0; i < ( int )StringTables.size(); i++ )
 	{
-		const CDemoStringTables::table_t& Table = StringTables.tables( i );
+		const CDemoStringTables::table_t& Table = *StringTables[ i ];
 
 		printf( "#%d %s flags:0x%x (%d Items) %d bytes\n",
 			i, Table.table_name().c_str(), Table.table_flags(),
@@ -441,19 +549,21 @@ void CDemoFileDump::PrintDemoHeader( EDemoCommands DemoCommand, int tick, int si
  * @param tick The tick# this message occurs at
  * @param size a reference to pass back the size of the message as read
  * @param uncompressed_size a reference to pass back the size of the message after it was decompressed
+ * @return false if the message couldn't be read
  */ 
 template < class DEMCLASS >
-void PrintDemoMessage( CDemoFileDump& Demo, bool bCompressed, int tick, int& size, int& uncompressed_size )
+bool PrintDemoMessage( CDemoFileDump& Demo, bool bCompressed, int tick, int& size, int& uncompressed_size )
 {
 	DEMCLASS Msg;
 
-	if( Demo.m_demofile.ReadMessage( &Msg, bCompressed, &size, &uncompressed_size ) )
-	{
-		Demo.PrintDemoHeader( Msg.GetType(), tick, size, uncompressed_size );
+	if( !Demo.m_demofile.ReadMessage( &Msg, bCompressed, &size, &uncompressed_size ) )
+		return false;
 
-		Demo.MsgPrintf( Msg, size, "%s", Msg.DebugString().c_str() );
+	Demo.PrintDemoHeader( Msg.GetType(), tick, size, uncompressed_size );
+
+	Demo.MsgPrintf( Msg, size, "%s", Msg.DebugString().c_str() );
     //This will print the default string encoding produced by the protobuf implementation
-	}
+	return true;
 }
 
 
@@ -462,16 +572,77 @@ void PrintDemoMessage( CDemoFileDump& Demo, bool bCompressed, int tick, int& siz
  *
  */
 template <>
-void PrintDemoMessage<CDemoStringTables_t>( CDemoFileDump& Demo, bool bCompressed, int tick, int& size, int& uncompressed_size )
+bool PrintDemoMessage<CDemoStringTables_t>( CDemoFileDump& Demo, bool bCompressed, int tick, int& size, int& uncompressed_size )
 {
-	CDemoStringTables_t Msg;
+	const char *pData;
+	int DataSize;
+	StringTableList_t Tables;
+
+	if( !Demo.m_demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size, &uncompressed_size ) )
+		return false;
 
-	if( Demo.m_demofile.ReadMessage( &Msg, bCompressed, &size, &uncompressed_size ) )
+	if( !ParseStringTablesInterned( pData, DataSize, Tables ) )
 	{
-		Demo.PrintDemoHeader( Msg.GetType(), tick, size, uncompressed_size );
+		Demo.m_demofile.ReportError( DEMO_ERROR_PARSE );
+		return false;
+	}
 
-		DumpDemoStringTable( Demo, Msg );
+	Demo.PrintDemoHeader( DEM_StringTables, tick, size, uncompressed_size );
+
+	DumpDemoStringTable( Demo, Tables );
+	return true;
+}
+
+/**
+ * Same as the generic implementation but takes the message from the schema cache
+ */
+template < class PB_OBJECT_TYPE >
+bool PrintInternedDemoMessage( CDemoFileDump& Demo, EDemoCommands DemoCommand, bool bCompressed, int tick, int& size, int& uncompressed_size )
+{
+	const char *pData;
+	int DataSize;
+
+	if( !Demo.m_demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size, &uncompressed_size ) )
+		return false;
+
+	std::shared_ptr< const PB_OBJECT_TYPE > pMsg = CSchemaCache< PB_OBJECT_TYPE >::Intern( pData, DataSize );
+
+	if( !pMsg )
+	{
+		Demo.m_demofile.ReportError( DEMO_ERROR_PARSE );
+		return false;
 	}
+
+	Demo.PrintDemoHeader( DemoCommand, tick, size, uncompressed_size );
+
+	Demo.MsgPrintf( *pMsg, size, "%s", pMsg->DebugString().c_str() );
+	return true;
+}
+
+template <>
+bool PrintDemoMessage<CDemoSendTables_t>( CDemoFileDump& Demo, bool bCompressed, int tick, int& size, int& uncompressed_size )
+{
+	return PrintInternedDemoMessage< CDemoSendTables >( Demo, DEM_SendTables, bCompressed, tick, size, uncompressed_size );
+}
+
+template <>
+bool PrintDemoMessage<CDemoClassInfo_t>( CDemoFileDump& Demo, bool bCompressed, int tick, int& size, int& uncompressed_size )
+{
+	return PrintInternedDemoMessage< CDemoClassInfo >( Demo, DEM_ClassInfo, bCompressed, tick, size, uncompressed_size );
+}
+
+/**
+ * Adds the frame that was just read to the block index, if one is being built
+ */ 
+void CDemoFileDump::IndexFrame( size_t nFramePos, int tick, const std::string *pPacketData )
+{
+	if( !m_pBlockIndex )
+		return;
+
+	m_pBlockIndex->AddFrame( nFramePos, m_demofile.GetPos(), m_nFrameNumber, tick );
+
+	if( pPacketData )
+		m_pBlockIndex->AddPacket( pPacketData->data(), ( int )pPacketData->size() );
 }
 
 /**
@@ -481,21 +652,29 @@ void CDemoFileDump::DoDump()
 {
 	bool bStopReading = false;
 
-	for( m_nFrameNumber = 0; !bStopReading; m_nFrameNumber++ )
+	// Open() starts at frame 0, SeekToCheckpoint() somewhere later
+	for( ; !bStopReading; m_nFrameNumber++ )
 	{
 		int tick = 0;
 		int size = 0;
 		bool bCompressed;
 		int uncompressed_size = 0;
 
+		// Don't sit on output while waiting for the next frame to be written
+		if( m_demofile.IsFollowing() && !m_demofile.IsFrameAvailable() )
+			fflush( stdout );
+
 		if( m_demofile.IsDone() )
 			break;
 
+		size_t nFramePos = m_demofile.GetPos();
+		bool bFrameOk = false;
+
 		EDemoCommands DemoCommand = m_demofile.ReadMessageType( &tick, &bCompressed );
 
 		switch( DemoCommand )
 		{
-#define HANDLE_DemoMsg( _x )	case DEM_ ## _x: PrintDemoMessage< CDemo ## _x ## _t >( *this, bCompressed, tick, size, uncompressed_size ); break
+#define HANDLE_DemoMsg( _x )	case DEM_ ## _x: bFrameOk = PrintDemoMessage< CDemo ## _x ## _t >( *this, bCompressed, tick, size, uncompressed_size ); break
 //This Macro shows some of the handy things that can be done with the C preprocessor. The ## is used to concatenate the tokens to either side
 		HANDLE_DemoMsg( FileHeader );
 		HANDLE_DemoMsg( FileInfo );
@@ -514,17 +693,29 @@ void CDemoFileDump::DoDump()
     //Not sure what a FullPacket is yet other than it contains a bunch of strings.
 		case DEM_FullPacket:
 			{
-				CDemoFullPacket_t FullPacket;
+				const char *pData;
+				int DataSize;
+				StringTableList_t Tables;
+				CDemoPacket Packet;
 
-				if( m_demofile.ReadMessage( &FullPacket, bCompressed, &size, &uncompressed_size ) )
+				if( m_demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size, &uncompressed_size ) )
 				{
-					PrintDemoHeader( DemoCommand, tick, size, uncompressed_size );
-
-					// Spew the stringtable
-					DumpDemoStringTable( *this, FullPacket.string_table() );
-
-					// Ok, now the packet.
-					DumpDemoPacket( FullPacket.packet().data() );
+					if( ParseFullPacketInterned( pData, DataSize, Tables, Packet ) )
+					{
+						bFrameOk = true;
+						IndexFrame( nFramePos, tick, &Packet.data() );
+						PrintDemoHeader( DemoCommand, tick, size, uncompressed_size );
+
+						// Spew the stringtable
+						DumpDemoStringTable( *this, Tables );
+
+						// Ok, now the packet.
+						DumpDemoPacket( Packet.data() );
+					}
+					else
+					{
+						m_demofile.ReportError( DEMO_ERROR_PARSE );
+					}
 				}
 			}
 			break;
@@ -536,6 +727,8 @@ void CDemoFileDump::DoDump()
 
 				if( m_demofile.ReadMessage( &Packet, bCompressed, &size, &uncompressed_size ) )
 				{
+					bFrameOk = true;
+					IndexFrame( nFramePos, tick, &Packet.data() );
 					PrintDemoHeader( DemoCommand, tick, size, uncompressed_size );
 
 					DumpDemoPacket( Packet.data() );
@@ -545,10 +738,24 @@ void CDemoFileDump::DoDump()
 
 		default:
 		case DEM_Error:
-			bStopReading = true;
-			fatal_errorf( "Shouldn't ever get this demo command?!? %d\n", DemoCommand );
 			break;
 		}
+
+		// The packets were indexed above, together with their messages
+		if( bFrameOk && DemoCommand != DEM_Packet && DemoCommand != DEM_SignonPacket && DemoCommand != DEM_FullPacket )
+			IndexFrame( nFramePos, tick, NULL );
+
+		// Skip over whatever is broken and carry on with the next good frame
+		if( !bFrameOk )
+		{
+			fprintf( stderr, "WARNING. DoDump(): frame #%d at offset %zu: %s.\n", m_nFrameNumber,
+				nFramePos + sizeof( protodemoheader_t ), GetDemoErrorName( m_demofile.GetLastError() ) );
+
+			if( !m_demofile.Resync( nFramePos ) )
+				bStopReading = true;
+		}
 	}
+
+	m_demofile.PrintErrors();
 }
 
@@ -25,30 +25,40 @@
 #ifndef DEMOFILEDUMP_H
 #define DEMOFILEDUMP_H
 
+#include "demoblockindex.h"
 #include "demofile.h"
+#include "schemacache.h"
 
 #include "generated_proto/netmessages.pb.h"
 
 class CDemoFileDump
 {
 public:
-	CDemoFileDump() : m_nFrameNumber( 0 ) {}
+	CDemoFileDump() : m_nFrameNumber( 0 ), m_pBlockIndex( NULL ) {}
 	~CDemoFileDump() {}
 
-	bool Open( const char *filename ); 
+	bool Open( const char *filename, CDemoReadAhead *pReadAhead = NULL );
+	bool OpenFollow( const char *filename );
+	bool SeekToCheckpoint( const char *filename, int tick );
 	void DoDump();
 
+	// DoDump() also adds every frame it reads to the index, see CDemoBlockIndex::BeginBuild()
+	void SetBlockIndex( CDemoBlockIndex *pBlockIndex )	{ m_pBlockIndex = pBlockIndex; }
+
 public:
 	void DumpDemoPacket( const std::string& buf );
+	void DumpNetMessage( int Cmd, const char *pData, int Size );
 	void DumpUserMessage( const void *parseBuffer, int BufferSize );
 	void PrintDemoHeader( EDemoCommands DemoCommand, int tick, int size, int uncompressed_size );
 	void MsgPrintf( const ::google::protobuf::Message& msg, int size, const char *fmt, ... );
+	void IndexFrame( size_t nFramePos, int tick, const std::string *pPacketData );
 
 public:
 	CDemoFile m_demofile;
-	CSVCMsg_GameEventList m_GameEventList;
+	std::shared_ptr< const CGameEventSchema > m_pGameEventSchema;
 
 	int m_nFrameNumber;
+	CDemoBlockIndex *m_pBlockIndex;
 };
 
 #endif // DEMOFILEDUMP_H
@@ -0,0 +1,184 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include "demofileslice.h"
+
+/**
+ * Passes to CDemoFile.Open() and does minor error checking
+ */ 
+bool CDemoFileSlice::Open( const char *filename )
+{
+	if ( !m_demofile.Open( filename ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Copies the message following a frame header over to the writer byte for byte
+ */ 
+bool CDemoFileSlice::CopyFrame( EDemoCommands DemoCommand, int tick, bool bCompressed )
+{
+	const char *pBuffer;
+	int size;
+
+	if( !m_demofile.ReadRawMessage( &pBuffer, &size ) )
+		return false;
+
+	return m_writer.WriteRawMessage( DemoCommand, tick, bCompressed, pBuffer, size );
+}
+
+/**
+ * Reads the DEM_FileInfo that fileinfo_offset in the header points at
+ */ 
+bool CDemoFileSlice::ReadFileInfo( CDemoFileInfo_t& FileInfo )
+{
+	int tick;
+	bool bCompressed;
+
+	if( m_demofile.GetFileInfoOffset() < ( int32 )sizeof( protodemoheader_t ) )
+		return false;
+
+	m_demofile.SetPos( m_demofile.GetFileInfoOffset() - sizeof( protodemoheader_t ) );
+
+	if( m_demofile.ReadMessageType( &tick, &bCompressed ) != DEM_FileInfo )
+		return false;
+
+	return m_demofile.ReadMessage( &FileInfo, bCompressed );
+}
+
+/**
+ * Writes the signon frames, then everything from the last DEM_FullPacket at or before nStartTick
+ * up to and including nEndTick, then a DEM_Stop and a DEM_FileInfo describing the new range.
+ *
+ * The frames between the full packet and nStartTick are kept because packet entities are delta
+ * encoded against them, so the clip may start somewhat before nStartTick.
+ */ 
+bool CDemoFileSlice::Slice( const char *outname, int nStartTick, int nEndTick )
+{
+	CDemoFileInfo_t FileInfo;
+	bool bHaveFileInfo = ReadFileInfo( FileInfo );
+
+	if( !m_writer.Open( outname ) )
+		return false;
+
+	m_demofile.SetPos( 0 );
+
+	// Copy the signon frames and find the frame to start the clip at
+	size_t nKeyFramePos = 0;
+	bool bInSignon = true;
+
+	while( !m_demofile.IsDone() )
+	{
+		int tick = 0;
+		bool bCompressed;
+		size_t nFramePos = m_demofile.GetPos();
+
+		EDemoCommands DemoCommand = m_demofile.ReadMessageType( &tick, &bCompressed );
+
+		if( DemoCommand == DEM_Error || DemoCommand == DEM_Stop || DemoCommand == DEM_FileInfo )
+			break;
+
+		if( DemoCommand == DEM_Packet || DemoCommand == DEM_FullPacket )
+		{
+			if( bInSignon )
+			{
+				bInSignon = false;
+				nKeyFramePos = nFramePos;
+			}
+
+			if( tick > nStartTick )
+				break;
+
+			if( DemoCommand == DEM_FullPacket )
+				nKeyFramePos = nFramePos;
+		}
+
+		if( bInSignon )
+		{
+			if( !CopyFrame( DemoCommand, tick, bCompressed ) )
+				return false;
+		}
+		else if( !m_demofile.ReadRawMessage( NULL, NULL ) )
+		{
+			return false;
+		}
+	}
+
+	if( bInSignon )
+	{
+		fprintf( stderr, "CDemoFileSlice::Slice: no packets found.\n" );
+		m_writer.Close();
+		return false;
+	}
+
+	// Copy the clip itself
+	int nFirstTick = -1;
+	int nLastTick = 0;
+	int nFrames = 0;
+
+	m_demofile.SetPos( nKeyFramePos );
+
+	while( !m_demofile.IsDone() )
+	{
+		int tick = 0;
+		bool bCompressed;
+
+		EDemoCommands DemoCommand = m_demofile.ReadMessageType( &tick, &bCompressed );
+
+		if( DemoCommand == DEM_Error || DemoCommand == DEM_Stop || DemoCommand == DEM_FileInfo || tick > nEndTick )
+			break;
+
+		if( !CopyFrame( DemoCommand, tick, bCompressed ) )
+			return false;
+
+		if( nFirstTick < 0 )
+			nFirstTick = tick;
+		nLastTick = tick;
+		nFrames++;
+	}
+
+	CDemoStop_t Stop;
+
+	if( !m_writer.WriteMessage( &Stop, nLastTick, false ) )
+		return false;
+
+	// Describe the clip rather than the original match, but keep the game info
+	int nTicks = ( nFirstTick < 0 ) ? 0 : nLastTick - nFirstTick;
+	float flTickInterval = ( bHaveFileInfo && FileInfo.playback_ticks() > 0 ) ?
+		FileInfo.playback_time() / FileInfo.playback_ticks() : 1.0f / 30.0f;
+
+	FileInfo.set_playback_ticks( nTicks );
+	FileInfo.set_playback_frames( nFrames );
+	FileInfo.set_playback_time( nTicks * flTickInterval );
+
+	if( !m_writer.WriteFileInfo( &FileInfo, nLastTick ) )
+		return false;
+
+	return m_writer.Close();
+}
@@ -0,0 +1,52 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOFILESLICE_H
+#define DEMOFILESLICE_H
+
+#include "demofile.h"
+#include "demofilewriter.h"
+
+/**
+ * Cuts a tick range out of a demo into a new, smaller, valid demo without decompressing any frames
+ */ 
+class CDemoFileSlice
+{
+public:
+	CDemoFileSlice() {}
+	~CDemoFileSlice() {}
+
+	bool Open( const char *filename );
+	bool Slice( const char *outname, int nStartTick, int nEndTick );
+
+private:
+	bool CopyFrame( EDemoCommands DemoCommand, int tick, bool bCompressed );
+	bool ReadFileInfo( CDemoFileInfo_t& FileInfo );
+
+public:
+	CDemoFile m_demofile;
+	CDemoFileWriter m_writer;
+};
+
+#endif // DEMOFILESLICE_H
@@ -0,0 +1,193 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <string.h>
+#include "demofilewriter.h"
+#include "snappy.h"
+
+// Frames are collected in memory and handed to fwrite in chunks of at least this size
+#define DEMOFILEWRITER_FLUSH_SIZE	( 1024 * 1024 )
+
+/**
+ * Encodes a uint32 as a variable length integer, the inverse of ReadVarInt32
+ */ 
+void WriteVarInt32( std::string& buf, uint32 value )
+{
+	while( value >= 0x80 )
+	{
+		buf.push_back( ( char )( ( value & 0x7F ) | 0x80 ) );
+		value >>= 7;
+	}
+
+	buf.push_back( ( char )value );
+}
+
+CDemoFileWriter::CDemoFileWriter() :
+	m_fp( NULL ),
+	m_nFilePos( 0 ),
+	m_nFileInfoOffset( 0 )
+{
+}
+
+CDemoFileWriter::~CDemoFileWriter()
+{
+	Close();
+}
+
+/**
+ * Creates the file and reserves room for the header, which is patched in Close()
+ *
+ * @param name the name of the file to create
+ */ 
+bool CDemoFileWriter::Open( const char *name )
+{
+	Close();
+
+	m_fp = fopen( name, "wb" );
+	if( !m_fp )
+	{
+		fprintf( stderr, "CDemoFileWriter::Open: couldn't create file %s.\n", name );
+		return false;
+	}
+
+	protodemoheader_t DotaDemoHeader;
+
+	memset( &DotaDemoHeader, 0, sizeof( DotaDemoHeader ) );
+	m_writeBuffer.append( ( const char * )&DotaDemoHeader, sizeof( DotaDemoHeader ) );
+
+	m_nFilePos = sizeof( DotaDemoHeader );
+	m_szFileName = name;
+	return true;
+}
+
+/**
+ * Writes out whatever is still buffered
+ */ 
+bool CDemoFileWriter::Flush()
+{
+	if( m_writeBuffer.empty() )
+		return true;
+
+	bool bOk = fwrite( m_writeBuffer.data(), 1, m_writeBuffer.size(), m_fp ) == m_writeBuffer.size();
+	m_writeBuffer.clear();
+
+	if( !bOk )
+	{
+		fprintf( stderr, "CDemoFileWriter::Flush: write failed. %s.\n", m_szFileName.c_str() );
+	}
+	return bOk;
+}
+
+/**
+ * Writes a message that has already been encoded, e.g. one taken straight from CDemoFile::ReadRawMessage()
+ *
+ * @param Cmd the demo command of the message
+ * @param tick the tick the message belongs to
+ * @param bCompressed true if pBuffer holds snappy compressed data
+ */ 
+bool CDemoFileWriter::WriteRawMessage( EDemoCommands Cmd, int tick, bool bCompressed, const char *pBuffer, int size )
+{
+	if( !m_fp )
+		return false;
+
+	size_t nStart = m_writeBuffer.size();
+
+	WriteVarInt32( m_writeBuffer, bCompressed ? ( Cmd | DEM_IsCompressed ) : Cmd );
+	WriteVarInt32( m_writeBuffer, tick );
+	WriteVarInt32( m_writeBuffer, size );
+	m_writeBuffer.append( pBuffer, size );
+
+	m_nFilePos += m_writeBuffer.size() - nStart;
+
+	if( m_writeBuffer.size() >= DEMOFILEWRITER_FLUSH_SIZE )
+		return Flush();
+
+	return true;
+}
+
+/**
+ * Serializes a message and writes it, optionally snappy compressing it first
+ */ 
+bool CDemoFileWriter::WriteMessage( IDemoMessage *pMsg, int tick, bool bCompress )
+{
+	if( !pMsg->GetProtoMsg().SerializeToString( &m_serializeBuffer ) )
+		return false;
+
+	if( bCompress )
+	{
+		size_t nCompressedLen;
+
+		m_compressBuffer.resize( snappy::MaxCompressedLength( m_serializeBuffer.size() ) );
+		snappy::RawCompress( m_serializeBuffer.data(), m_serializeBuffer.size(), &m_compressBuffer[ 0 ], &nCompressedLen );
+
+		return WriteRawMessage( pMsg->GetType(), tick, true, m_compressBuffer.data(), nCompressedLen );
+	}
+
+	return WriteRawMessage( pMsg->GetType(), tick, false, m_serializeBuffer.data(), m_serializeBuffer.size() );
+}
+
+bool CDemoFileWriter::WriteFileInfo( CDemoFileInfo_t *pFileInfo, int tick )
+{
+	m_nFileInfoOffset = m_nFilePos;
+
+	return WriteMessage( pFileInfo, tick, false );
+}
+
+/**
+ * Flushes the file and patches fileinfo_offset into the header
+ *
+ * @return false if any of the writes failed
+ */ 
+bool CDemoFileWriter::Close()
+{
+	bool bOk = true;
+
+	if( m_fp )
+	{
+		protodemoheader_t DotaDemoHeader;
+
+		memset( &DotaDemoHeader, 0, sizeof( DotaDemoHeader ) );
+		strcpy( DotaDemoHeader.demofilestamp, PROTODEMO_HEADER_ID );
+		DotaDemoHeader.fileinfo_offset = m_nFileInfoOffset;
+
+		bOk = Flush();
+		bOk = bOk && fseek( m_fp, 0, SEEK_SET ) == 0;
+		bOk = bOk && fwrite( &DotaDemoHeader, 1, sizeof( DotaDemoHeader ), m_fp ) == sizeof( DotaDemoHeader );
+		bOk = ( fclose( m_fp ) == 0 ) && bOk;
+		m_fp = NULL;
+
+		if( !bOk )
+		{
+			fprintf( stderr, "CDemoFileWriter::Close: couldn't write %s.\n", m_szFileName.c_str() );
+		}
+	}
+
+	m_szFileName.clear();
+	m_nFilePos = 0;
+	m_nFileInfoOffset = 0;
+
+	m_writeBuffer.clear();
+	return bOk;
+}
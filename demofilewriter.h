@@ -0,0 +1,66 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOFILEWRITER_H
+#define DEMOFILEWRITER_H
+
+#include <stdio.h>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Demo file writer, the counterpart of CDemoFile
+//-----------------------------------------------------------------------------
+class CDemoFileWriter
+{
+public:
+	CDemoFileWriter();
+	~CDemoFileWriter();
+
+	bool	Open( const char *name );
+	bool	Close();
+
+	bool	WriteRawMessage( EDemoCommands Cmd, int tick, bool bCompressed, const char *pBuffer, int size );
+	bool	WriteMessage( IDemoMessage *pMsg, int tick, bool bCompress );
+
+	// Writes the trailing DEM_FileInfo and remembers where it went so Close() can patch the header
+	bool	WriteFileInfo( CDemoFileInfo_t *pFileInfo, int tick );
+
+private:
+	bool	Flush();
+
+	FILE *m_fp;
+	std::string m_szFileName;
+
+	// Offset of the next byte to be written, counted from the start of the file
+	size_t m_nFilePos;
+	int32 m_nFileInfoOffset;
+
+	std::string m_writeBuffer;
+	std::string m_serializeBuffer;
+	std::string m_compressBuffer;
+};
+
+void WriteVarInt32( std::string& buf, uint32 value );
+
+#endif // DEMOFILEWRITER_H
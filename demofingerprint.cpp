@@ -0,0 +1,257 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "demofingerprint.h"
+
+/**
+ * Reads the frame headers of the demo and hashes the signon frames and the sampled packets
+ * without decompressing them
+ */ 
+bool ComputeDemoFingerprint( const char *filename, int nStride, demo_fingerprint_t& Fingerprint )
+{
+	CDemoFile demofile;
+
+	Fingerprint.filename = filename;
+	Fingerprint.bOk = false;
+	Fingerprint.signon_hash = 0;
+	Fingerprint.key = 0;
+	Fingerprint.hash = 0;
+	Fingerprint.size = 0;
+	Fingerprint.num_frames = 0;
+	Fingerprint.last_tick = 0;
+	Fingerprint.samples.clear();
+
+	if( !demofile.Open( filename ) )
+		return false;
+
+	int nNextSampleTick = 0;
+
+	while( !demofile.IsDone() )
+	{
+		int tick = 0;
+		bool bCompressed;
+		size_t nFramePos = demofile.GetPos();
+		const char *pData;
+		int size;
+
+		EDemoCommands DemoCommand = demofile.ReadMessageType( &tick, &bCompressed );
+
+		if( DemoCommand == DEM_Error || !demofile.ReadRawMessage( &pData, &size ) )
+		{
+			if( !demofile.Resync( nFramePos ) )
+				break;
+			continue;
+		}
+
+		switch( DemoCommand )
+		{
+		case DEM_FileHeader:
+		case DEM_SendTables:
+		case DEM_ClassInfo:
+			Fingerprint.signon_hash = HashBytes64( pData, size, Fingerprint.signon_hash ^ DemoCommand );
+			break;
+
+		case DEM_Packet:
+			if( tick >= nNextSampleTick )
+			{
+				Fingerprint.samples.push_back( HashBytes64( pData, size, ( uint64 )( uint32 )tick ) );
+				nNextSampleTick = ( tick / nStride + 1 ) * nStride;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		Fingerprint.num_frames++;
+		Fingerprint.last_tick = std::max( Fingerprint.last_tick, tick );
+	}
+
+	Fingerprint.size = demofile.GetSize();
+
+	uint64 Counts[ 3 ] = { Fingerprint.size, ( uint64 )Fingerprint.num_frames, ( uint64 )Fingerprint.last_tick };
+
+	Fingerprint.key = Fingerprint.samples.empty() ? Fingerprint.signon_hash :
+		HashBytes64( &Fingerprint.samples[ 0 ], sizeof( uint64 ), Fingerprint.signon_hash );
+	Fingerprint.hash = HashBytes64( Fingerprint.samples.data(), Fingerprint.samples.size() * sizeof( uint64 ), Fingerprint.signon_hash );
+	Fingerprint.hash = HashBytes64( Counts, sizeof( Counts ), Fingerprint.hash );
+	Fingerprint.bOk = Fingerprint.num_frames > 0;
+	return Fingerprint.bOk;
+}
+
+void ComputeDemoFingerprints( int nFiles, char **ppFiles, int nStride, int nThreads, std::vector< demo_fingerprint_t >& Fingerprints )
+{
+	std::atomic< int > nNextFile( 0 );
+	std::vector< std::thread > threads;
+
+	if( nThreads <= 0 )
+		nThreads = std::max( 1u, std::thread::hardware_concurrency() );
+
+	Fingerprints.clear();
+	Fingerprints.resize( nFiles );
+
+	// Every file is a separate read, the threads mostly wait for the disk
+	for( int i = 0; i < std::min( nThreads, nFiles ); i++ )
+	{
+		threads.emplace_back( [&]
+		{
+			for( int nFile = nNextFile++; nFile < nFiles; nFile = nNextFile++ )
+				ComputeDemoFingerprint( ppFiles[ nFile ], nStride, Fingerprints[ nFile ] );
+		} );
+	}
+
+	for( size_t i = 0; i < threads.size(); i++ )
+		threads[ i ].join();
+}
+
+static bool IsSameDemo( const demo_fingerprint_t& a, const demo_fingerprint_t& b )
+{
+	return a.hash == b.hash && a.signon_hash == b.signon_hash && a.samples == b.samples &&
+		a.size == b.size && a.num_frames == b.num_frames && a.last_tick == b.last_tick;
+}
+
+/**
+ * Can a be b cut short, the samples of a have to start b and b has to be longer
+ */ 
+static bool IsPrefixOf( const demo_fingerprint_t& a, const demo_fingerprint_t& b )
+{
+	return a.signon_hash == b.signon_hash && a.samples.size() <= b.samples.size() &&
+		std::equal( a.samples.begin(), a.samples.end(), b.samples.begin() ) &&
+		a.num_frames < b.num_frames && a.size < b.size && a.last_tick <= b.last_tick;
+}
+
+/**
+ * Sorting by signon and then the samples puts every demo that starts with the samples of another one
+ * right after it, so the prefixes are found without comparing every pair
+ */ 
+void FindDemoFingerprintRelations( const std::vector< demo_fingerprint_t >& Fingerprints, std::vector< demo_fingerprint_relation_t >& Relations )
+{
+	std::vector< int > order;
+	std::vector< int > distinct;
+
+	Relations.clear();
+
+	for( size_t i = 0; i < Fingerprints.size(); i++ )
+	{
+		if( Fingerprints[ i ].bOk )
+			order.push_back( ( int )i );
+	}
+
+	std::sort( order.begin(), order.end(), [&Fingerprints]( int i, int j )
+	{
+		const demo_fingerprint_t& a = Fingerprints[ i ];
+		const demo_fingerprint_t& b = Fingerprints[ j ];
+
+		if( a.signon_hash != b.signon_hash )
+			return a.signon_hash < b.signon_hash;
+		if( a.samples != b.samples )
+			return a.samples < b.samples;
+		if( a.last_tick != b.last_tick )
+			return a.last_tick < b.last_tick;
+		if( a.num_frames != b.num_frames )
+			return a.num_frames < b.num_frames;
+		if( a.size != b.size )
+			return a.size < b.size;
+		return i < j;
+	} );
+
+	for( size_t i = 0; i < order.size(); i++ )
+	{
+		if( !distinct.empty() && IsSameDemo( Fingerprints[ distinct.back() ], Fingerprints[ order[ i ] ] ) )
+		{
+			demo_fingerprint_relation_t Relation = { order[ i ], distinct.back(), DEMOFINGERPRINT_DUPLICATE };
+			Relations.push_back( Relation );
+			continue;
+		}
+		distinct.push_back( order[ i ] );
+	}
+
+	for( size_t i = 0; i < distinct.size(); i++ )
+	{
+		const demo_fingerprint_t& a = Fingerprints[ distinct[ i ] ];
+
+		// Without a sample the signon is all there is, that's the same for many matches
+		if( a.samples.empty() )
+			continue;
+
+		// Everything that starts with the samples of a follows it
+		for( size_t j = i + 1; j < distinct.size(); j++ )
+		{
+			const demo_fingerprint_t& b = Fingerprints[ distinct[ j ] ];
+
+			if( b.signon_hash != a.signon_hash || b.samples.size() < a.samples.size() ||
+				!std::equal( a.samples.begin(), a.samples.end(), b.samples.begin() ) )
+				break;
+
+			if( IsPrefixOf( a, b ) )
+			{
+				demo_fingerprint_relation_t Relation = { distinct[ i ], distinct[ j ], DEMOFINGERPRINT_PREFIX };
+				Relations.push_back( Relation );
+			}
+		}
+	}
+}
+
+bool FingerprintDemos( int nFiles, char **ppFiles, int nStride, int nThreads )
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector< demo_fingerprint_t > Fingerprints;
+	std::vector< demo_fingerprint_relation_t > Relations;
+	bool bOk = true;
+
+	ComputeDemoFingerprints( nFiles, ppFiles, nStride, nThreads, Fingerprints );
+	FindDemoFingerprintRelations( Fingerprints, Relations );
+
+	for( size_t i = 0; i < Fingerprints.size(); i++ )
+	{
+		const demo_fingerprint_t& Fingerprint = Fingerprints[ i ];
+
+		if( !Fingerprint.bOk )
+		{
+			fprintf( stderr, "Couldn't fingerprint '%s'\n", Fingerprint.filename.c_str() );
+			bOk = false;
+			continue;
+		}
+
+		printf( "%016llx key:%016llx frames:%d last_tick:%d samples:%d %s\n", ( unsigned long long )Fingerprint.hash,
+			( unsigned long long )Fingerprint.key, Fingerprint.num_frames, Fingerprint.last_tick, ( int )Fingerprint.samples.size(),
+			Fingerprint.filename.c_str() );
+	}
+
+	for( size_t i = 0; i < Relations.size(); i++ )
+	{
+		printf( "%s %s %s\n", Relations[ i ].relation == DEMOFINGERPRINT_DUPLICATE ? "duplicate:" : "prefix:",
+			Fingerprints[ Relations[ i ].a ].filename.c_str(), Fingerprints[ Relations[ i ].b ].filename.c_str() );
+	}
+
+	double flSeconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+	fprintf( stderr, "%d files in %.2fs, %d relations.\n", nFiles, flSeconds, ( int )Relations.size() );
+	return bOk;
+}
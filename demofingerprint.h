@@ -0,0 +1,84 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#ifndef DEMOFINGERPRINT_H
+#define DEMOFINGERPRINT_H
+
+#include <string>
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Fingerprints for finding copies of the same demo in an archive. Nothing is
+// decompressed: the fingerprint hashes the DEM_FileHeader, DEM_SendTables
+// and DEM_ClassInfo frames and one DEM_Packet every so many ticks as they
+// are stored in the file.
+//
+// A demo that was cut short has the same signon and the first samples of
+// the complete one, so besides identical copies the fingerprints also tell
+// when one demo is a prefix of another.
+//-----------------------------------------------------------------------------
+
+#define DEMOFINGERPRINT_DEFAULT_STRIDE	3600		// ticks between samples, two minutes of game time
+
+struct demo_fingerprint_t
+{
+	std::string filename;
+	bool bOk;
+
+	uint64 signon_hash;				// of the signon frames
+	uint64 key;						// signon and first sample, the same for every copy of a match
+	uint64 hash;					// of everything, the same for identical copies
+	uint64 size;					// of the frame stream
+	int32 num_frames;
+	int32 last_tick;
+	std::vector< uint64 > samples;	// first DEM_Packet at or after every multiple of the stride, hashed with its tick
+};
+
+enum EDemoFingerprintRelation
+{
+	DEMOFINGERPRINT_DUPLICATE = 0,	// a is the same as b
+	DEMOFINGERPRINT_PREFIX,			// a is the start of b
+};
+
+struct demo_fingerprint_relation_t
+{
+	int a;
+	int b;
+	EDemoFingerprintRelation relation;
+};
+
+bool	ComputeDemoFingerprint( const char *filename, int nStride, demo_fingerprint_t& Fingerprint );
+
+// Fingerprints the files on nThreads threads, 0 is one per core. Fingerprints[ i ] is for ppFiles[ i ].
+void	ComputeDemoFingerprints( int nFiles, char **ppFiles, int nStride, int nThreads, std::vector< demo_fingerprint_t >& Fingerprints );
+
+// Duplicates are given against the first of them, prefixes once for every distinct pair
+void	FindDemoFingerprintRelations( const std::vector< demo_fingerprint_t >& Fingerprints, std::vector< demo_fingerprint_relation_t >& Relations );
+
+// The -fingerprint mode, prints the fingerprints and the relations between them
+bool	FingerprintDemos( int nFiles, char **ppFiles, int nStride, int nThreads );
+
+#endif // DEMOFINGERPRINT_H
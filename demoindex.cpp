@@ -0,0 +1,749 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include "demoindex.h"
+#include "schemacache.h"
+
+#define DEMOINDEX_ALIGN( x )	( ( ( x ) + 7 ) & ~( uint64 )7 )
+
+static const char *s_KeyNames[ DEMOINDEX_KEY_MAX ] = { "xuid", "hero", "player_hero", "match", "mode" };
+
+uint64 GetDemoIndexKeyHash( EDemoIndexKey type, uint64 value, const char *str, size_t length )
+{
+	switch( type )
+	{
+	case DEMOINDEX_KEY_HERO:
+		return HashBytes64( str, length );
+	case DEMOINDEX_KEY_PLAYER_HERO:
+		return HashBytes64( str, length, value );
+	default:
+		return value;
+	}
+}
+
+CDemoIndex::CDemoIndex() :
+	m_pData( NULL ),
+	m_nSize( 0 ),
+	m_pHeader( NULL ),
+	m_pFiles( NULL ),
+	m_pStrings( NULL ),
+	m_pPostings( NULL )
+{
+	memset( m_pKeys, 0, sizeof( m_pKeys ) );
+}
+
+CDemoIndex::~CDemoIndex()
+{
+	Close();
+}
+
+/**
+ * Is [offset, offset + count * elemsize) inside the file and aligned for the element type
+ */ 
+static bool IsSectionValid( size_t nFileSize, uint64 offset, uint64 count, size_t elemsize )
+{
+	if( offset & 7 )
+		return false;
+	if( offset > nFileSize || count > ( nFileSize - offset ) / elemsize )
+		return false;
+	return true;
+}
+
+bool CDemoIndex::Open( const char *filename )
+{
+	Close();
+
+	int fd = open( filename, O_RDONLY );
+	if( fd < 0 )
+	{
+		fprintf( stderr, "CDemoIndex::Open: couldn't open %s.\n", filename );
+		return false;
+	}
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || ( size_t )st.st_size < sizeof( demoindexheader_t ) )
+	{
+		fprintf( stderr, "CDemoIndex::Open: %s is not an index.\n", filename );
+		close( fd );
+		return false;
+	}
+
+	void *pData = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if( pData == MAP_FAILED )
+	{
+		fprintf( stderr, "CDemoIndex::Open: couldn't map %s.\n", filename );
+		return false;
+	}
+
+	m_pData = ( const char * )pData;
+	m_nSize = st.st_size;
+
+	const demoindexheader_t *pHeader = ( const demoindexheader_t * )m_pData;
+	bool bValid = !memcmp( pHeader->indexstamp, DEMOINDEX_HEADER_ID, sizeof( pHeader->indexstamp ) ) && pHeader->version == DEMOINDEX_VERSION;
+
+	bValid = bValid && IsSectionValid( m_nSize, pHeader->files_offset, pHeader->num_files, sizeof( demoindexfile_t ) );
+	bValid = bValid && IsSectionValid( m_nSize, pHeader->strings_offset, pHeader->strings_size, 1 );
+	bValid = bValid && IsSectionValid( m_nSize, pHeader->postings_offset, pHeader->num_postings, sizeof( uint32 ) );
+	for( int i = 0; i < DEMOINDEX_KEY_MAX; i++ )
+		bValid = bValid && IsSectionValid( m_nSize, pHeader->keys_offset[ i ], pHeader->num_keys[ i ], sizeof( demoindexkey_t ) );
+
+	if( !bValid )
+	{
+		fprintf( stderr, "CDemoIndex::Open: %s is not a version %d index.\n", filename, DEMOINDEX_VERSION );
+		Close();
+		return false;
+	}
+
+	m_pHeader = pHeader;
+	m_pFiles = ( const demoindexfile_t * )( m_pData + pHeader->files_offset );
+	m_pStrings = m_pData + pHeader->strings_offset;
+	m_pPostings = ( const uint32 * )( m_pData + pHeader->postings_offset );
+	for( int i = 0; i < DEMOINDEX_KEY_MAX; i++ )
+		m_pKeys[ i ] = ( const demoindexkey_t * )( m_pData + pHeader->keys_offset[ i ] );
+
+	return true;
+}
+
+void CDemoIndex::Close()
+{
+	if( m_pData )
+		munmap( ( void * )m_pData, m_nSize );
+
+	m_pData = NULL;
+	m_nSize = 0;
+	m_pHeader = NULL;
+	m_pFiles = NULL;
+	m_pStrings = NULL;
+	m_pPostings = NULL;
+	memset( m_pKeys, 0, sizeof( m_pKeys ) );
+}
+
+/**
+ * Strings are checked against the string section on every access, the keys themselves aren't validated by Open()
+ */ 
+static std::string GetIndexString( const char *pStrings, uint64 nStringsSize, uint64 offset, uint32 length )
+{
+	if( offset > nStringsSize || length > nStringsSize - offset )
+		return std::string();
+	return std::string( pStrings + offset, length );
+}
+
+std::string CDemoIndex::GetFileName( uint32 fileid ) const
+{
+	if( fileid >= GetFileCount() )
+		return std::string();
+	return GetIndexString( m_pStrings, m_pHeader->strings_size, m_pFiles[ fileid ].name_offset, m_pFiles[ fileid ].name_length );
+}
+
+std::string CDemoIndex::GetKeyString( const demoindexkey_t& Key ) const
+{
+	return GetIndexString( m_pStrings, m_pHeader->strings_size, Key.str_offset, Key.str_length );
+}
+
+bool CDemoIndex::Lookup( EDemoIndexKey type, uint64 value, const char *str, const uint32 **ppFileIds, uint32 *pCount ) const
+{
+	*ppFileIds = NULL;
+	*pCount = 0;
+
+	if( !m_pHeader )
+		return false;
+
+	size_t length = str ? strlen( str ) : 0;
+	uint64 key = GetDemoIndexKeyHash( type, value, str, length );
+	if( type != DEMOINDEX_KEY_PLAYER_HERO )
+		value = 0;
+
+	const demoindexkey_t *pBegin = m_pKeys[ type ];
+	const demoindexkey_t *pEnd = pBegin + m_pHeader->num_keys[ type ];
+	const demoindexkey_t *pKey = std::lower_bound( pBegin, pEnd, key,
+		[value]( const demoindexkey_t& Key, uint64 key ) { return Key.key < key || ( Key.key == key && Key.value < value ); } );
+
+	// Hash collisions sit next to each other, the string tells them apart
+	for( ; pKey != pEnd && pKey->key == key && pKey->value == value; pKey++ )
+	{
+		if( pKey->str_length != length )
+			continue;
+		if( pKey->str_offset > m_pHeader->strings_size || length > m_pHeader->strings_size - pKey->str_offset )
+			continue;
+		if( length && memcmp( m_pStrings + pKey->str_offset, str, length ) )
+			continue;
+		return GetPostings( *pKey, ppFileIds, pCount );
+	}
+
+	return false;
+}
+
+bool CDemoIndex::GetPostings( const demoindexkey_t& Key, const uint32 **ppFileIds, uint32 *pCount ) const
+{
+	if( Key.postings_start > m_pHeader->num_postings || Key.num_postings > m_pHeader->num_postings - Key.postings_start )
+	{
+		*ppFileIds = NULL;
+		*pCount = 0;
+		return false;
+	}
+
+	*ppFileIds = m_pPostings + Key.postings_start;
+	*pCount = Key.num_postings;
+	return true;
+}
+
+uint32 CDemoIndexBuilder::AddFile( const file_t& File )
+{
+	// A demo that is indexed again replaces what was known about it
+	std::unordered_map< std::string, uint32 >::iterator it = m_fileIds.find( File.name );
+	if( it != m_fileIds.end() )
+		m_files[ it->second ].bRemoved = true;
+
+	uint32 fileid = ( uint32 )m_files.size();
+	m_files.push_back( File );
+	m_fileIds[ File.name ] = fileid;
+	return fileid;
+}
+
+void CDemoIndexBuilder::AddKey( EDemoIndexKey type, uint64 value, const std::string& str, uint32 fileid )
+{
+	entry_t Entry;
+
+	Entry.type = type;
+	Entry.key = GetDemoIndexKeyHash( type, value, str.data(), str.size() );
+	Entry.value = ( type == DEMOINDEX_KEY_PLAYER_HERO ) ? value : 0;
+	Entry.fileid = fileid;
+
+	std::pair< std::unordered_map< std::string, uint32 >::iterator, bool > Inserted = m_stringIds.insert( std::make_pair( str, ( uint32 )m_strings.size() ) );
+	if( Inserted.second )
+		m_strings.push_back( str );
+	Entry.strid = Inserted.first->second;
+
+	m_entries.push_back( Entry );
+}
+
+/**
+ * Reads the players from the userinfo string table and the heroes from the file info. Every string table
+ * snapshot is looked at since players that connect late are missing from the early ones.
+ */ 
+bool CDemoIndexBuilder::AddDemo( const char *filename )
+{
+	CDemoFile demofile;
+
+	if( !demofile.Open( filename ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
+
+	std::map< std::string, uint64 > xuidByName;
+	CDemoFileInfo_t FileInfo;
+	bool bHaveFileInfo = false;
+
+	while( !demofile.IsDone() )
+	{
+		int tick = 0;
+		int size = 0;
+		bool bCompressed;
+		bool bFrameOk = false;
+		size_t nFramePos = demofile.GetPos();
+		StringTableList_t Tables;
+
+		EDemoCommands DemoCommand = demofile.ReadMessageType( &tick, &bCompressed );
+
+		switch( DemoCommand )
+		{
+		case DEM_FullPacket:
+		case DEM_StringTables:
+			{
+				const char *pData;
+				int DataSize;
+				CDemoPacket Packet;
+
+				if( demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size ) )
+				{
+					if( DemoCommand == DEM_FullPacket )
+						bFrameOk = ParseFullPacketInterned( pData, DataSize, Tables, Packet );
+					else
+						bFrameOk = ParseStringTablesInterned( pData, DataSize, Tables );
+
+					if( !bFrameOk )
+						demofile.ReportError( DEMO_ERROR_PARSE );
+				}
+			}
+			break;
+
+		case DEM_FileInfo:
+			bFrameOk = bHaveFileInfo = demofile.ReadMessage( &FileInfo, bCompressed, &size );
+			break;
+
+		case DEM_Error:
+			break;
+
+		default:
+			bFrameOk = demofile.ReadRawMessage( NULL, &size );
+			break;
+		}
+
+		if( !bFrameOk )
+		{
+			if( !demofile.Resync( nFramePos ) )
+				break;
+			continue;
+		}
+
+		for( size_t i = 0; i < Tables.size(); i++ )
+		{
+			const CDemoStringTables::table_t& Table = *Tables[ i ];
+
+			if( Table.table_name() != "userinfo" )
+				continue;
+
+			for( int j = 0; j < Table.items_size(); j++ )
+			{
+				const std::string& data = Table.items( j ).data();
+				player_info_t PlayerInfo;
+
+				if( data.size() != sizeof( player_info_t ) )
+					continue;
+
+				memcpy( &PlayerInfo, data.data(), sizeof( PlayerInfo ) );
+				if( !PlayerInfo.xuid || PlayerInfo.fakeplayer || PlayerInfo.ishltv )
+					continue;
+
+				PlayerInfo.name[ MAX_PLAYER_NAME_LENGTH - 1 ] = 0;
+				xuidByName[ PlayerInfo.name ] = PlayerInfo.xuid;
+			}
+		}
+	}
+
+	demofile.Close();
+
+	file_t File;
+	File.name = filename;
+	File.match_id = 0;
+	File.game_mode = 0;
+	File.game_winner = 0;
+	File.bRemoved = false;
+
+	const CGameInfo::CDotaGameInfo& DotaInfo = FileInfo.game_info().dota();
+	if( bHaveFileInfo )
+	{
+		File.match_id = DotaInfo.match_id();
+		File.game_mode = DotaInfo.game_mode();
+		File.game_winner = DotaInfo.game_winner();
+	}
+
+	uint32 fileid = AddFile( File );
+
+	if( bHaveFileInfo )
+	{
+		AddKey( DEMOINDEX_KEY_MATCH_ID, File.match_id, std::string(), fileid );
+		AddKey( DEMOINDEX_KEY_GAME_MODE, ( uint32 )File.game_mode, std::string(), fileid );
+	}
+
+	for( std::map< std::string, uint64 >::const_iterator it = xuidByName.begin(); it != xuidByName.end(); ++it )
+		AddKey( DEMOINDEX_KEY_XUID, it->second, std::string(), fileid );
+
+	for( int i = 0; i < DotaInfo.player_info_size(); i++ )
+	{
+		const CGameInfo::CDotaGameInfo::CPlayerInfo& Player = DotaInfo.player_info( i );
+
+		if( Player.hero_name().empty() )
+			continue;
+
+		AddKey( DEMOINDEX_KEY_HERO, 0, Player.hero_name(), fileid );
+
+		// userinfo names are cut off to fit player_info_t
+		std::map< std::string, uint64 >::const_iterator it = xuidByName.find( Player.player_name().substr( 0, MAX_PLAYER_NAME_LENGTH - 1 ) );
+		if( it != xuidByName.end() && !Player.is_fake_client() )
+			AddKey( DEMOINDEX_KEY_PLAYER_HERO, it->second, Player.hero_name(), fileid );
+	}
+
+	if( !bHaveFileInfo )
+		fprintf( stderr, "%s has no file info, only its players are indexed.\n", filename );
+
+	return true;
+}
+
+/**
+ * Copies everything in an existing index, its file ids are renumbered after the files already added
+ */ 
+bool CDemoIndexBuilder::AddIndex( const CDemoIndex& Index )
+{
+	std::vector< uint32 > fileIds( Index.GetFileCount() );
+
+	for( uint32 i = 0; i < Index.GetFileCount(); i++ )
+	{
+		const demoindexfile_t& IndexFile = Index.GetFile( i );
+		file_t File;
+
+		File.name = Index.GetFileName( i );
+		File.match_id = IndexFile.match_id;
+		File.game_mode = IndexFile.game_mode;
+		File.game_winner = IndexFile.game_winner;
+		File.bRemoved = false;
+
+		fileIds[ i ] = AddFile( File );
+	}
+
+	for( int type = 0; type < DEMOINDEX_KEY_MAX; type++ )
+	{
+		for( uint64 i = 0; i < Index.GetKeyCount( ( EDemoIndexKey )type ); i++ )
+		{
+			const demoindexkey_t& Key = Index.GetKey( ( EDemoIndexKey )type, i );
+			const uint32 *pFileIds;
+			uint32 nCount;
+			std::string str = Index.GetKeyString( Key );
+
+			if( !Index.GetPostings( Key, &pFileIds, &nCount ) )
+			{
+				fprintf( stderr, "CDemoIndexBuilder::AddIndex: index is corrupt.\n" );
+				return false;
+			}
+
+			for( uint32 j = 0; j < nCount; j++ )
+			{
+				if( pFileIds[ j ] < fileIds.size() )
+					AddKey( ( EDemoIndexKey )type, type == DEMOINDEX_KEY_PLAYER_HERO ? Key.value : Key.key, str, fileIds[ pFileIds[ j ] ] );
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Writes the index to a temporary file that is then renamed over filename, so readers that have
+ * the old index mapped keep a consistent view of it.
+ */ 
+bool CDemoIndexBuilder::Write( const char *filename )
+{
+	// Drop the demos that were indexed again and close the gaps they leave in the file ids
+	std::vector< uint32 > fileIds( m_files.size() );
+	uint32 nFiles = 0;
+
+	for( size_t i = 0; i < m_files.size(); i++ )
+		fileIds[ i ] = m_files[ i ].bRemoved ? ( uint32 )-1 : nFiles++;
+
+	std::vector< entry_t > entries;
+	entries.reserve( m_entries.size() );
+	for( size_t i = 0; i < m_entries.size(); i++ )
+	{
+		if( fileIds[ m_entries[ i ].fileid ] == ( uint32 )-1 )
+			continue;
+
+		entries.push_back( m_entries[ i ] );
+		entries.back().fileid = fileIds[ m_entries[ i ].fileid ];
+	}
+
+	std::sort( entries.begin(), entries.end(), []( const entry_t& a, const entry_t& b )
+	{
+		if( a.type != b.type )
+			return a.type < b.type;
+		if( a.key != b.key )
+			return a.key < b.key;
+		if( a.value != b.value )
+			return a.value < b.value;
+		if( a.strid != b.strid )
+			return a.strid < b.strid;
+		return a.fileid < b.fileid;
+	} );
+
+	// Strings: the file names, then each key string once
+	std::string strings;
+	std::vector< demoindexfile_t > files;
+	files.reserve( nFiles );
+
+	for( size_t i = 0; i < m_files.size(); i++ )
+	{
+		if( m_files[ i ].bRemoved )
+			continue;
+
+		demoindexfile_t File;
+		memset( &File, 0, sizeof( File ) );
+		File.name_offset = strings.size();
+		File.name_length = ( uint32 )m_files[ i ].name.size();
+		File.match_id = m_files[ i ].match_id;
+		File.game_mode = m_files[ i ].game_mode;
+		File.game_winner = m_files[ i ].game_winner;
+		files.push_back( File );
+
+		strings += m_files[ i ].name;
+	}
+
+	std::vector< uint64 > stringOffsets( m_strings.size(), ( uint64 )-1 );
+	std::vector< demoindexkey_t > keys[ DEMOINDEX_KEY_MAX ];
+	std::vector< uint32 > postings;
+	postings.reserve( entries.size() );
+
+	for( size_t i = 0; i < entries.size(); i++ )
+	{
+		const entry_t& Entry = entries[ i ];
+
+		if( i && Entry.type == entries[ i - 1 ].type && Entry.key == entries[ i - 1 ].key &&
+			Entry.value == entries[ i - 1 ].value && Entry.strid == entries[ i - 1 ].strid )
+		{
+			// Same key, the demo may have been listed several times
+			if( Entry.fileid != postings.back() )
+			{
+				postings.push_back( Entry.fileid );
+				keys[ Entry.type ].back().num_postings++;
+			}
+			continue;
+		}
+
+		if( stringOffsets[ Entry.strid ] == ( uint64 )-1 )
+		{
+			stringOffsets[ Entry.strid ] = strings.size();
+			strings += m_strings[ Entry.strid ];
+		}
+
+		demoindexkey_t Key;
+		memset( &Key, 0, sizeof( Key ) );
+		Key.key = Entry.key;
+		Key.value = Entry.value;
+		Key.str_offset = stringOffsets[ Entry.strid ];
+		Key.str_length = ( uint32 )m_strings[ Entry.strid ].size();
+		Key.postings_start = postings.size();
+		Key.num_postings = 1;
+		keys[ Entry.type ].push_back( Key );
+
+		postings.push_back( Entry.fileid );
+	}
+
+	// Lay the sections out after the header, each 8 byte aligned
+	demoindexheader_t Header;
+	memset( &Header, 0, sizeof( Header ) );
+	memcpy( Header.indexstamp, DEMOINDEX_HEADER_ID, sizeof( Header.indexstamp ) );
+	Header.version = DEMOINDEX_VERSION;
+	Header.num_files = nFiles;
+
+	uint64 offset = DEMOINDEX_ALIGN( sizeof( Header ) );
+	Header.files_offset = offset;
+	offset = DEMOINDEX_ALIGN( offset + files.size() * sizeof( demoindexfile_t ) );
+	for( int i = 0; i < DEMOINDEX_KEY_MAX; i++ )
+	{
+		Header.keys_offset[ i ] = offset;
+		Header.num_keys[ i ] = keys[ i ].size();
+		offset = DEMOINDEX_ALIGN( offset + keys[ i ].size() * sizeof( demoindexkey_t ) );
+	}
+	Header.postings_offset = offset;
+	Header.num_postings = postings.size();
+	offset = DEMOINDEX_ALIGN( offset + postings.size() * sizeof( uint32 ) );
+	Header.strings_offset = offset;
+	Header.strings_size = strings.size();
+
+	std::string tmpname = std::string( filename ) + ".tmp";
+	FILE *fp = fopen( tmpname.c_str(), "wb" );
+	if( !fp )
+	{
+		fprintf( stderr, "CDemoIndexBuilder::Write: couldn't open %s.\n", tmpname.c_str() );
+		return false;
+	}
+
+	static const char s_Padding[ 8 ] = { 0 };
+	uint64 pos = 0;
+	bool bOk = true;
+
+	auto WriteSection = [&]( uint64 start, const void *pData, size_t size )
+	{
+		bOk = bOk && fwrite( s_Padding, 1, start - pos, fp ) == start - pos;
+		bOk = bOk && ( !size || fwrite( pData, 1, size, fp ) == size );
+		pos = start + size;
+	};
+
+	WriteSection( 0, &Header, sizeof( Header ) );
+	WriteSection( Header.files_offset, files.data(), files.size() * sizeof( demoindexfile_t ) );
+	for( int i = 0; i < DEMOINDEX_KEY_MAX; i++ )
+		WriteSection( Header.keys_offset[ i ], keys[ i ].data(), keys[ i ].size() * sizeof( demoindexkey_t ) );
+	WriteSection( Header.postings_offset, postings.data(), postings.size() * sizeof( uint32 ) );
+	WriteSection( Header.strings_offset, strings.data(), strings.size() );
+
+	bOk = ( fclose( fp ) == 0 ) && bOk;
+
+	if( !bOk || rename( tmpname.c_str(), filename ) != 0 )
+	{
+		fprintf( stderr, "CDemoIndexBuilder::Write: couldn't write %s.\n", filename );
+		remove( tmpname.c_str() );
+		return false;
+	}
+
+	uint64 nKeys = 0;
+	for( int i = 0; i < DEMOINDEX_KEY_MAX; i++ )
+		nKeys += Header.num_keys[ i ];
+
+	fprintf( stderr, "Indexed %u demos, %llu keys, %zu postings.\n", nFiles, ( unsigned long long )nKeys, postings.size() );
+	return true;
+}
+
+/**
+ * -index: merges the existing indexes and the demos into outname
+ */ 
+bool BuildDemoIndex( const char *outname, int nIndexes, char **ppIndexes, int nFiles, char **ppFiles )
+{
+	CDemoIndexBuilder Builder;
+
+	for( int i = 0; i < nIndexes; i++ )
+	{
+		CDemoIndex Index;
+
+		if( !Index.Open( ppIndexes[ i ] ) || !Builder.AddIndex( Index ) )
+			return false;
+	}
+
+	for( int i = 0; i < nFiles; i++ )
+		Builder.AddDemo( ppFiles[ i ] );
+
+	return Builder.Write( outname );
+}
+
+/**
+ * -query: prints the demos that match all of the name=value terms
+ */ 
+bool QueryDemoIndex( const char *indexname, int nTerms, char **ppTerms )
+{
+	CDemoIndex Index;
+
+	if( !Index.Open( indexname ) )
+		return false;
+
+	const char *pHero = NULL;
+	bool bHaveXuid = false;
+	uint64 xuid = 0;
+	std::vector< std::pair< EDemoIndexKey, uint64 > > terms;
+
+	for( int i = 0; i < nTerms; i++ )
+	{
+		const char *pValue = strchr( ppTerms[ i ], '=' );
+		int type = DEMOINDEX_KEY_MAX;
+
+		if( pValue )
+		{
+			for( type = 0; type < DEMOINDEX_KEY_MAX; type++ )
+			{
+				if( type != DEMOINDEX_KEY_PLAYER_HERO && strlen( s_KeyNames[ type ] ) == ( size_t )( pValue - ppTerms[ i ] ) &&
+					!strncmp( ppTerms[ i ], s_KeyNames[ type ], pValue - ppTerms[ i ] ) )
+					break;
+			}
+			pValue++;
+		}
+
+		if( type == DEMOINDEX_KEY_MAX )
+		{
+			fprintf( stderr, "Unknown query term '%s', expected xuid=, hero=, match= or mode=.\n", ppTerms[ i ] );
+			return false;
+		}
+
+		if( type == DEMOINDEX_KEY_HERO )
+			pHero = pValue;
+		else if( type == DEMOINDEX_KEY_XUID )
+		{
+			bHaveXuid = true;
+			xuid = strtoull( pValue, NULL, 10 );
+		}
+		else if( type == DEMOINDEX_KEY_GAME_MODE )
+			terms.push_back( std::make_pair( ( EDemoIndexKey )type, ( uint64 )( uint32 )atoi( pValue ) ) );
+		else
+			terms.push_back( std::make_pair( ( EDemoIndexKey )type, strtoull( pValue, NULL, 10 ) ) );
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// A player on a hero has its own key, the two lists on their own would also match games
+	// where the player was on another hero and someone else was on this one
+	std::vector< std::pair< const uint32 *, uint32 > > lists;
+	bool bFound = true;
+
+	for( size_t i = 0; i <= terms.size(); i++ )
+	{
+		const uint32 *pFileIds = NULL;
+		uint32 nCount = 0;
+
+		if( i < terms.size() )
+			bFound = bFound && Index.Lookup( terms[ i ].first, terms[ i ].second, NULL, &pFileIds, &nCount );
+		else if( bHaveXuid && pHero )
+			bFound = bFound && Index.Lookup( DEMOINDEX_KEY_PLAYER_HERO, xuid, pHero, &pFileIds, &nCount );
+		else if( bHaveXuid )
+			bFound = bFound && Index.Lookup( DEMOINDEX_KEY_XUID, xuid, NULL, &pFileIds, &nCount );
+		else if( pHero )
+			bFound = bFound && Index.Lookup( DEMOINDEX_KEY_HERO, 0, pHero, &pFileIds, &nCount );
+		else
+			continue;
+
+		lists.push_back( std::make_pair( pFileIds, nCount ) );
+	}
+
+	// Intersect starting with the shortest list, no terms matches everything
+	std::vector< uint32 > result;
+	if( bFound && lists.empty() )
+	{
+		for( uint32 i = 0; i < Index.GetFileCount(); i++ )
+			result.push_back( i );
+	}
+	else if( bFound )
+	{
+		std::sort( lists.begin(), lists.end(), []( const std::pair< const uint32 *, uint32 >& a, const std::pair< const uint32 *, uint32 >& b ) { return a.second < b.second; } );
+
+		result.assign( lists[ 0 ].first, lists[ 0 ].first + lists[ 0 ].second );
+		for( size_t i = 1; i < lists.size() && !result.empty(); i++ )
+		{
+			std::vector< uint32 > next;
+			const uint32 *pFileIds = lists[ i ].first;
+			const uint32 *pEnd = pFileIds + lists[ i ].second;
+
+			for( size_t j = 0; j < result.size(); j++ )
+			{
+				pFileIds = std::lower_bound( pFileIds, pEnd, result[ j ] );
+				if( pFileIds == pEnd )
+					break;
+				if( *pFileIds == result[ j ] )
+					next.push_back( result[ j ] );
+			}
+			result.swap( next );
+		}
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	for( size_t i = 0; i < result.size(); i++ )
+	{
+		if( result[ i ] >= Index.GetFileCount() )
+			continue;
+
+		const demoindexfile_t& File = Index.GetFile( result[ i ] );
+		printf( "%s\tmatch %u\tgame_mode %d\n", Index.GetFileName( result[ i ] ).c_str(), File.match_id, File.game_mode );
+	}
+
+	fprintf( stderr, "%zu of %u demos match, lookup took %.1f us.\n", result.size(), Index.GetFileCount(),
+		std::chrono::duration< double, std::micro >( end - start ).count() );
+	return true;
+}
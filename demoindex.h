@@ -0,0 +1,180 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOINDEX_H
+#define DEMOINDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Index over a corpus of demos, answering "which demos have player X on hero
+// Y in game mode Z" without opening any of them.
+//
+// The index is a single immutable file made to be mmap()ed: a table of the
+// indexed demos, then for each kind of key a sorted array of keys, each
+// pointing at a sorted posting list of file ids. Lookups are a binary search.
+// New demos are added by merging them with an existing index into a new
+// file, which then replaces the old one.
+//
+// Players come from the userinfo string table (player_info_t) and heroes
+// from CDemoFileInfo. The two only share the player name, so that is what
+// ties a player to their hero.
+//-----------------------------------------------------------------------------
+
+#define DEMOINDEX_HEADER_ID		"DEMOIDX"
+#define DEMOINDEX_VERSION		1
+
+enum EDemoIndexKey
+{
+	DEMOINDEX_KEY_XUID = 0,
+	DEMOINDEX_KEY_HERO,				// hero_name
+	DEMOINDEX_KEY_PLAYER_HERO,		// xuid playing hero_name
+	DEMOINDEX_KEY_MATCH_ID,
+	DEMOINDEX_KEY_GAME_MODE,
+
+	DEMOINDEX_KEY_MAX
+};
+
+struct demoindexheader_t
+{
+	char indexstamp[ 8 ];	// DEMOINDEX_HEADER_ID
+	int32 version;
+	uint32 num_files;
+	uint64 files_offset;							// demoindexfile_t[ num_files ]
+	uint64 strings_offset;
+	uint64 strings_size;
+	uint64 postings_offset;						// uint32 file ids
+	uint64 num_postings;
+	uint64 keys_offset[ DEMOINDEX_KEY_MAX ];		// demoindexkey_t[ num_keys ], sorted
+	uint64 num_keys[ DEMOINDEX_KEY_MAX ];
+};
+
+struct demoindexfile_t
+{
+	uint64 name_offset;		// into the strings
+	uint32 name_length;
+	uint32 match_id;
+	int32 game_mode;
+	int32 game_winner;
+};
+
+struct demoindexkey_t
+{
+	uint64 key;				// the value itself, or a hash for the keys with a string
+	uint64 value;			// xuid for DEMOINDEX_KEY_PLAYER_HERO
+	uint64 str_offset;
+	uint32 str_length;
+	uint32 num_postings;
+	uint64 postings_start;	// index into the postings
+};
+
+/**
+ * Read only view of an index file
+ */ 
+class CDemoIndex
+{
+public:
+	CDemoIndex();
+	~CDemoIndex();
+
+	bool	Open( const char *filename );
+	void	Close();
+
+	uint32	GetFileCount() const					{ return m_pHeader ? m_pHeader->num_files : 0; }
+	const demoindexfile_t& GetFile( uint32 fileid ) const	{ return m_pFiles[ fileid ]; }
+	std::string GetFileName( uint32 fileid ) const;
+	std::string GetKeyString( const demoindexkey_t& Key ) const;
+
+	uint64	GetKeyCount( EDemoIndexKey type ) const	{ return m_pHeader ? m_pHeader->num_keys[ type ] : 0; }
+	const demoindexkey_t& GetKey( EDemoIndexKey type, uint64 i ) const	{ return m_pKeys[ type ][ i ]; }
+	bool	GetPostings( const demoindexkey_t& Key, const uint32 **ppFileIds, uint32 *pCount ) const;
+
+	// Sorted file ids for a key, false if the key isn't in the index. str is the hero name for the
+	// hero keys, value the xuid for DEMOINDEX_KEY_PLAYER_HERO and the key itself for the others.
+	bool	Lookup( EDemoIndexKey type, uint64 value, const char *str, const uint32 **ppFileIds, uint32 *pCount ) const;
+
+private:
+	const char *m_pData;
+	size_t m_nSize;
+	const demoindexheader_t *m_pHeader;
+	const demoindexfile_t *m_pFiles;
+	const char *m_pStrings;
+	const uint32 *m_pPostings;
+	const demoindexkey_t *m_pKeys[ DEMOINDEX_KEY_MAX ];
+};
+
+/**
+ * Collects demos, and the contents of existing indexes, into a new index file
+ */ 
+class CDemoIndexBuilder
+{
+public:
+	CDemoIndexBuilder() {}
+	~CDemoIndexBuilder() {}
+
+	bool	AddDemo( const char *filename );
+	bool	AddIndex( const CDemoIndex& Index );
+	bool	Write( const char *filename );
+
+private:
+	struct file_t
+	{
+		std::string name;
+		uint32 match_id;
+		int32 game_mode;
+		int32 game_winner;
+		bool bRemoved;
+	};
+
+	struct entry_t
+	{
+		EDemoIndexKey type;
+		uint64 key;
+		uint64 value;
+		uint32 strid;			// into m_strings
+		uint32 fileid;
+	};
+
+	uint32	AddFile( const file_t& File );
+	void	AddKey( EDemoIndexKey type, uint64 value, const std::string& str, uint32 fileid );
+
+	std::vector< file_t > m_files;
+	std::unordered_map< std::string, uint32 > m_fileIds;
+	std::vector< entry_t > m_entries;
+
+	// Key strings are stored once, there are only so many heroes
+	std::vector< std::string > m_strings;
+	std::unordered_map< std::string, uint32 > m_stringIds;
+};
+
+uint64	GetDemoIndexKeyHash( EDemoIndexKey type, uint64 value, const char *str, size_t length );
+
+// The command line modes
+bool	BuildDemoIndex( const char *outname, int nIndexes, char **ppIndexes, int nFiles, char **ppFiles );
+bool	QueryDemoIndex( const char *indexname, int nTerms, char **ppTerms );
+
+#endif // DEMOINDEX_H
@@ -23,7 +23,43 @@
 //===========================================================================//
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "demoarchive.h"
+#include "demoblockindex.h"
+#include "democheckpoint.h"
+#include "demodaemon.h"
 #include "demofiledump.h"
+#include "demofileslice.h"
+#include "demofingerprint.h"
+#include "demoindex.h"
+#include "demomodifiers.h"
+#include "demoparticles.h"
+#include "demoreadahead.h"
+#include "demovoice.h"
+#include "flatverify.h"
+
+static void PrintUsage()
+{
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] [-readahead|-readahead-threads <files ahead>] filename.dem...\n" );
+	printf( "demoinfo2_public.exe -follow filename.dem\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -slice <start tick> <end tick> <out.dem> filename.dem\n" );
+	printf( "demoinfo2_public.exe -traindict <out.dict> filename.dem...\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -transcode [-level <n>] <out.dema> filename.dem\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -verifyflat filename.dem...\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -index <out.idx> [-merge <old.idx>]... filename.dem...\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -checkpoint [-interval <ticks>] filename.dem...\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -seek <tick> filename.dem\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -blockindex [-dump] filename.dem...\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -find filename.dem [msg=<id|name>] [um=<id|name>] [event=<id|name>]...\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -modifiers filename.dem [<parent> <tick>]\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -particles filename.dem\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -fingerprint [-stride <ticks>] [-threads <n>] filename.dem...\n" );
+	printf( "demoinfo2_public.exe -query <index.idx> [xuid=<n>] [hero=<hero_name>] [match=<n>] [mode=<n>]\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -daemon <socket> [-workers <n>] [-cache <replays>]\n" );
+	printf( "demoinfo2_public.exe [-dict <archive.dict>] -voice <out.voice> filename.dem\n" );
+	printf( "demoinfo2_public.exe -voicetrack <in.voice> [<xuid> <out.raw>]\n" );
+}
 
 /**
  * Wrapper around DemoFileDump.DoDump()
@@ -31,17 +67,340 @@
  */ 
 int main( int argc, char *argv[] )
 {
+	// Declared first, the dump's CDemoFile hands its file back to it when it closes
+	CDemoReadAhead ReadAhead;
 	CDemoFileDump DemoFileDump;
 
 	if( argc <= 1 )
 	{
-		printf( "demoinfo2_public.exe filename.dem\n" );
+		PrintUsage();
 		exit( 0 );
 	}
 
-	if( DemoFileDump.Open( argv[ 1 ] ) )
+	if( !strcmp( argv[ 1 ], "-dict" ) )
+	{
+		if( argc <= 3 || !LoadDemoArchiveDictionary( argv[ 2 ] ) )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	if( !strcmp( argv[ 1 ], "-traindict" ) )
+	{
+		if( argc <= 3 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return TrainDemoArchiveDictionary( argv[ 2 ], argc - 3, argv + 3 ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-transcode" ) )
+	{
+		int level = DEMOARCHIVE_DEFAULT_LEVEL;
+
+		if( argc == 6 && !strcmp( argv[ 2 ], "-level" ) )
+		{
+			level = atoi( argv[ 3 ] );
+			argc -= 2;
+			argv += 2;
+		}
+
+		if( argc != 4 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return TranscodeDemoToArchive( argv[ 3 ], argv[ 2 ], level ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-verifyflat" ) )
+	{
+		if( argc <= 2 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return VerifyFlatDecoders( argc - 2, argv + 2 ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-index" ) )
+	{
+		if( argc <= 2 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		// The existing indexes to merge come first, each after a -merge
+		std::vector< char * > indexes;
+		int i = 3;
+
+		for( ; i + 1 < argc && !strcmp( argv[ i ], "-merge" ); i += 2 )
+			indexes.push_back( argv[ i + 1 ] );
+
+		return BuildDemoIndex( argv[ 2 ], ( int )indexes.size(), indexes.data(), argc - i, argv + i ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-query" ) )
+	{
+		if( argc <= 2 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return QueryDemoIndex( argv[ 2 ], argc - 3, argv + 3 ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-daemon" ) )
+	{
+		int nWorkers = 0;
+		int nCacheSize = DEMODAEMON_DEFAULT_CACHE_SIZE;
+
+		if( argc <= 2 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		for( int i = 3; i + 1 < argc; i += 2 )
+		{
+			if( !strcmp( argv[ i ], "-workers" ) )
+				nWorkers = atoi( argv[ i + 1 ] );
+			else if( !strcmp( argv[ i ], "-cache" ) )
+				nCacheSize = atoi( argv[ i + 1 ] );
+		}
+
+		CDemoDaemon Daemon;
+		return Daemon.Run( argv[ 2 ], nWorkers, nCacheSize ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-voice" ) )
+	{
+		if( argc != 4 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return ExtractDemoVoice( argv[ 3 ], argv[ 2 ] ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-voicetrack" ) )
+	{
+		if( argc != 3 && argc != 5 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return DumpDemoVoiceTrack( argv[ 2 ], argc == 5 ? argv[ 3 ] : NULL, argc == 5 ? argv[ 4 ] : NULL ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-fingerprint" ) )
+	{
+		int nStride = DEMOFINGERPRINT_DEFAULT_STRIDE;
+		int nThreads = 0;
+
+		while( argc >= 4 && ( !strcmp( argv[ 2 ], "-stride" ) || !strcmp( argv[ 2 ], "-threads" ) ) )
+		{
+			if( !strcmp( argv[ 2 ], "-stride" ) )
+				nStride = atoi( argv[ 3 ] );
+			else
+				nThreads = atoi( argv[ 3 ] );
+			argc -= 2;
+			argv += 2;
+		}
+
+		if( argc <= 2 || nStride <= 0 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return FingerprintDemos( argc - 2, argv + 2, nStride, nThreads ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-checkpoint" ) )
+	{
+		int nInterval = DEMOCHECKPOINT_DEFAULT_INTERVAL;
+
+		if( argc >= 4 && !strcmp( argv[ 2 ], "-interval" ) )
+		{
+			nInterval = atoi( argv[ 3 ] );
+			argc -= 2;
+			argv += 2;
+		}
+
+		if( argc <= 2 || nInterval <= 0 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		bool bOk = true;
+		for( int i = 2; i < argc; i++ )
+		{
+			CDemoCheckpoints Checkpoints;
+			bOk = Checkpoints.Build( argv[ i ], nInterval ) && bOk;
+		}
+		return bOk ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-seek" ) )
+	{
+		if( argc != 4 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		if( DemoFileDump.Open( argv[ 3 ] ) && DemoFileDump.SeekToCheckpoint( argv[ 3 ], atoi( argv[ 2 ] ) ) )
+		{
+			DemoFileDump.DoDump();
+			return 0;
+		}
+		return 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-blockindex" ) )
+	{
+		if( argc <= 2 || ( argc == 3 && !strcmp( argv[ 2 ], "-dump" ) ) )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		// With -dump the files are dumped as usual and indexed in the same pass
+		bool bDump = !strcmp( argv[ 2 ], "-dump" );
+		bool bOk = true;
+
+		for( int i = bDump ? 3 : 2; i < argc; i++ )
+		{
+			CDemoBlockIndex BlockIndex;
+
+			if( !bDump )
+			{
+				bOk = BlockIndex.Build( argv[ i ] ) && bOk;
+			}
+			else if( DemoFileDump.Open( argv[ i ] ) )
+			{
+				BlockIndex.BeginBuild();
+				DemoFileDump.SetBlockIndex( &BlockIndex );
+				DemoFileDump.DoDump();
+				DemoFileDump.SetBlockIndex( NULL );
+				bOk = BlockIndex.Finish( argv[ i ], DemoFileDump.m_demofile ) && bOk;
+			}
+			else
+			{
+				bOk = false;
+			}
+		}
+		return bOk ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-find" ) )
+	{
+		if( argc <= 3 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return FindInDemo( argv[ 2 ], argc - 3, argv + 3 ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-modifiers" ) )
+	{
+		if( argc != 3 && argc != 5 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		bool bHaveParent = ( argc == 5 );
+		return DumpDemoModifiers( argv[ 2 ], bHaveParent, bHaveParent ? atoi( argv[ 3 ] ) : 0, bHaveParent ? atoi( argv[ 4 ] ) : 0 ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-particles" ) )
+	{
+		if( argc != 3 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		return DumpDemoParticles( argv[ 2 ] ) ? 0 : 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-slice" ) )
+	{
+		CDemoFileSlice DemoFileSlice;
+
+		if( argc != 6 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		if( DemoFileSlice.Open( argv[ 5 ] ) && DemoFileSlice.Slice( argv[ 4 ], atoi( argv[ 2 ] ), atoi( argv[ 3 ] ) ) )
+		{
+			return 0;
+		}
+		return 1;
+	}
+
+	if( !strcmp( argv[ 1 ], "-follow" ) )
+	{
+		if( argc != 3 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		if( DemoFileDump.OpenFollow( argv[ 2 ] ) )
+		{
+			DemoFileDump.DoDump();
+		}
+		return 1;
+	}
+
+	// Reads the next files of a batch while the current one is being dumped
+	if( !strcmp( argv[ 1 ], "-readahead" ) || !strcmp( argv[ 1 ], "-readahead-threads" ) )
+	{
+		EDemoReadAheadBackend backend = !strcmp( argv[ 1 ], "-readahead" ) ? DEMOREADAHEAD_AUTO : DEMOREADAHEAD_THREADS;
+
+		if( argc <= 3 )
+		{
+			PrintUsage();
+			exit( 0 );
+		}
+
+		int nFilesAhead = atoi( argv[ 2 ] );
+		argc -= 2;
+		argv += 2;
+
+		if( !ReadAhead.Start( argc - 1, argv + 1, nFilesAhead, backend ) )
+			return 1;
+
+		fprintf( stderr, "Reading ahead %d files using %s.\n", nFilesAhead, ReadAhead.GetBackendName() );
+	}
+
+	// Several files are dumped one after the other and share the schema cache
+	for( int i = 1; i < argc; i++ )
 	{
-		DemoFileDump.DoDump();
+		if( DemoFileDump.Open( argv[ i ], &ReadAhead ) )
+		{
+			DemoFileDump.DoDump();
+		}
 	}
 
 	return 1;
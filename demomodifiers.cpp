@@ -0,0 +1,370 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include "demomodifiers.h"
+#include "demostreams.h"
+
+#include "generated_proto/dota_modifiers.pb.h"
+
+#define MODIFIER_TICK_INTERVAL		( 1.0f / 30.0f )
+
+CDemoModifierTracker::CDemoModifierTracker()
+{
+	Reset();
+}
+
+void CDemoModifierTracker::Reset()
+{
+	m_flTickInterval = MODIFIER_TICK_INTERVAL;
+	m_nServerTickOffset = 0;
+	m_nSnapshot = 0;
+	m_nLastSnapshotTick = -1;
+	m_bHaveUpdates = false;
+	m_items.clear();
+	m_active.clear();
+	m_closed.clear();
+	m_names.clear();
+}
+
+int CDemoModifierTracker::TimeToTick( float flTime ) const
+{
+	return ( int )floorf( flTime / m_flTickInterval + 0.5f ) - m_nServerTickOffset;
+}
+
+void CDemoModifierTracker::ReadStringTables( const StringTableList_t& Tables, int tick )
+{
+	for( size_t i = 0; i < Tables.size(); i++ )
+	{
+		const CDemoStringTables::table_t& Table = *Tables[ i ];
+
+		if( Table.table_name() == "ActiveModifiers" )
+		{
+			ReadModifiers( Table, tick );
+			m_nLastSnapshotTick = tick;
+		}
+		else if( Table.table_name() == "ModifierNames" )
+		{
+			m_names.resize( Table.items_size() );
+			for( int j = 0; j < Table.items_size(); j++ )
+				m_names[ j ] = Table.items( j ).str();
+		}
+	}
+}
+
+bool CDemoModifierTracker::IsModifierTable( const std::string& name )
+{
+	return name == "ActiveModifiers" || name == "ModifierNames";
+}
+
+void CDemoModifierTracker::ReadStringTableEntries( const std::string& name, const std::vector< demo_string_table_entry_t >& Entries, int tick )
+{
+	if( name == "ActiveModifiers" )
+	{
+		m_bHaveUpdates = true;
+
+		for( size_t i = 0; i < Entries.size(); i++ )
+		{
+			if( Entries[ i ].bHaveData )
+				ReadModifier( Entries[ i ].index, Entries[ i ].data, tick, true );
+		}
+	}
+	else if( name == "ModifierNames" )
+	{
+		for( size_t i = 0; i < Entries.size(); i++ )
+		{
+			const demo_string_table_entry_t& Entry = Entries[ i ];
+
+			if( !Entry.bHaveStr )
+				continue;
+			if( Entry.index >= ( int )m_names.size() )
+				m_names.resize( Entry.index + 1 );
+			m_names[ Entry.index ] = Entry.str;
+		}
+	}
+}
+
+/**
+ * Compares the snapshot with the modifiers that are on: the ones that are new start, the ones that
+ * are missing or removed end. When the updates were read this only finds what they missed.
+ */ 
+void CDemoModifierTracker::ReadModifiers( const CDemoStringTables::table_t& Table, int tick )
+{
+	m_nSnapshot++;
+	m_items.resize( Table.items_size(), std::make_pair( 0, 0 ) );
+
+	for( int i = 0; i < Table.items_size(); i++ )
+		ReadModifier( i, Table.items( i ).data(), tick, false );
+
+	for( std::unordered_map< uint64, modifier_t >::iterator it = m_active.begin(); it != m_active.end(); )
+	{
+		if( it->second.snapshot != m_nSnapshot )
+		{
+			CloseModifier( it->second, tick, false );
+			it = m_active.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+/**
+ * Applies table item index as it is at tick. bExact says that the item was seen the tick it
+ * changed, otherwise it changed somewhere since the last snapshot.
+ */ 
+void CDemoModifierTracker::ReadModifier( int index, const std::string& data, int tick, bool bExact )
+{
+	uint64 hash = HashBytes64( data.data(), data.size() );
+
+	if( index >= ( int )m_items.size() )
+		m_items.resize( index + 1, std::make_pair( 0, 0 ) );
+
+	std::pair< uint64, uint64 >& Item = m_items[ index ];
+
+	if( hash && Item.first == hash )
+	{
+		std::unordered_map< uint64, modifier_t >::iterator it = m_active.find( Item.second );
+		if( it != m_active.end() )
+		{
+			it->second.snapshot = m_nSnapshot;
+			it->second.last_seen_tick = tick;
+		}
+		return;
+	}
+
+	CDOTAModifierBuffTableEntry Entry;
+	uint64 nPrevKey = Item.first ? Item.second : 0;
+	bool bHavePrev = Item.first != 0;
+
+	Item = std::make_pair( 0, 0 );
+	if( !Entry.ParseFromString( data ) )
+		return;
+
+	uint64 key = ( ( uint64 )( uint32 )Entry.parent() << 32 ) | ( uint32 )Entry.serial_num();
+	Item = std::make_pair( hash, key );
+
+	// The item was reused for another modifier without being removed first. A snapshot leaves
+	// that to the check for the modifiers missing from it, a modifier can be at another item there.
+	if( bExact && bHavePrev && nPrevKey != key )
+	{
+		std::unordered_map< uint64, modifier_t >::iterator it = m_active.find( nPrevKey );
+		if( it != m_active.end() )
+		{
+			CloseModifier( it->second, tick, bExact );
+			m_active.erase( it );
+		}
+	}
+
+	std::unordered_map< uint64, modifier_t >::iterator it = m_active.find( key );
+
+	if( Entry.entry_type() == DOTA_MODIFIER_ENTRY_TYPE_REMOVED )
+	{
+		if( it != m_active.end() )
+		{
+			CloseModifier( it->second, tick, bExact );
+			m_active.erase( it );
+		}
+		return;
+	}
+
+	if( it == m_active.end() )
+	{
+		modifier_t& Modifier = m_active[ key ];
+
+		Modifier.parent = Entry.parent();
+		Modifier.serial_num = Entry.serial_num();
+		Modifier.creation_time = Entry.creation_time();
+		Modifier.start_tick = tick;
+
+		// It was created somewhere after the last snapshot
+		if( !bExact && Entry.has_creation_time() )
+		{
+			int nCreationTick = TimeToTick( Entry.creation_time() );
+			if( nCreationTick <= tick && nCreationTick > m_nLastSnapshotTick )
+				Modifier.start_tick = std::max( nCreationTick, 0 );
+		}
+
+		it = m_active.find( key );
+	}
+
+	// The rest can change while the modifier is on, keep the last of it
+	modifier_t& Modifier = it->second;
+	Modifier.name = Entry.name();
+	Modifier.caster = Entry.caster();
+	Modifier.ability = Entry.ability();
+	Modifier.ability_level = Entry.ability_level();
+	Modifier.stack_count = Entry.stack_count();
+	Modifier.duration = Entry.duration();
+	if( Entry.has_creation_time() )
+		Modifier.creation_time = Entry.creation_time();
+	Modifier.last_seen_tick = tick;
+	Modifier.snapshot = m_nSnapshot;
+}
+
+/**
+ * The modifier is gone at tick. Unless that is exact, if it had a duration that ran out since it
+ * was last seen that is when it ended.
+ */ 
+void CDemoModifierTracker::CloseModifier( modifier_t& Modifier, int tick, bool bExact )
+{
+	Modifier.end_tick = tick;
+
+	if( !bExact && Modifier.duration > 0.0f )
+	{
+		int nExpireTick = TimeToTick( Modifier.creation_time + Modifier.duration );
+		if( nExpireTick > Modifier.last_seen_tick && nExpireTick < tick )
+			Modifier.end_tick = nExpireTick;
+	}
+
+	Modifier.end_tick = std::max( Modifier.end_tick, Modifier.start_tick + 1 );
+	m_closed.push_back( Modifier );
+}
+
+void CDemoModifierTracker::Finish( int tick, demo_modifier_stream_t& Stream, std::vector< std::string >& Names )
+{
+	for( std::unordered_map< uint64, modifier_t >::iterator it = m_active.begin(); it != m_active.end(); ++it )
+		CloseModifier( it->second, tick + 1, m_bHaveUpdates );
+	m_active.clear();
+
+	std::sort( m_closed.begin(), m_closed.end(), []( const modifier_t& a, const modifier_t& b )
+	{
+		if( a.parent != b.parent )
+			return a.parent < b.parent;
+		if( a.name != b.name )
+			return a.name < b.name;
+		if( a.start_tick != b.start_tick )
+			return a.start_tick < b.start_tick;
+		return a.serial_num < b.serial_num;
+	} );
+
+	Stream = demo_modifier_stream_t();
+
+	for( size_t i = 0; i < m_closed.size(); i++ )
+	{
+		const modifier_t& Modifier = m_closed[ i ];
+		bool bSameGroup = i && Modifier.parent == m_closed[ i - 1 ].parent && Modifier.name == m_closed[ i - 1 ].name;
+
+		Stream.parent.push_back( Modifier.parent );
+		Stream.name.push_back( Modifier.name );
+		Stream.start_tick.push_back( Modifier.start_tick );
+		Stream.end_tick.push_back( Modifier.end_tick );
+		Stream.max_end_tick.push_back( bSameGroup ? std::max( Stream.max_end_tick.back(), Modifier.end_tick ) : Modifier.end_tick );
+		Stream.serial_num.push_back( Modifier.serial_num );
+		Stream.caster.push_back( Modifier.caster );
+		Stream.ability.push_back( Modifier.ability );
+		Stream.ability_level.push_back( Modifier.ability_level );
+		Stream.stack_count.push_back( Modifier.stack_count );
+		Stream.creation_time.push_back( Modifier.creation_time );
+		Stream.duration.push_back( Modifier.duration );
+	}
+
+	Names.swap( m_names );
+	Reset();
+}
+
+/**
+ * First row in [ first, last ) for which pred is false, pred has to be true for a prefix of the range
+ */ 
+template < class PRED >
+static int PartitionRows( int first, int last, PRED pred )
+{
+	while( first < last )
+	{
+		int mid = first + ( last - first ) / 2;
+
+		if( pred( mid ) )
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return first;
+}
+
+int FindModifierAt( const demo_modifier_stream_t& Stream, int32 parent, int32 name, int tick )
+{
+	int count = ( int )Stream.parent.size();
+	int first = PartitionRows( 0, count, [&]( int i ) { return Stream.parent[ i ] < parent || ( Stream.parent[ i ] == parent && Stream.name[ i ] < name ); } );
+	int last = PartitionRows( first, count, [&]( int i ) { return Stream.parent[ i ] == parent && Stream.name[ i ] == name && Stream.start_tick[ i ] <= tick; } );
+
+	// max_end_tick only grows within the group, the first row where it passes tick is an instance that is still on
+	int row = PartitionRows( first, last, [&]( int i ) { return Stream.max_end_tick[ i ] <= tick; } );
+
+	return row < last ? row : -1;
+}
+
+void FindModifiersAt( const demo_modifier_stream_t& Stream, int32 parent, int tick, std::vector< int >& Rows )
+{
+	int count = ( int )Stream.parent.size();
+	int first = PartitionRows( 0, count, [&]( int i ) { return Stream.parent[ i ] < parent; } );
+
+	Rows.clear();
+	for( int i = first; i < count && Stream.parent[ i ] == parent; i++ )
+	{
+		if( Stream.start_tick[ i ] <= tick && tick < Stream.end_tick[ i ] )
+			Rows.push_back( i );
+	}
+}
+
+static const char *GetModifierName( const std::vector< std::string >& Names, int32 name )
+{
+	return ( name >= 0 && name < ( int32 )Names.size() ) ? Names[ name ].c_str() : "?";
+}
+
+static void PrintModifier( const demo_streams_t& Streams, int row )
+{
+	const demo_modifier_stream_t& Stream = Streams.modifiers;
+
+	printf( "parent:%d name:%d %s ticks:[%d, %d) serial:%d caster:%d ability:%d level:%d stacks:%d created:%.2f duration:%.2f\n",
+		Stream.parent[ row ], Stream.name[ row ], GetModifierName( Streams.modifier_names, Stream.name[ row ] ),
+		Stream.start_tick[ row ], Stream.end_tick[ row ], Stream.serial_num[ row ], Stream.caster[ row ], Stream.ability[ row ],
+		Stream.ability_level[ row ], Stream.stack_count[ row ], Stream.creation_time[ row ], Stream.duration[ row ] );
+}
+
+bool DumpDemoModifiers( const char *filename, bool bHaveParent, int32 parent, int tick )
+{
+	CDemoStreams DemoStreams;
+
+	if( !DemoStreams.Load( filename ) )
+		return false;
+
+	const demo_streams_t& Streams = DemoStreams.GetStreams();
+
+	if( !bHaveParent )
+	{
+		for( size_t i = 0; i < Streams.modifiers.parent.size(); i++ )
+			PrintModifier( Streams, ( int )i );
+		return true;
+	}
+
+	std::vector< int > Rows;
+	FindModifiersAt( Streams.modifiers, parent, tick, Rows );
+
+	for( size_t i = 0; i < Rows.size(); i++ )
+		PrintModifier( Streams, Rows[ i ] );
+	return true;
+}
@@ -0,0 +1,144 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOMODIFIERS_H
+#define DEMOMODIFIERS_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "demofile.h"
+#include "demostringtables.h"
+#include "schemacache.h"
+
+//-----------------------------------------------------------------------------
+// Turns the ActiveModifiers string table into one interval per modifier
+// instance, the tick range [start_tick, end_tick) it was on its parent.
+// Instances are told apart by their parent and global serial number.
+//
+// The table's entries come from svc_CreateStringTable and
+// svc_UpdateStringTable as the server changes them, so the start and end are
+// the ticks the entry was added and removed. The snapshots in
+// DEM_StringTables and DEM_FullPacket only resync: what is missing from one
+// ends there. A demo without the updates only has the snapshots, then the
+// start is the first snapshot a modifier is in and the end the first one it
+// is gone from, narrowed down by its creation_time and duration when those
+// fall between the snapshots.
+//-----------------------------------------------------------------------------
+
+/**
+ * One row per modifier instance, sorted by parent, name and start_tick. max_end_tick is the
+ * largest end_tick of the rows before and including this one with the same parent and name,
+ * it is what makes FindModifierAt() a binary search.
+ */ 
+struct demo_modifier_stream_t
+{
+	std::vector< int32 > parent;			// ehandle
+	std::vector< int32 > name;				// index into the ModifierNames string table
+	std::vector< int32 > start_tick;
+	std::vector< int32 > end_tick;
+	std::vector< int32 > max_end_tick;
+	std::vector< int32 > serial_num;
+	std::vector< int32 > caster;
+	std::vector< int32 > ability;
+	std::vector< int32 > ability_level;
+	std::vector< int32 > stack_count;		// last seen
+	std::vector< float > creation_time;
+	std::vector< float > duration;
+};
+
+class CDemoModifierTracker
+{
+public:
+	CDemoModifierTracker();
+	~CDemoModifierTracker() {}
+
+	void	Reset();
+
+	// Maps creation_time to demo ticks: tick = creation_time / flTickInterval - nServerTickOffset
+	void	SetTickInterval( float flTickInterval )		{ m_flTickInterval = flTickInterval; }
+	void	SetServerTickOffset( int nServerTickOffset )	{ m_nServerTickOffset = nServerTickOffset; }
+
+	// Takes the ActiveModifiers and ModifierNames tables out of a snapshot taken at tick
+	void	ReadStringTables( const StringTableList_t& Tables, int tick );
+
+	// The tables ReadStringTableEntries() wants the svc_CreateStringTable and svc_UpdateStringTable entries of
+	static bool IsModifierTable( const std::string& name );
+
+	// Entries of the table that were created or changed at tick
+	void	ReadStringTableEntries( const std::string& name, const std::vector< demo_string_table_entry_t >& Entries, int tick );
+
+	// Ends the modifiers that are still on at the last tick of the demo and hands out the intervals
+	void	Finish( int tick, demo_modifier_stream_t& Stream, std::vector< std::string >& Names );
+
+private:
+	struct modifier_t
+	{
+		int32 parent;
+		int32 name;
+		int32 serial_num;
+		int32 caster;
+		int32 ability;
+		int32 ability_level;
+		int32 stack_count;
+		float creation_time;
+		float duration;
+		int start_tick;
+		int end_tick;
+		int last_seen_tick;
+		int snapshot;			// last snapshot it was in
+	};
+
+	void	ReadModifiers( const CDemoStringTables::table_t& Table, int tick );
+	void	ReadModifier( int index, const std::string& data, int tick, bool bExact );
+	void	CloseModifier( modifier_t& Modifier, int tick, bool bExact );
+	int		TimeToTick( float flTime ) const;
+
+	float m_flTickInterval;
+	int m_nServerTickOffset;
+
+	int m_nSnapshot;
+	int m_nLastSnapshotTick;
+	bool m_bHaveUpdates;			// ActiveModifiers entries come from svc_UpdateStringTable too
+
+	// Table item index -> hash of its data and the modifier it was, so unchanged items aren't parsed again
+	std::vector< std::pair< uint64, uint64 > > m_items;
+
+	// ( parent, serial_num ) -> the modifiers that are on
+	std::unordered_map< uint64, modifier_t > m_active;
+
+	std::vector< modifier_t > m_closed;
+	std::vector< std::string > m_names;
+};
+
+// Row of the instance of name on parent that is on at tick, -1 if there is none
+int		FindModifierAt( const demo_modifier_stream_t& Stream, int32 parent, int32 name, int tick );
+
+// Rows of all the modifiers on parent at tick
+void	FindModifiersAt( const demo_modifier_stream_t& Stream, int32 parent, int tick, std::vector< int >& Rows );
+
+// The -modifiers mode, prints every interval or, with a parent, the modifiers on it at tick
+bool	DumpDemoModifiers( const char *filename, bool bHaveParent, int32 parent, int tick );
+
+#endif // DEMOMODIFIERS_H
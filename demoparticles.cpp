@@ -0,0 +1,500 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "demoparticles.h"
+#include "demostreams.h"
+
+#include "generated_proto/dota_usermessages.pb.h"
+#include "generated_proto/flatdecoders.h"
+
+#define PROJECTILE_TABLE_MIN_SIZE		64
+
+static uint32 HashProjectileHandle( int32 handle )
+{
+	return ( uint32 )handle * 2654435761u;
+}
+
+CDemoParticleTracker::CDemoParticleTracker()
+{
+	Reset();
+}
+
+void CDemoParticleTracker::Reset()
+{
+	m_particles.clear();
+	m_endedParticles.clear();
+	m_nLiveParticles = 0;
+
+	m_projectiles.clear();
+	m_freeProjectiles.clear();
+	m_projectileTable.assign( PROJECTILE_TABLE_MIN_SIZE, -1 );
+	m_endedProjectiles.clear();
+
+	m_dodges = demo_projectile_dodge_stream_t();
+}
+
+bool CDemoParticleTracker::ReadUserMessage( int msg_type, const char *pData, int size, int tick )
+{
+	switch( msg_type )
+	{
+	case DOTA_UM_ParticleManager:
+		return ReadParticleManager( pData, size, tick );
+
+	case DOTA_UM_CreateLinearProjectile:
+		{
+			CFlat_CDOTAUserMsg_CreateLinearProjectile msg;
+
+			if( !msg.Decode( pData, size ) )
+				return false;
+
+			// A handle that is still alive was never destroyed, it ends where it's reused
+			int nProjectile = FindProjectileSlot( msg.handle() );
+			if( nProjectile >= 0 )
+				EndProjectile( nProjectile, false, tick );
+
+			if( m_freeProjectiles.empty() )
+			{
+				nProjectile = ( int )m_projectiles.size();
+				m_projectiles.push_back( projectile_t() );
+			}
+			else
+			{
+				nProjectile = m_freeProjectiles.back();
+				m_freeProjectiles.pop_back();
+			}
+
+			projectile_t& Projectile = m_projectiles[ nProjectile ];
+
+			Projectile.handle = msg.handle();
+			Projectile.entindex = msg.entindex();
+			Projectile.particle_index = msg.particle_index();
+			Projectile.start_tick = tick;
+			Projectile.end_tick = tick;
+			Projectile.bLive = true;
+			Projectile.bDestroyed = false;
+			Projectile.latency = msg.latency();
+			Projectile.origin[ 0 ] = msg.origin().x();
+			Projectile.origin[ 1 ] = msg.origin().y();
+			Projectile.origin[ 2 ] = msg.origin().z();
+			Projectile.velocity[ 0 ] = msg.velocity().x();
+			Projectile.velocity[ 1 ] = msg.velocity().y();
+
+			InsertProjectileSlot( msg.handle(), nProjectile );
+		}
+		return true;
+
+	case DOTA_UM_DestroyLinearProjectile:
+		{
+			CFlat_CDOTAUserMsg_DestroyLinearProjectile msg;
+
+			if( !msg.Decode( pData, size ) )
+				return false;
+
+			int nProjectile = FindProjectileSlot( msg.handle() );
+			if( nProjectile >= 0 )
+				EndProjectile( nProjectile, true, tick );
+		}
+		return true;
+
+	case DOTA_UM_DodgeTrackingProjectiles:
+		{
+			CFlat_CDOTAUserMsg_DodgeTrackingProjectiles msg;
+
+			if( !msg.Decode( pData, size ) )
+				return false;
+
+			m_dodges.tick.push_back( tick );
+			m_dodges.entindex.push_back( msg.entindex() );
+		}
+		return true;
+
+	default:
+		return true;
+	}
+}
+
+bool CDemoParticleTracker::ReadParticleManager( const char *pData, int size, int tick )
+{
+	CFlat_CDOTAUserMsg_ParticleManager msg;
+
+	if( !msg.Decode( pData, size ) || msg.index() >= DEMOPARTICLE_MAX_INDEX )
+		return false;
+
+	if( msg.type() == DOTA_PARTICLE_MANAGER_EVENT_DESTROY_INVOLVING )
+	{
+		const CFlat_CDOTAUserMsg_ParticleManager_DestroyParticleInvolving& Destroy = msg.destroy_particle_involving();
+
+		// Would match every particle with an unused involved[] entry
+		if( Destroy.entity_handle() == DEMOPARTICLE_INVALID_HANDLE )
+			return true;
+
+		for( size_t i = 0; i < m_particles.size(); i++ )
+		{
+			particle_t& Particle = m_particles[ i ];
+
+			if( Particle.bLive && std::find( Particle.involved, Particle.involved + DEMOPARTICLE_MAX_INVOLVED, Destroy.entity_handle() ) !=
+				Particle.involved + DEMOPARTICLE_MAX_INVOLVED )
+			{
+				DestroyParticle( Particle, Destroy.destroy_immediately(), tick );
+			}
+		}
+		return true;
+	}
+
+	if( msg.index() >= m_particles.size() )
+	{
+		size_t nOldSize = m_particles.size();
+
+		// Grows in steps so a long demo only resizes a few times
+		m_particles.resize( std::max< size_t >( msg.index() + 1, nOldSize * 2 ) );
+		for( size_t i = nOldSize; i < m_particles.size(); i++ )
+			m_particles[ i ].bLive = false;
+	}
+
+	particle_t& Particle = m_particles[ msg.index() ];
+
+	if( msg.type() == DOTA_PARTICLE_MANAGER_EVENT_CREATE )
+	{
+		const CFlat_CDOTAUserMsg_ParticleManager_CreateParticle& Create = msg.create_particle();
+
+		// The index should have been released first
+		if( Particle.bLive )
+			EndParticle( Particle, tick );
+
+		Particle.index = msg.index();
+		Particle.name = Create.particle_name_index();
+		Particle.entity_handle = Create.entity_handle();
+		Particle.attach_type = Create.attach_type();
+		Particle.start_tick = tick;
+		Particle.destroy_tick = -1;
+		Particle.end_tick = tick;
+		Particle.bLive = true;
+		Particle.bDestroyImmediately = false;
+		Particle.num_updates = 0;
+		Particle.control_points = 0;
+		Particle.origin_cp = -1;
+		memset( Particle.origin, 0, sizeof( Particle.origin ) );
+		std::fill( Particle.involved, Particle.involved + DEMOPARTICLE_MAX_INVOLVED, DEMOPARTICLE_INVALID_HANDLE );
+		AddInvolved( Particle, Create.entity_handle() );
+
+		m_nLiveParticles++;
+		return true;
+	}
+
+	// Updates to an index that wasn't created in the demo have nothing to attach to
+	if( !Particle.bLive )
+		return true;
+
+	switch( msg.type() )
+	{
+	case DOTA_PARTICLE_MANAGER_EVENT_UPDATE:
+		{
+			const CFlat_CDOTAUserMsg_ParticleManager_UpdateParticle& Update = msg.update_particle();
+			UpdateParticle( Particle, Update.control_point(), Update.has_position(), Update.position().x(), Update.position().y(), Update.position().z() );
+		}
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_UPDATE_FALLBACK:
+		{
+			const CFlat_CDOTAUserMsg_ParticleManager_UpdateParticleFallback& Update = msg.update_particle_fallback();
+			UpdateParticle( Particle, Update.control_point(), Update.has_position(), Update.position().x(), Update.position().y(), Update.position().z() );
+		}
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_UPDATE_FORWARD:
+		UpdateParticle( Particle, msg.update_particle_fwd().control_point(), false, 0.0f, 0.0f, 0.0f );
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_UPDATE_ORIENTATION:
+		UpdateParticle( Particle, msg.update_particle_orient().control_point(), false, 0.0f, 0.0f, 0.0f );
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_UPDATE_OFFSET:
+		UpdateParticle( Particle, msg.update_particle_offset().control_point(), false, 0.0f, 0.0f, 0.0f );
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_UPDATE_ENT:
+		{
+			const CFlat_CDOTAUserMsg_ParticleManager_UpdateParticleEnt& Update = msg.update_particle_ent();
+
+			UpdateParticle( Particle, Update.control_point(), false, 0.0f, 0.0f, 0.0f );
+			AddInvolved( Particle, Update.entity_handle() );
+		}
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_DESTROY:
+		DestroyParticle( Particle, msg.destroy_particle().destroy_immediately(), tick );
+		break;
+
+	case DOTA_PARTICLE_MANAGER_EVENT_RELEASE:
+		EndParticle( Particle, tick );
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+void CDemoParticleTracker::UpdateParticle( particle_t& Particle, int control_point, bool bHasPosition, float x, float y, float z )
+{
+	Particle.num_updates++;
+	if( control_point >= 0 && control_point < 32 )
+		Particle.control_points |= 1u << control_point;
+
+	if( bHasPosition && Particle.origin_cp < 0 )
+	{
+		Particle.origin_cp = control_point;
+		Particle.origin[ 0 ] = x;
+		Particle.origin[ 1 ] = y;
+		Particle.origin[ 2 ] = z;
+	}
+}
+
+void CDemoParticleTracker::AddInvolved( particle_t& Particle, int32 entity_handle )
+{
+	if( entity_handle == DEMOPARTICLE_INVALID_HANDLE )
+		return;
+
+	for( int i = 0; i < DEMOPARTICLE_MAX_INVOLVED; i++ )
+	{
+		if( Particle.involved[ i ] == entity_handle )
+			return;
+
+		if( Particle.involved[ i ] == DEMOPARTICLE_INVALID_HANDLE )
+		{
+			Particle.involved[ i ] = entity_handle;
+			return;
+		}
+	}
+}
+
+void CDemoParticleTracker::DestroyParticle( particle_t& Particle, bool bImmediately, int tick )
+{
+	if( Particle.destroy_tick >= 0 )
+		return;
+
+	Particle.destroy_tick = tick;
+	Particle.bDestroyImmediately = bImmediately;
+}
+
+void CDemoParticleTracker::EndParticle( particle_t& Particle, int tick )
+{
+	Particle.end_tick = tick;
+	Particle.bLive = false;
+	m_endedParticles.push_back( Particle );
+	m_nLiveParticles--;
+}
+
+int CDemoParticleTracker::FindProjectileSlot( int32 handle ) const
+{
+	uint32 mask = ( uint32 )m_projectileTable.size() - 1;
+
+	for( uint32 i = HashProjectileHandle( handle ) & mask; m_projectileTable[ i ] != -1; i = ( i + 1 ) & mask )
+	{
+		if( m_projectiles[ m_projectileTable[ i ] ].handle == handle )
+			return m_projectileTable[ i ];
+	}
+	return -1;
+}
+
+void CDemoParticleTracker::InsertProjectileSlot( int32 handle, int nProjectile )
+{
+	uint32 mask = ( uint32 )m_projectileTable.size() - 1;
+
+	// Kept at most half full, growing puts the live projectiles back in
+	if( GetLiveProjectileCount() * 2 > ( int )m_projectileTable.size() )
+	{
+		m_projectileTable.assign( m_projectileTable.size() * 2, -1 );
+		mask = ( uint32 )m_projectileTable.size() - 1;
+
+		for( size_t i = 0; i < m_projectiles.size(); i++ )
+		{
+			if( m_projectiles[ i ].bLive && ( int )i != nProjectile )
+				InsertProjectileSlot( m_projectiles[ i ].handle, ( int )i );
+		}
+	}
+
+	uint32 i = HashProjectileHandle( handle ) & mask;
+
+	while( m_projectileTable[ i ] != -1 )
+		i = ( i + 1 ) & mask;
+	m_projectileTable[ i ] = nProjectile;
+}
+
+void CDemoParticleTracker::RemoveProjectileSlot( int32 handle )
+{
+	uint32 mask = ( uint32 )m_projectileTable.size() - 1;
+	uint32 hole = HashProjectileHandle( handle ) & mask;
+
+	while( m_projectileTable[ hole ] != -1 && m_projectiles[ m_projectileTable[ hole ] ].handle != handle )
+		hole = ( hole + 1 ) & mask;
+
+	if( m_projectileTable[ hole ] == -1 )
+		return;
+
+	// Moves the rest of the run back into the hole where that doesn't put an entry before its home
+	for( uint32 i = ( hole + 1 ) & mask; m_projectileTable[ i ] != -1; i = ( i + 1 ) & mask )
+	{
+		uint32 home = HashProjectileHandle( m_projectiles[ m_projectileTable[ i ] ].handle ) & mask;
+
+		if( ( ( i - home ) & mask ) >= ( ( i - hole ) & mask ) )
+		{
+			m_projectileTable[ hole ] = m_projectileTable[ i ];
+			hole = i;
+		}
+	}
+	m_projectileTable[ hole ] = -1;
+}
+
+void CDemoParticleTracker::EndProjectile( int nProjectile, bool bDestroyed, int tick )
+{
+	projectile_t& Projectile = m_projectiles[ nProjectile ];
+
+	RemoveProjectileSlot( Projectile.handle );
+
+	Projectile.end_tick = tick;
+	Projectile.bDestroyed = bDestroyed;
+	Projectile.bLive = false;
+	m_endedProjectiles.push_back( Projectile );
+	m_freeProjectiles.push_back( nProjectile );
+}
+
+void CDemoParticleTracker::Finish( int tick, demo_particle_stream_t& Particles, demo_projectile_stream_t& Projectiles, demo_projectile_dodge_stream_t& Dodges )
+{
+	for( size_t i = 0; i < m_particles.size(); i++ )
+	{
+		if( m_particles[ i ].bLive )
+			EndParticle( m_particles[ i ], tick );
+	}
+
+	for( size_t i = 0; i < m_projectiles.size(); i++ )
+	{
+		if( m_projectiles[ i ].bLive )
+			EndProjectile( ( int )i, false, tick );
+	}
+
+	std::stable_sort( m_endedParticles.begin(), m_endedParticles.end(), []( const particle_t& a, const particle_t& b )
+	{
+		return a.start_tick < b.start_tick;
+	} );
+	std::stable_sort( m_endedProjectiles.begin(), m_endedProjectiles.end(), []( const projectile_t& a, const projectile_t& b )
+	{
+		return a.start_tick < b.start_tick;
+	} );
+
+	Particles = demo_particle_stream_t();
+	Projectiles = demo_projectile_stream_t();
+
+	for( size_t i = 0; i < m_endedParticles.size(); i++ )
+	{
+		const particle_t& Particle = m_endedParticles[ i ];
+
+		Particles.index.push_back( Particle.index );
+		Particles.name.push_back( Particle.name );
+		Particles.entity_handle.push_back( Particle.entity_handle );
+		Particles.attach_type.push_back( Particle.attach_type );
+		Particles.start_tick.push_back( Particle.start_tick );
+		Particles.destroy_tick.push_back( Particle.destroy_tick );
+		Particles.end_tick.push_back( Particle.end_tick );
+		Particles.destroy_immediately.push_back( Particle.bDestroyImmediately );
+		Particles.num_updates.push_back( Particle.num_updates );
+		Particles.control_points.push_back( Particle.control_points );
+		Particles.origin_cp.push_back( Particle.origin_cp );
+		Particles.origin_x.push_back( Particle.origin[ 0 ] );
+		Particles.origin_y.push_back( Particle.origin[ 1 ] );
+		Particles.origin_z.push_back( Particle.origin[ 2 ] );
+	}
+
+	for( size_t i = 0; i < m_endedProjectiles.size(); i++ )
+	{
+		const projectile_t& Projectile = m_endedProjectiles[ i ];
+
+		Projectiles.handle.push_back( Projectile.handle );
+		Projectiles.entindex.push_back( Projectile.entindex );
+		Projectiles.particle_index.push_back( Projectile.particle_index );
+		Projectiles.start_tick.push_back( Projectile.start_tick );
+		Projectiles.end_tick.push_back( Projectile.end_tick );
+		Projectiles.destroyed.push_back( Projectile.bDestroyed );
+		Projectiles.latency.push_back( Projectile.latency );
+		Projectiles.origin_x.push_back( Projectile.origin[ 0 ] );
+		Projectiles.origin_y.push_back( Projectile.origin[ 1 ] );
+		Projectiles.origin_z.push_back( Projectile.origin[ 2 ] );
+		Projectiles.velocity_x.push_back( Projectile.velocity[ 0 ] );
+		Projectiles.velocity_y.push_back( Projectile.velocity[ 1 ] );
+	}
+
+	Dodges.tick.swap( m_dodges.tick );
+	Dodges.entindex.swap( m_dodges.entindex );
+	Reset();
+}
+
+static const char *GetParticleName( const std::vector< std::string >& Names, int32 name )
+{
+	return ( name >= 0 && name < ( int32 )Names.size() ) ? Names[ name ].c_str() : "?";
+}
+
+bool DumpDemoParticles( const char *filename )
+{
+	CDemoStreams DemoStreams;
+
+	if( !DemoStreams.Load( filename ) )
+		return false;
+
+	const demo_streams_t& Streams = DemoStreams.GetStreams();
+	const demo_particle_stream_t& Particles = Streams.particles;
+	const demo_projectile_stream_t& Projectiles = Streams.projectiles;
+	const demo_projectile_dodge_stream_t& Dodges = Streams.projectile_dodges;
+
+	for( size_t i = 0; i < Particles.index.size(); i++ )
+	{
+		printf( "particle:%u name:%d %s entity:%d attach:%d ticks:[%d, %d) destroyed:%d%s updates:%u cps:0x%x",
+			Particles.index[ i ], Particles.name[ i ], GetParticleName( Streams.particle_names, Particles.name[ i ] ),
+			Particles.entity_handle[ i ], Particles.attach_type[ i ], Particles.start_tick[ i ], Particles.end_tick[ i ],
+			Particles.destroy_tick[ i ], Particles.destroy_immediately[ i ] ? " immediately" : "", Particles.num_updates[ i ],
+			Particles.control_points[ i ] );
+
+		if( Particles.origin_cp[ i ] >= 0 )
+			printf( " cp%d:(%.1f %.1f %.1f)", Particles.origin_cp[ i ], Particles.origin_x[ i ], Particles.origin_y[ i ], Particles.origin_z[ i ] );
+		printf( "\n" );
+	}
+
+	for( size_t i = 0; i < Projectiles.handle.size(); i++ )
+	{
+		printf( "projectile:%d entindex:%d particle:%d ticks:[%d, %d)%s latency:%d origin:(%.1f %.1f %.1f) velocity:(%.1f %.1f)\n",
+			Projectiles.handle[ i ], Projectiles.entindex[ i ], Projectiles.particle_index[ i ], Projectiles.start_tick[ i ],
+			Projectiles.end_tick[ i ], Projectiles.destroyed[ i ] ? " destroyed" : "", Projectiles.latency[ i ],
+			Projectiles.origin_x[ i ], Projectiles.origin_y[ i ], Projectiles.origin_z[ i ], Projectiles.velocity_x[ i ], Projectiles.velocity_y[ i ] );
+	}
+
+	for( size_t i = 0; i < Dodges.tick.size(); i++ )
+		printf( "dodge: tick:%d entindex:%d\n", Dodges.tick[ i ], Dodges.entindex[ i ] );
+
+	return true;
+}
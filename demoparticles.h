@@ -0,0 +1,178 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#ifndef DEMOPARTICLES_H
+#define DEMOPARTICLES_H
+
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Follows particles and linear projectiles through the ParticleManager,
+// CreateLinearProjectile and DestroyLinearProjectile user messages and keeps
+// one row per finished lifetime instead of the messages.
+//
+// The live ones are kept in pooled slots: particles by their particle index,
+// which the server reuses, and projectiles by their handle through a small
+// open addressing table. Messages are read with the flat decoders and
+// nothing is allocated per message once the pools are big enough for the
+// busiest moment of the demo.
+//-----------------------------------------------------------------------------
+
+#define DEMOPARTICLE_MAX_INDEX			( 1 << 20 )		// particle indices past this are ignored
+#define DEMOPARTICLE_MAX_INVOLVED		4				// entities a particle remembers for DESTROY_INVOLVING
+#define DEMOPARTICLE_INVALID_HANDLE		-1				// no entity, also marks the unused involved[] entries
+
+/**
+ * One row per particle, sorted by start_tick. name is an index into the ParticleEffectNames
+ * string table. A particle is destroyed (it starts fading) before its index is released.
+ */ 
+struct demo_particle_stream_t
+{
+	std::vector< uint32 > index;
+	std::vector< int32 > name;
+	std::vector< int32 > entity_handle;		// from CreateParticle
+	std::vector< int32 > attach_type;
+	std::vector< int32 > start_tick;
+	std::vector< int32 > destroy_tick;		// -1 if it never was
+	std::vector< int32 > end_tick;			// released, or the last tick of the demo
+	std::vector< uint8_t > destroy_immediately;
+	std::vector< uint32 > num_updates;
+	std::vector< uint32 > control_points;	// bit per control point that was updated
+	std::vector< int32 > origin_cp;			// control point of the first position, -1 if there was none
+	std::vector< float > origin_x;
+	std::vector< float > origin_y;
+	std::vector< float > origin_z;
+};
+
+/**
+ * One row per linear projectile, sorted by start_tick
+ */ 
+struct demo_projectile_stream_t
+{
+	std::vector< int32 > handle;
+	std::vector< int32 > entindex;
+	std::vector< int32 > particle_index;
+	std::vector< int32 > start_tick;
+	std::vector< int32 > end_tick;			// destroyed, or the last tick of the demo
+	std::vector< uint8_t > destroyed;
+	std::vector< int32 > latency;
+	std::vector< float > origin_x;
+	std::vector< float > origin_y;
+	std::vector< float > origin_z;
+	std::vector< float > velocity_x;
+	std::vector< float > velocity_y;
+};
+
+/**
+ * DodgeTrackingProjectiles, tracking projectiles aren't created by user messages so only the dodge is known
+ */ 
+struct demo_projectile_dodge_stream_t
+{
+	std::vector< int32 > tick;
+	std::vector< int32 > entindex;
+};
+
+class CDemoParticleTracker
+{
+public:
+	CDemoParticleTracker();
+	~CDemoParticleTracker() {}
+
+	void	Reset();
+
+	// pData is the payload of a DOTA_UM_ParticleManager, DOTA_UM_CreateLinearProjectile,
+	// DOTA_UM_DestroyLinearProjectile or DOTA_UM_DodgeTrackingProjectiles user message
+	bool	ReadUserMessage( int msg_type, const char *pData, int size, int tick );
+
+	// Ends what is still alive at the last tick of the demo and hands out the rows
+	void	Finish( int tick, demo_particle_stream_t& Particles, demo_projectile_stream_t& Projectiles, demo_projectile_dodge_stream_t& Dodges );
+
+	int		GetLiveParticleCount() const		{ return m_nLiveParticles; }
+	int		GetLiveProjectileCount() const		{ return ( int )( m_projectiles.size() - m_freeProjectiles.size() ); }
+
+private:
+	struct particle_t
+	{
+		uint32 index;
+		int32 name;
+		int32 entity_handle;
+		int32 attach_type;
+		int32 start_tick;
+		int32 destroy_tick;
+		int32 end_tick;
+		bool bLive;
+		bool bDestroyImmediately;
+		uint32 num_updates;
+		uint32 control_points;
+		int32 origin_cp;
+		float origin[ 3 ];
+		int32 involved[ DEMOPARTICLE_MAX_INVOLVED ];
+	};
+
+	struct projectile_t
+	{
+		int32 handle;
+		int32 entindex;
+		int32 particle_index;
+		int32 start_tick;
+		int32 end_tick;
+		bool bLive;
+		bool bDestroyed;
+		int32 latency;
+		float origin[ 3 ];
+		float velocity[ 2 ];
+	};
+
+	bool	ReadParticleManager( const char *pData, int size, int tick );
+	void	UpdateParticle( particle_t& Particle, int control_point, bool bHasPosition, float x, float y, float z );
+	void	AddInvolved( particle_t& Particle, int32 entity_handle );
+	void	DestroyParticle( particle_t& Particle, bool bImmediately, int tick );
+	void	EndParticle( particle_t& Particle, int tick );
+
+	int		FindProjectileSlot( int32 handle ) const;
+	void	InsertProjectileSlot( int32 handle, int nProjectile );
+	void	RemoveProjectileSlot( int32 handle );
+	void	EndProjectile( int nProjectile, bool bDestroyed, int tick );
+
+	// Particles by index, finished ones are copied to m_endedParticles
+	std::vector< particle_t > m_particles;
+	std::vector< particle_t > m_endedParticles;
+	int m_nLiveParticles;
+
+	// Projectile pool, and handle -> pool slot by linear probing. m_projectileTable has a power
+	// of two size and -1 for empty entries.
+	std::vector< projectile_t > m_projectiles;
+	std::vector< int32 > m_freeProjectiles;
+	std::vector< int32 > m_projectileTable;
+	std::vector< projectile_t > m_endedProjectiles;
+
+	demo_projectile_dodge_stream_t m_dodges;
+};
+
+// The -particles mode, prints the particle and projectile lifetimes
+bool	DumpDemoParticles( const char *filename );
+
+#endif // DEMOPARTICLES_H
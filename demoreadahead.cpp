@@ -0,0 +1,610 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+#include "demoreadahead.h"
+
+static int sys_io_uring_setup( unsigned int entries, struct io_uring_params *pParams )
+{
+	return ( int )syscall( __NR_io_uring_setup, entries, pParams );
+}
+
+static int sys_io_uring_enter( int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags )
+{
+	return ( int )syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0 );
+}
+
+/**
+ * Reads until size bytes have been read, the file ends or there is an error
+ *
+ * @return bytes read, or -errno if nothing could be read
+ */ 
+static ssize_t PreadFully( int fd, char *pBuffer, size_t size, uint64 offset )
+{
+	size_t nRead = 0;
+
+	while( nRead < size )
+	{
+		ssize_t n = pread( fd, pBuffer + nRead, size - nRead, offset + nRead );
+
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n < 0 )
+			return nRead ? ( ssize_t )nRead : -errno;
+		if( n == 0 )
+			break;
+
+		nRead += n;
+	}
+
+	return nRead;
+}
+
+CDemoReadAhead::CDemoReadAhead() :
+	m_backend( DEMOREADAHEAD_THREADS ),
+	m_nFilesAhead( 0 ),
+	m_nCurrentFile( 0 ),
+	m_nOutstanding( 0 ),
+	m_uringFd( -1 ),
+	m_nUringPending( 0 ),
+	m_pSqRing( NULL ),
+	m_nSqRingSize( 0 ),
+	m_pCqRing( NULL ),
+	m_nCqRingSize( 0 ),
+	m_pSqes( NULL ),
+	m_nSqesSize( 0 ),
+	m_bStopping( false )
+{
+}
+
+CDemoReadAhead::~CDemoReadAhead()
+{
+	Stop();
+}
+
+bool CDemoReadAhead::Start( int nFiles, char **ppFiles, int nFilesAhead, EDemoReadAheadBackend backend )
+{
+	Stop();
+
+	m_files.resize( nFiles );
+	for( int i = 0; i < nFiles; i++ )
+	{
+		file_t& File = m_files[ i ];
+
+		File.name = ppFiles[ i ];
+		File.fd = -1;
+		File.size = 0;
+		File.bOpened = false;
+		File.bFailed = false;
+		File.bReleased = false;
+		File.nNextIssue = 0;
+		File.nNextConsume = 0;
+	}
+
+	m_nFilesAhead = nFilesAhead > 0 ? nFilesAhead : 0;
+	m_nCurrentFile = 0;
+	m_nOutstanding = 0;
+	m_bStopping = false;
+
+	if( backend != DEMOREADAHEAD_THREADS && InitUring() )
+	{
+		m_backend = DEMOREADAHEAD_URING;
+	}
+	else if( backend == DEMOREADAHEAD_URING )
+	{
+		fprintf( stderr, "CDemoReadAhead::Start: io_uring isn't available: %s.\n", strerror( errno ) );
+		m_files.clear();
+		return false;
+	}
+	else
+	{
+		m_backend = DEMOREADAHEAD_THREADS;
+		for( int i = 0; i < DEMOREADAHEAD_NUM_THREADS; i++ )
+			m_threads.push_back( std::thread( &CDemoReadAhead::WorkerThread, this ) );
+	}
+
+	// Get the first files going right away
+	std::unique_lock< std::mutex > lock( m_mutex );
+	Pump();
+	return true;
+}
+
+/**
+ * Waits for reads that are still in flight and frees everything
+ */ 
+void CDemoReadAhead::Stop()
+{
+	{
+		std::unique_lock< std::mutex > lock( m_mutex );
+
+		for( size_t i = 0; i < m_files.size(); i++ )
+			ReleaseFile( lock, i );
+
+		m_bStopping = true;
+		m_workCv.notify_all();
+	}
+
+	for( size_t i = 0; i < m_threads.size(); i++ )
+		m_threads[ i ].join();
+
+	m_threads.clear();
+	m_workQueue.clear();
+	m_files.clear();
+	m_nOutstanding = 0;
+	ShutdownUring();
+}
+
+const char *CDemoReadAhead::GetBackendName() const
+{
+	return m_backend == DEMOREADAHEAD_URING ? "io_uring" : "threads";
+}
+
+int CDemoReadAhead::FindFile( const char *name ) const
+{
+	for( int i = m_nCurrentFile; i < ( int )m_files.size(); i++ )
+	{
+		if( !m_files[ i ].bReleased && m_files[ i ].name == name )
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Opens the file and splits it into chunks, this happens when read-ahead first reaches it
+ */ 
+bool CDemoReadAhead::OpenFile( file_t& File )
+{
+	struct stat st;
+
+	File.bOpened = true;
+	File.fd = open( File.name.c_str(), O_RDONLY | O_CLOEXEC );
+
+	if( File.fd < 0 || fstat( File.fd, &st ) )
+	{
+		File.bFailed = true;
+		return false;
+	}
+
+	// Tell the kernel not to bother with its own read-ahead, we know the access pattern
+	posix_fadvise( File.fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+	int nFile = ( int )( &File - &m_files[ 0 ] );
+	File.size = st.st_size;
+	File.chunks.resize( ( File.size + DEMOREADAHEAD_CHUNK_SIZE - 1 ) / DEMOREADAHEAD_CHUNK_SIZE );
+
+	for( size_t i = 0; i < File.chunks.size(); i++ )
+	{
+		chunk_t& Chunk = File.chunks[ i ];
+
+		Chunk.nFile = nFile;
+		Chunk.offset = ( uint64 )i * DEMOREADAHEAD_CHUNK_SIZE;
+		Chunk.size = std::min< size_t >( DEMOREADAHEAD_CHUNK_SIZE, File.size - Chunk.offset );
+		Chunk.pBuffer = NULL;
+		Chunk.result = 0;
+		Chunk.bIssued = false;
+		Chunk.bDone = false;
+	}
+
+	return true;
+}
+
+/**
+ * Issues reads, in the order they will be needed, until the window is full. Called with m_mutex held.
+ */ 
+void CDemoReadAhead::Pump()
+{
+	int nLastFile = std::min< int >( m_nCurrentFile + m_nFilesAhead, ( int )m_files.size() - 1 );
+
+	for( int i = m_nCurrentFile; i <= nLastFile && m_nOutstanding < DEMOREADAHEAD_MAX_CHUNKS; i++ )
+	{
+		file_t& File = m_files[ i ];
+
+		if( File.bReleased || ( !File.bOpened && !OpenFile( File ) ) || File.bFailed )
+			continue;
+
+		while( File.nNextIssue < File.chunks.size() && m_nOutstanding < DEMOREADAHEAD_MAX_CHUNKS )
+		{
+			Issue( File.chunks[ File.nNextIssue++ ] );
+		}
+	}
+
+	if( m_backend == DEMOREADAHEAD_URING && m_nUringPending )
+		EnterUring( 0 );
+}
+
+void CDemoReadAhead::Issue( chunk_t& Chunk )
+{
+	// Aligned buffers keep the reads page sized all the way down
+	if( posix_memalign( ( void ** )&Chunk.pBuffer, 4096, DEMOREADAHEAD_CHUNK_SIZE ) )
+	{
+		Chunk.pBuffer = NULL;
+		Chunk.result = -ENOMEM;
+		Chunk.bIssued = true;
+		Chunk.bDone = true;
+		m_nOutstanding++;
+		return;
+	}
+
+	Chunk.bIssued = true;
+	m_nOutstanding++;
+
+	if( m_backend == DEMOREADAHEAD_URING )
+	{
+		QueueUringRead( Chunk );
+	}
+	else
+	{
+		m_workQueue.push_back( &Chunk );
+		m_workCv.notify_one();
+	}
+}
+
+/**
+ * Blocks until the read for Chunk has completed. Called with m_mutex held.
+ */ 
+void CDemoReadAhead::WaitChunk( std::unique_lock< std::mutex >& lock, chunk_t& Chunk )
+{
+	while( !Chunk.bDone )
+	{
+		if( m_backend == DEMOREADAHEAD_URING )
+		{
+			if( !EnterUring( 1 ) )
+			{
+				// The ring is unusable, from here on the kernel may or may not still write to the
+				// buffer, so leave it to the kernel and read into a new one
+				fprintf( stderr, "CDemoReadAhead: io_uring failed: %s.\n", strerror( errno ) );
+				Chunk.pBuffer = NULL;
+				if( !posix_memalign( ( void ** )&Chunk.pBuffer, 4096, DEMOREADAHEAD_CHUNK_SIZE ) )
+					Chunk.result = PreadFully( m_files[ Chunk.nFile ].fd, Chunk.pBuffer, Chunk.size, Chunk.offset );
+				else
+					Chunk.result = -ENOMEM;
+				Chunk.bDone = true;
+			}
+		}
+		else
+		{
+			m_doneCv.wait( lock );
+		}
+	}
+}
+
+void CDemoReadAhead::FreeChunk( chunk_t& Chunk )
+{
+	if( Chunk.bIssued && Chunk.pBuffer )
+	{
+		free( Chunk.pBuffer );
+		Chunk.pBuffer = NULL;
+	}
+
+	if( Chunk.bIssued )
+	{
+		Chunk.bIssued = false;
+		m_nOutstanding--;
+	}
+}
+
+/**
+ * Moves read-ahead on to nFile, files before it that are still around were skipped by the caller
+ */ 
+void CDemoReadAhead::SetCurrentFile( std::unique_lock< std::mutex >& lock, int nFile )
+{
+	for( ; m_nCurrentFile < nFile; m_nCurrentFile++ )
+	{
+		ReleaseFile( lock, m_nCurrentFile );
+	}
+}
+
+bool CDemoReadAhead::GetFileSize( int nFile, size_t *pSize )
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	file_t& File = m_files[ nFile ];
+
+	SetCurrentFile( lock, nFile );
+
+	if( !File.bOpened )
+		OpenFile( File );
+
+	Pump();
+
+	*pSize = File.size;
+	return !File.bFailed;
+}
+
+bool CDemoReadAhead::AppendChunk( int nFile, std::string& buf, bool *pbError )
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	file_t& File = m_files[ nFile ];
+
+	*pbError = false;
+
+	if( File.bFailed || File.bReleased || File.nNextConsume >= File.chunks.size() )
+		return false;
+
+	chunk_t& Chunk = File.chunks[ File.nNextConsume++ ];
+
+	SetCurrentFile( lock, nFile );
+
+	// Chunks are issued in order, so if this one isn't it is the next one to go
+	if( !Chunk.bIssued )
+		Pump();
+	if( !Chunk.bIssued )
+	{
+		Issue( Chunk );
+		File.nNextIssue = File.nNextConsume;
+	}
+
+	WaitChunk( lock, Chunk );
+
+	// Short or failed reads (e.g. a kernel without IORING_OP_READ) are finished off here
+	ssize_t nRead = Chunk.result > 0 ? Chunk.result : 0;
+	if( ( size_t )nRead < Chunk.size && Chunk.pBuffer )
+	{
+		lock.unlock();
+		ssize_t nMore = PreadFully( File.fd, Chunk.pBuffer + nRead, Chunk.size - nRead, Chunk.offset + nRead );
+		lock.lock();
+
+		if( nMore > 0 )
+			nRead += nMore;
+	}
+
+	if( Chunk.pBuffer )
+		buf.append( Chunk.pBuffer, nRead );
+
+	*pbError = ( size_t )nRead < Chunk.size;
+
+	FreeChunk( Chunk );
+	Pump();
+
+	// Nothing past a hole in the file is usable
+	if( *pbError )
+		File.nNextConsume = File.chunks.size();
+
+	return nRead > 0;
+}
+
+void CDemoReadAhead::ReleaseFile( int nFile )
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+
+	ReleaseFile( lock, nFile );
+	Pump();
+}
+
+/**
+ * Drops whatever is left of a file, once the reads in flight for it have landed
+ */ 
+void CDemoReadAhead::ReleaseFile( std::unique_lock< std::mutex >& lock, int nFile )
+{
+	file_t& File = m_files[ nFile ];
+
+	if( File.bReleased )
+		return;
+
+	for( size_t i = 0; i < File.chunks.size(); i++ )
+	{
+		if( File.chunks[ i ].bIssued && !File.chunks[ i ].bDone )
+			WaitChunk( lock, File.chunks[ i ] );
+		FreeChunk( File.chunks[ i ] );
+	}
+
+	File.chunks.clear();
+	File.bReleased = true;
+
+	if( File.fd >= 0 )
+	{
+		close( File.fd );
+		File.fd = -1;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// io_uring backend, driven entirely from the parsing thread
+//-----------------------------------------------------------------------------
+
+bool CDemoReadAhead::InitUring()
+{
+	struct io_uring_params params;
+
+	memset( &params, 0, sizeof( params ) );
+	m_uringFd = sys_io_uring_setup( DEMOREADAHEAD_MAX_CHUNKS, &params );
+	if( m_uringFd < 0 )
+		return false;
+
+	m_nSqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned int );
+	m_nCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	m_nSqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+		m_nSqRingSize = m_nCqRingSize = std::max( m_nSqRingSize, m_nCqRingSize );
+
+	m_pSqRing = mmap( NULL, m_nSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_uringFd, IORING_OFF_SQ_RING );
+	if( m_pSqRing == MAP_FAILED )
+	{
+		m_pSqRing = NULL;
+		ShutdownUring();
+		return false;
+	}
+
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		m_pCqRing = m_pSqRing;
+	}
+	else
+	{
+		m_pCqRing = mmap( NULL, m_nCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_uringFd, IORING_OFF_CQ_RING );
+		if( m_pCqRing == MAP_FAILED )
+		{
+			m_pCqRing = NULL;
+			ShutdownUring();
+			return false;
+		}
+	}
+
+	m_pSqes = ( struct io_uring_sqe * )mmap( NULL, m_nSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_uringFd, IORING_OFF_SQES );
+	if( m_pSqes == MAP_FAILED )
+	{
+		m_pSqes = NULL;
+		ShutdownUring();
+		return false;
+	}
+
+	char *pSq = ( char * )m_pSqRing;
+	char *pCq = ( char * )m_pCqRing;
+
+	m_pSqTail = ( unsigned int * )( pSq + params.sq_off.tail );
+	m_pSqMask = ( unsigned int * )( pSq + params.sq_off.ring_mask );
+	m_pSqArray = ( unsigned int * )( pSq + params.sq_off.array );
+	m_pCqHead = ( unsigned int * )( pCq + params.cq_off.head );
+	m_pCqTail = ( unsigned int * )( pCq + params.cq_off.tail );
+	m_pCqMask = ( unsigned int * )( pCq + params.cq_off.ring_mask );
+	m_pCqes = ( struct io_uring_cqe * )( pCq + params.cq_off.cqes );
+	m_nUringPending = 0;
+	return true;
+}
+
+void CDemoReadAhead::ShutdownUring()
+{
+	if( m_pSqes )
+		munmap( m_pSqes, m_nSqesSize );
+	if( m_pCqRing && m_pCqRing != m_pSqRing )
+		munmap( m_pCqRing, m_nCqRingSize );
+	if( m_pSqRing )
+		munmap( m_pSqRing, m_nSqRingSize );
+	if( m_uringFd >= 0 )
+		close( m_uringFd );
+
+	m_pSqes = NULL;
+	m_pCqRing = NULL;
+	m_pSqRing = NULL;
+	m_uringFd = -1;
+	m_nUringPending = 0;
+}
+
+/**
+ * Puts a read on the submission ring, it's handed to the kernel by the next EnterUring()
+ */ 
+void CDemoReadAhead::QueueUringRead( chunk_t& Chunk )
+{
+	// The window is never bigger than the ring, so there is always a free entry
+	unsigned int tail = *m_pSqTail;
+	unsigned int index = tail & *m_pSqMask;
+	struct io_uring_sqe *pSqe = &m_pSqes[ index ];
+
+	memset( pSqe, 0, sizeof( *pSqe ) );
+	pSqe->opcode = IORING_OP_READ;
+	pSqe->fd = m_files[ Chunk.nFile ].fd;
+	pSqe->addr = ( uint64 )( uintptr_t )Chunk.pBuffer;
+	pSqe->len = Chunk.size;
+	pSqe->off = Chunk.offset;
+	pSqe->user_data = ( uint64 )( uintptr_t )&Chunk;
+
+	m_pSqArray[ index ] = index;
+	__atomic_store_n( m_pSqTail, tail + 1, __ATOMIC_RELEASE );
+	m_nUringPending++;
+}
+
+/**
+ * Submits the queued reads and waits for at least nMinComplete completions
+ *
+ * @return false if the ring stopped working
+ */ 
+bool CDemoReadAhead::EnterUring( unsigned int nMinComplete )
+{
+	for( ;; )
+	{
+		int ret = sys_io_uring_enter( m_uringFd, m_nUringPending, nMinComplete, nMinComplete ? IORING_ENTER_GETEVENTS : 0 );
+
+		if( ret >= 0 )
+		{
+			m_nUringPending -= std::min< unsigned int >( ret, m_nUringPending );
+			ReapUring();
+			return true;
+		}
+
+		if( errno != EINTR && errno != EAGAIN && errno != EBUSY )
+			return false;
+
+		// Out of resources, make room by collecting completions first
+		ReapUring();
+	}
+}
+
+void CDemoReadAhead::ReapUring()
+{
+	unsigned int head = *m_pCqHead;
+
+	while( head != __atomic_load_n( m_pCqTail, __ATOMIC_ACQUIRE ) )
+	{
+		const struct io_uring_cqe *pCqe = &m_pCqes[ head & *m_pCqMask ];
+		chunk_t *pChunk = ( chunk_t * )( uintptr_t )pCqe->user_data;
+
+		pChunk->result = pCqe->res;
+		pChunk->bDone = true;
+		head++;
+	}
+
+	__atomic_store_n( m_pCqHead, head, __ATOMIC_RELEASE );
+}
+
+//-----------------------------------------------------------------------------
+// Thread pool backend
+//-----------------------------------------------------------------------------
+
+void CDemoReadAhead::WorkerThread()
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+
+	for( ;; )
+	{
+		while( !m_bStopping && m_workQueue.empty() )
+			m_workCv.wait( lock );
+
+		if( m_workQueue.empty() )
+			break;
+
+		// Oldest first, that's the one the parser is going to want next
+		chunk_t *pChunk = m_workQueue.front();
+		m_workQueue.erase( m_workQueue.begin() );
+		int fd = m_files[ pChunk->nFile ].fd;
+
+		lock.unlock();
+		ssize_t result = PreadFully( fd, pChunk->pBuffer, pChunk->size, pChunk->offset );
+		lock.lock();
+
+		pChunk->result = result;
+		pChunk->bDone = true;
+		m_doneCv.notify_all();
+	}
+}
@@ -0,0 +1,154 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOREADAHEAD_H
+#define DEMOREADAHEAD_H
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Asynchronous read-ahead for batches of demos. Files are read in large,
+// chunk aligned pieces, for the rest of the demo being parsed and for the
+// next few demos of the batch, while CDemoFile works on the frames that are
+// already in memory. Reads go through io_uring where the kernel allows it
+// and through a small pool of pread() threads otherwise.
+//
+// All methods are called from the thread that parses the demos.
+//-----------------------------------------------------------------------------
+
+#define DEMOREADAHEAD_CHUNK_SIZE		( 1024 * 1024 )
+// Chunks that may be in flight or waiting to be parsed, i.e. the memory used for read-ahead
+#define DEMOREADAHEAD_MAX_CHUNKS		64
+#define DEMOREADAHEAD_NUM_THREADS		4
+
+enum EDemoReadAheadBackend
+{
+	DEMOREADAHEAD_AUTO = 0,			// io_uring, or threads if that isn't available
+	DEMOREADAHEAD_URING,
+	DEMOREADAHEAD_THREADS,
+};
+
+class CDemoReadAhead
+{
+public:
+	CDemoReadAhead();
+	~CDemoReadAhead();
+
+	// The files are expected to be opened in this order, reads run up to nFilesAhead files past the current one
+	bool	Start( int nFiles, char **ppFiles, int nFilesAhead, EDemoReadAheadBackend backend = DEMOREADAHEAD_AUTO );
+	void	Stop();
+	const char *GetBackendName() const;
+
+	// Index of a file passed to Start() that hasn't been released yet, -1 if there is none
+	int		FindFile( const char *name ) const;
+
+	// Makes nFile the current file, earlier ones are released. False if the file couldn't be opened.
+	bool	GetFileSize( int nFile, size_t *pSize );
+
+	// Appends the next chunk of nFile to buf, false once the file is finished.
+	// pbError is set if the chunk couldn't be read completely.
+	bool	AppendChunk( int nFile, std::string& buf, bool *pbError );
+
+	void	ReleaseFile( int nFile );
+
+private:
+	struct chunk_t
+	{
+		int nFile;
+		uint64 offset;
+		size_t size;
+		char *pBuffer;
+		ssize_t result;		// bytes read, or -errno
+		bool bIssued;
+		bool bDone;
+	};
+
+	struct file_t
+	{
+		std::string name;
+		int fd;
+		size_t size;
+		bool bOpened;
+		bool bFailed;
+		bool bReleased;
+		std::vector< chunk_t > chunks;
+		size_t nNextIssue;
+		size_t nNextConsume;
+	};
+
+	bool	OpenFile( file_t& File );
+	void	Pump();
+	void	Issue( chunk_t& Chunk );
+	void	WaitChunk( std::unique_lock< std::mutex >& lock, chunk_t& Chunk );
+	void	FreeChunk( chunk_t& Chunk );
+	void	SetCurrentFile( std::unique_lock< std::mutex >& lock, int nFile );
+	void	ReleaseFile( std::unique_lock< std::mutex >& lock, int nFile );
+
+	bool	InitUring();
+	void	ShutdownUring();
+	void	QueueUringRead( chunk_t& Chunk );
+	bool	EnterUring( unsigned int nMinComplete );
+	void	ReapUring();
+
+	void	WorkerThread();
+
+	EDemoReadAheadBackend m_backend;
+	int m_nFilesAhead;
+	int m_nCurrentFile;
+	int m_nOutstanding;
+	std::vector< file_t > m_files;
+
+	// io_uring rings, see io_uring_setup(2)
+	int m_uringFd;
+	unsigned int m_nUringPending;
+	void *m_pSqRing;
+	size_t m_nSqRingSize;
+	void *m_pCqRing;
+	size_t m_nCqRingSize;
+	struct io_uring_sqe *m_pSqes;
+	size_t m_nSqesSize;
+	unsigned int *m_pSqTail;
+	unsigned int *m_pSqMask;
+	unsigned int *m_pSqArray;
+	unsigned int *m_pCqHead;
+	unsigned int *m_pCqTail;
+	unsigned int *m_pCqMask;
+	struct io_uring_cqe *m_pCqes;
+
+	// Thread pool
+	std::mutex m_mutex;
+	std::condition_variable m_workCv;
+	std::condition_variable m_doneCv;
+	std::vector< chunk_t * > m_workQueue;
+	std::vector< std::thread > m_threads;
+	bool m_bStopping;
+};
+
+#endif // DEMOREADAHEAD_H
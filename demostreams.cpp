@@ -0,0 +1,404 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <algorithm>
+#include "demostreams.h"
+
+#include "generated_proto/dota_usermessages.pb.h"
+#include "generated_proto/flatdecoders.h"
+
+/**
+ * Reads the whole demo into m_streams
+ */ 
+bool CDemoStreams::Load( const char *filename )
+{
+	m_streams = demo_streams_t();
+	m_streams.error_count = 0;
+	m_modifiers.Reset();
+	m_particles.Reset();
+	m_stringTables.clear();
+	m_bHaveServerTickOffset = false;
+	int nLastTick = 0;
+
+	if( !m_demofile.Open( filename ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
+
+	while( !m_demofile.IsDone() )
+	{
+		int tick = 0;
+		int size = 0;
+		bool bCompressed;
+		bool bFrameOk = false;
+		size_t nFramePos = m_demofile.GetPos();
+
+		EDemoCommands DemoCommand = m_demofile.ReadMessageType( &tick, &bCompressed );
+
+		switch( DemoCommand )
+		{
+		case DEM_Packet:
+		case DEM_SignonPacket:
+			{
+				const char *pData;
+				int DataSize;
+				CFlat_CDemoPacket Packet;
+
+				if( m_demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size ) )
+				{
+					bFrameOk = Packet.Decode( pData, DataSize );
+
+					if( bFrameOk )
+						ReadPacket( Packet.data().data(), ( int )Packet.data().size(), tick );
+					else
+						m_demofile.ReportError( DEMO_ERROR_PARSE );
+				}
+			}
+			break;
+
+		case DEM_FullPacket:
+			{
+				const char *pData;
+				int DataSize;
+				StringTableList_t Tables;
+				CDemoPacket Packet;
+
+				if( m_demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size ) )
+				{
+					bFrameOk = ParseFullPacketInterned( pData, DataSize, Tables, Packet );
+
+					if( bFrameOk )
+					{
+						ReadStringTables( Tables, tick );
+						ReadPacket( Packet.data().data(), ( int )Packet.data().size(), tick );
+					}
+					else
+					{
+						m_demofile.ReportError( DEMO_ERROR_PARSE );
+					}
+				}
+			}
+			break;
+
+		case DEM_StringTables:
+			{
+				const char *pData;
+				int DataSize;
+				StringTableList_t Tables;
+
+				if( m_demofile.ReadMessageData( bCompressed, &pData, &DataSize, &size ) )
+				{
+					bFrameOk = ParseStringTablesInterned( pData, DataSize, Tables );
+
+					if( bFrameOk )
+						ReadStringTables( Tables, tick );
+					else
+						m_demofile.ReportError( DEMO_ERROR_PARSE );
+				}
+			}
+			break;
+
+		case DEM_Error:
+			break;
+
+		default:
+			bFrameOk = m_demofile.ReadRawMessage( NULL, &size );
+			break;
+		}
+
+		if( !bFrameOk )
+		{
+			if( !m_demofile.Resync( nFramePos ) )
+				break;
+			continue;
+		}
+
+		nLastTick = std::max( nLastTick, tick );
+
+		m_streams.frames.tick.push_back( tick );
+		m_streams.frames.command.push_back( DemoCommand );
+		m_streams.frames.offset.push_back( nFramePos );
+		m_streams.frames.size.push_back( size );
+	}
+
+	m_modifiers.Finish( nLastTick, m_streams.modifiers, m_streams.modifier_names );
+	m_particles.Finish( nLastTick, m_streams.particles, m_streams.projectiles, m_streams.projectile_dodges );
+
+	m_streams.error_count = m_demofile.GetErrorCount();
+	m_demofile.Close();
+	return true;
+}
+
+/**
+ * Walks the net messages in a packet, keeping the ones that have a stream
+ */ 
+void CDemoStreams::ReadPacket( const char *pData, int size, int tick )
+{
+	CFlatReader reader( pData, size );
+
+	while( !reader.AtEnd() )
+	{
+		uint64_t Cmd;
+		std::string_view msg;
+
+		if( !reader.ReadVarint64( &Cmd ) || !reader.ReadBytes( &msg ) )
+		{
+			m_demofile.ReportError( DEMO_ERROR_BAD_PACKET );
+			return;
+		}
+
+		switch( Cmd )
+		{
+		case svc_UserMessage:
+			ReadUserMessage( msg.data(), ( int )msg.size(), tick );
+			break;
+
+		case svc_GameEvent:
+			ReadGameEvent( msg.data(), ( int )msg.size(), tick );
+			break;
+
+		case svc_ServerInfo:
+			{
+				CSVCMsg_ServerInfo ServerInfo;
+
+				if( ServerInfo.ParseFromArray( msg.data(), ( int )msg.size() ) && ServerInfo.tick_interval() > 0.0f )
+					m_modifiers.SetTickInterval( ServerInfo.tick_interval() );
+			}
+			break;
+
+		case net_Tick:
+			// Signon packets are all at tick 0, the offset comes from the first packet of the match
+			if( !m_bHaveServerTickOffset && tick > 0 )
+			{
+				CNETMsg_Tick Tick;
+
+				if( Tick.ParseFromArray( msg.data(), ( int )msg.size() ) )
+				{
+					m_modifiers.SetServerTickOffset( ( int )Tick.tick() - tick );
+					m_bHaveServerTickOffset = true;
+				}
+			}
+			break;
+
+		case svc_CreateStringTable:
+			ReadCreateStringTable( msg.data(), ( int )msg.size(), tick );
+			break;
+
+		case svc_UpdateStringTable:
+			ReadUpdateStringTable( msg.data(), ( int )msg.size(), tick );
+			break;
+
+		case svc_GameEventList:
+			{
+				std::shared_ptr< const CGameEventSchema > pSchema = CSchemaCache< CGameEventSchema >::Intern( msg.data(), ( int )msg.size() );
+
+				if( pSchema )
+					m_streams.pGameEventSchema = pSchema;
+			}
+			break;
+		}
+	}
+}
+
+void CDemoStreams::ReadUserMessage( const char *pData, int size, int tick )
+{
+	CFlat_CSVCMsg_UserMessage userMessage;
+
+	if( !userMessage.Decode( pData, size ) )
+		return;
+
+	const char *pDataUM = userMessage.msg_data().data();
+	int SizeUM = ( int )userMessage.msg_data().size();
+
+	if( userMessage.msg_type() == DOTA_UM_CombatLogData )
+	{
+		CFlat_CDOTAUserMsg_CombatLogData msg;
+		demo_combat_log_stream_t& Stream = m_streams.combat_log;
+
+		if( !msg.Decode( pDataUM, SizeUM ) )
+			return;
+
+		Stream.tick.push_back( tick );
+		Stream.type.push_back( msg.type() );
+		Stream.target_name.push_back( msg.target_name() );
+		Stream.attacker_name.push_back( msg.attacker_name() );
+		Stream.inflictor_name.push_back( msg.inflictor_name() );
+		Stream.attacker_illusion.push_back( msg.attacker_illusion() );
+		Stream.target_illusion.push_back( msg.target_illusion() );
+		Stream.value.push_back( msg.value() );
+		Stream.health.push_back( msg.health() );
+		Stream.time.push_back( msg.time() );
+	}
+	else if( userMessage.msg_type() == DOTA_UM_CombatHeroPositions )
+	{
+		CFlat_CDOTAUserMsg_CombatHeroPositions msg;
+		demo_hero_position_stream_t& Stream = m_streams.hero_positions;
+
+		if( !msg.Decode( pDataUM, SizeUM ) )
+			return;
+
+		Stream.tick.push_back( tick );
+		Stream.index.push_back( msg.index() );
+		Stream.time.push_back( msg.time() );
+		Stream.x.push_back( msg.world_pos().x() );
+		Stream.y.push_back( msg.world_pos().y() );
+		Stream.health.push_back( msg.health() );
+	}
+	else if( !m_particles.ReadUserMessage( userMessage.msg_type(), pDataUM, SizeUM, tick ) )
+	{
+		m_demofile.ReportError( DEMO_ERROR_PARSE );
+	}
+}
+
+/**
+ * Adds a decoded game event, works with both the flat decoder and libprotobuf
+ */ 
+template < class T >
+static void AppendGameEvent( demo_streams_t& Streams, const T& msg, int tick )
+{
+	demo_game_event_stream_t& Stream = Streams.game_events;
+	demo_game_event_key_stream_t& Keys = Streams.game_event_keys;
+
+	Stream.tick.push_back( tick );
+	Stream.eventid.push_back( msg.eventid() );
+	Stream.first_key.push_back( Keys.type.size() );
+	Stream.num_keys.push_back( msg.keys_size() );
+
+	for( int i = 0; i < msg.keys_size(); i++ )
+	{
+		const typename T::key_t& Key = msg.keys( i );
+		int64_t val_int = Key.has_val_long() ? Key.val_long() : Key.has_val_short() ? Key.val_short() :
+			Key.has_val_byte() ? Key.val_byte() : Key.has_val_bool() ? Key.val_bool() : ( int64_t )Key.val_uint64();
+
+		Keys.type.push_back( Key.type() );
+		Keys.val_int.push_back( val_int );
+		Keys.val_float.push_back( Key.val_float() );
+		Keys.str_offset.push_back( Streams.game_event_strings.size() );
+		Keys.str_length.push_back( Key.val_string().size() );
+		Streams.game_event_strings.append( Key.val_string().data(), Key.val_string().size() );
+	}
+}
+
+void CDemoStreams::ReadGameEvent( const char *pData, int size, int tick )
+{
+	CFlat_CSVCMsg_GameEvent flat;
+
+	if( flat.Decode( pData, size ) )
+	{
+		AppendGameEvent( m_streams, flat, tick );
+		return;
+	}
+
+	// Events with more keys than the flat decoder holds go through libprotobuf
+	CSVCMsg_GameEvent msg;
+
+	if( msg.ParseFromArray( pData, size ) )
+		AppendGameEvent( m_streams, msg, tick );
+}
+
+/**
+ * Remembers how to decode the table's updates and hands the entries it starts with to the
+ * modifier tracker when it is one of its tables
+ */ 
+void CDemoStreams::ReadCreateStringTable( const char *pData, int size, int tick )
+{
+	CSVCMsg_CreateStringTable msg;
+
+	if( !msg.ParseFromArray( pData, size ) )
+	{
+		m_demofile.ReportError( DEMO_ERROR_PARSE );
+		return;
+	}
+
+	m_stringTables.push_back( demo_string_table_info_t() );
+
+	demo_string_table_info_t& Table = m_stringTables.back();
+	Table.name = msg.name();
+	Table.max_entries = msg.max_entries();
+	Table.user_data_fixed_size = msg.user_data_fixed_size();
+	Table.user_data_size_bits = msg.user_data_size_bits();
+
+	if( !CDemoModifierTracker::IsModifierTable( Table.name ) )
+		return;
+
+	if( DecodeStringTableEntries( Table, msg.string_data().data(), ( int )msg.string_data().size(), msg.num_entries(), m_stringTableEntries ) )
+		m_modifiers.ReadStringTableEntries( Table.name, m_stringTableEntries, tick );
+	else
+		m_demofile.ReportError( DEMO_ERROR_PARSE );
+}
+
+/**
+ * Only the modifier tracker's tables are decoded, the other updates are skipped without a copy
+ */ 
+void CDemoStreams::ReadUpdateStringTable( const char *pData, int size, int tick )
+{
+	CFlat_CSVCMsg_UpdateStringTable msg;
+
+	if( !msg.Decode( pData, size ) )
+	{
+		m_demofile.ReportError( DEMO_ERROR_PARSE );
+		return;
+	}
+
+	if( msg.table_id() < 0 || msg.table_id() >= ( int )m_stringTables.size() )
+		return;
+
+	demo_string_table_info_t& Table = m_stringTables[ msg.table_id() ];
+
+	if( !CDemoModifierTracker::IsModifierTable( Table.name ) )
+		return;
+
+	if( DecodeStringTableEntries( Table, msg.string_data().data(), ( int )msg.string_data().size(), msg.num_changed_entries(), m_stringTableEntries ) )
+		m_modifiers.ReadStringTableEntries( Table.name, m_stringTableEntries, tick );
+	else
+		m_demofile.ReportError( DEMO_ERROR_PARSE );
+}
+
+/**
+ * Keeps the names from the CombatLogNames and ParticleEffectNames tables that the combat log
+ * and the particles refer to and passes the snapshot on to the modifier tracker
+ */ 
+void CDemoStreams::ReadStringTables( const StringTableList_t& Tables, int tick )
+{
+	m_modifiers.ReadStringTables( Tables, tick );
+
+	for( size_t i = 0; i < Tables.size(); i++ )
+	{
+		const CDemoStringTables::table_t& Table = *Tables[ i ];
+		std::vector< std::string > *pNames;
+
+		if( Table.table_name() == "CombatLogNames" )
+			pNames = &m_streams.combat_log_names;
+		else if( Table.table_name() == "ParticleEffectNames" )
+			pNames = &m_streams.particle_names;
+		else
+			continue;
+
+		pNames->resize( Table.items_size() );
+		for( int j = 0; j < Table.items_size(); j++ )
+			( *pNames )[ j ] = Table.items( j ).str();
+	}
+}
@@ -0,0 +1,161 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOSTREAMS_H
+#define DEMOSTREAMS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "demofile.h"
+#include "demomodifiers.h"
+#include "demoparticles.h"
+#include "demostringtables.h"
+#include "schemacache.h"
+
+//-----------------------------------------------------------------------------
+// Pulls the commonly analysed streams out of a demo into flat columns, one
+// std::vector per field, so they can be handed to other languages (see
+// python/demoinfo2module.cpp) without converting anything. Row i of a stream
+// is element i of each of its columns.
+//-----------------------------------------------------------------------------
+
+/**
+ * Every frame in the demo, offsets are into the frame stream like CDemoFile::GetPos()
+ */ 
+struct demo_frame_stream_t
+{
+	std::vector< int32 > tick;
+	std::vector< int32 > command;
+	std::vector< uint64 > offset;
+	std::vector< int32 > size;
+};
+
+/**
+ * svc_GameEvent, the keys of event i are rows first_key[ i ] .. first_key[ i ] + num_keys[ i ] - 1 of keys
+ */ 
+struct demo_game_event_stream_t
+{
+	std::vector< int32 > tick;
+	std::vector< int32 > eventid;
+	std::vector< uint32 > first_key;
+	std::vector< uint32 > num_keys;
+};
+
+/**
+ * Values of game event keys, type says which of the value columns is used. Strings are
+ * ranges of demo_streams_t::game_event_strings.
+ */ 
+struct demo_game_event_key_stream_t
+{
+	std::vector< int32 > type;
+	std::vector< int64_t > val_int;			// val_long, val_short, val_byte, val_bool and val_uint64
+	std::vector< float > val_float;
+	std::vector< uint32 > str_offset;
+	std::vector< uint32 > str_length;
+};
+
+/**
+ * CDOTAUserMsg_CombatLogData, names are indices into demo_streams_t::combat_log_names
+ */ 
+struct demo_combat_log_stream_t
+{
+	std::vector< int32 > tick;
+	std::vector< uint32 > type;
+	std::vector< uint32 > target_name;
+	std::vector< uint32 > attacker_name;
+	std::vector< uint32 > inflictor_name;
+	std::vector< uint8_t > attacker_illusion;
+	std::vector< uint8_t > target_illusion;
+	std::vector< int32 > value;
+	std::vector< int32 > health;
+	std::vector< float > time;
+};
+
+/**
+ * CDOTAUserMsg_CombatHeroPositions
+ */ 
+struct demo_hero_position_stream_t
+{
+	std::vector< int32 > tick;
+	std::vector< uint32 > index;
+	std::vector< int32 > time;
+	std::vector< float > x;
+	std::vector< float > y;
+	std::vector< int32 > health;
+};
+
+struct demo_streams_t
+{
+	demo_frame_stream_t frames;
+	demo_game_event_stream_t game_events;
+	demo_game_event_key_stream_t game_event_keys;
+	std::string game_event_strings;
+	demo_combat_log_stream_t combat_log;
+	demo_hero_position_stream_t hero_positions;
+	demo_modifier_stream_t modifiers;
+	demo_particle_stream_t particles;
+	demo_projectile_stream_t projectiles;
+	demo_projectile_dodge_stream_t projectile_dodges;
+
+	// Last game event list, CombatLogNames, ModifierNames and ParticleEffectNames string tables in the demo
+	std::shared_ptr< const CGameEventSchema > pGameEventSchema;
+	std::vector< std::string > combat_log_names;
+	std::vector< std::string > modifier_names;
+	std::vector< std::string > particle_names;
+
+	int error_count;
+};
+
+class CDemoStreams
+{
+public:
+	CDemoStreams() {}
+	~CDemoStreams() {}
+
+	// Reads the whole demo, corrupt frames are skipped and counted in error_count
+	bool Load( const char *filename );
+
+	const demo_streams_t& GetStreams() const	{ return m_streams; }
+
+private:
+	void ReadPacket( const char *pData, int size, int tick );
+	void ReadUserMessage( const char *pData, int size, int tick );
+	void ReadGameEvent( const char *pData, int size, int tick );
+	void ReadStringTables( const StringTableList_t& Tables, int tick );
+	void ReadCreateStringTable( const char *pData, int size, int tick );
+	void ReadUpdateStringTable( const char *pData, int size, int tick );
+
+	CDemoFile m_demofile;
+	demo_streams_t m_streams;
+	CDemoModifierTracker m_modifiers;
+	CDemoParticleTracker m_particles;
+	bool m_bHaveServerTickOffset;
+
+	// In the order they were created, which is the table_id of svc_UpdateStringTable
+	std::vector< demo_string_table_info_t > m_stringTables;
+	std::vector< demo_string_table_entry_t > m_stringTableEntries;
+};
+
+#endif // DEMOSTREAMS_H
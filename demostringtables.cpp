@@ -0,0 +1,191 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <algorithm>
+#include "demostringtables.h"
+
+/**
+ * Reads bits least significant first, reading past the end returns zeros and sets the overflow flag
+ */ 
+class CStringTableBitReader
+{
+public:
+	CStringTableBitReader( const void *pData, int size ) :
+		m_pData( ( const unsigned char * )pData ), m_nBits( ( size_t )size * 8 ), m_nPos( 0 ), m_bOverflowed( false ) {}
+
+	bool IsOverflowed() const	{ return m_bOverflowed; }
+
+	uint32 ReadUBits( int nBits )
+	{
+		if( m_nPos + nBits > m_nBits )
+		{
+			m_bOverflowed = true;
+			m_nPos = m_nBits;
+			return 0;
+		}
+
+		uint32 Value = 0;
+
+		for( int i = 0; i < nBits; )
+		{
+			int nBit = m_nPos & 7;
+			int nCount = std::min( 8 - nBit, nBits - i );
+
+			Value |= ( uint32 )( ( m_pData[ m_nPos >> 3 ] >> nBit ) & ( ( 1 << nCount ) - 1 ) ) << i;
+			m_nPos += nCount;
+			i += nCount;
+		}
+
+		return Value;
+	}
+
+	bool ReadOneBit()	{ return ReadUBits( 1 ) != 0; }
+
+	// Appends a NUL terminated string of at most nMaxLength characters
+	bool ReadString( std::string& str, size_t nMaxLength )
+	{
+		for( ;; )
+		{
+			char c = ( char )ReadUBits( 8 );
+
+			if( !c || m_bOverflowed )
+				return !m_bOverflowed;
+			if( str.size() >= nMaxLength )
+				return false;
+
+			str.push_back( c );
+		}
+	}
+
+	void ReadBits( std::string& data, int nBits )
+	{
+		if( ( size_t )nBits > m_nBits - m_nPos )
+		{
+			m_bOverflowed = true;
+			m_nPos = m_nBits;
+			return;
+		}
+
+		data.resize( ( nBits + 7 ) / 8 );
+
+		for( size_t i = 0; nBits > 0; i++, nBits -= 8 )
+			data[ i ] = ( char )ReadUBits( std::min( nBits, 8 ) );
+	}
+
+private:
+	const unsigned char *m_pData;
+	size_t m_nBits;
+	size_t m_nPos;
+	bool m_bOverflowed;
+};
+
+bool DecodeStringTableEntries( demo_string_table_info_t& Table, const void *pData, int size, int nEntries,
+	std::vector< demo_string_table_entry_t >& Entries )
+{
+	CStringTableBitReader reader( pData, size );
+	std::vector< std::string > history;
+	int nEntryBits = 0;
+	int lastEntry = -1;
+
+	Entries.clear();
+
+	if( nEntries <= 0 || Table.max_entries <= 0 )
+		return nEntries == 0;
+
+	while( Table.max_entries >> ( nEntryBits + 1 ) )
+		nEntryBits++;
+
+	// Dictionary encoded tables can't be decoded without the dictionary
+	if( reader.ReadOneBit() )
+		return false;
+
+	Entries.resize( nEntries );
+
+	for( int i = 0; i < nEntries; i++ )
+	{
+		demo_string_table_entry_t& Entry = Entries[ i ];
+
+		Entry.index = lastEntry + 1;
+		if( !reader.ReadOneBit() )
+			Entry.index = ( int )reader.ReadUBits( nEntryBits );
+
+		if( Entry.index < 0 || Entry.index >= Table.max_entries )
+			return false;
+		lastEntry = Entry.index;
+
+		Entry.bHaveStr = reader.ReadOneBit();
+		Entry.str.clear();
+
+		if( Entry.bHaveStr )
+		{
+			if( reader.ReadOneBit() )
+			{
+				// Starts like one of the last keys
+				uint32 nHistory = reader.ReadUBits( 5 );
+				uint32 nLength = reader.ReadUBits( 5 );
+
+				if( nHistory >= history.size() )
+					return false;
+
+				Entry.str.assign( history[ nHistory ], 0, nLength );
+			}
+
+			if( !reader.ReadString( Entry.str, STRINGTABLE_MAX_KEY_LENGTH ) )
+				return false;
+
+			if( Entry.index >= ( int )Table.keys.size() )
+				Table.keys.resize( Entry.index + 1 );
+			Table.keys[ Entry.index ] = Entry.str;
+		}
+
+		// Like the engine, an entry without a key puts its existing key in the history
+		if( history.size() >= STRINGTABLE_KEY_HISTORY_SIZE )
+			history.erase( history.begin() );
+		if( Entry.bHaveStr )
+			history.push_back( Entry.str );
+		else if( Entry.index < ( int )Table.keys.size() )
+			history.push_back( Table.keys[ Entry.index ] );
+		else
+			history.push_back( std::string() );
+
+		Entry.bHaveData = reader.ReadOneBit();
+		Entry.data.clear();
+
+		if( Entry.bHaveData )
+		{
+			int nBits = Table.user_data_fixed_size ? Table.user_data_size_bits :
+				( int )reader.ReadUBits( STRINGTABLE_USERDATA_SIZE_BITS ) * 8;
+
+			if( nBits < 0 )
+				return false;
+
+			reader.ReadBits( Entry.data, nBits );
+		}
+
+		if( reader.IsOverflowed() )
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,71 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef DEMOSTRINGTABLES_H
+#define DEMOSTRINGTABLES_H
+
+#include <string>
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Decodes the entries carried by svc_CreateStringTable and
+// svc_UpdateStringTable. The string_data of both is a bit stream, least
+// significant bit first, with one record per changed entry: its index (or
+// "the one after the last"), an optional key that may reuse the start of one
+// of the last 32 keys, and optional user data.
+//-----------------------------------------------------------------------------
+
+#define STRINGTABLE_KEY_HISTORY_SIZE	32
+#define STRINGTABLE_MAX_KEY_LENGTH		1024
+#define STRINGTABLE_USERDATA_SIZE_BITS	14		// variable size user data, byte count
+
+struct demo_string_table_entry_t
+{
+	int index;
+	bool bHaveStr;
+	bool bHaveData;
+	std::string str;
+	std::string data;
+};
+
+/**
+ * The part of svc_CreateStringTable needed to decode the table's entries, svc_UpdateStringTable
+ * refers to tables by the order they were created in. keys holds the table's current keys by
+ * index, an entry sent without a key puts its existing key in the key history.
+ */ 
+struct demo_string_table_info_t
+{
+	std::string name;
+	int max_entries;
+	bool user_data_fixed_size;
+	int user_data_size_bits;
+	std::vector< std::string > keys;
+};
+
+// Decodes nEntries entries from string_data and updates Table.keys, false if it is corrupt or uses dictionary encoding
+bool	DecodeStringTableEntries( demo_string_table_info_t& Table, const void *pData, int size, int nEntries,
+			std::vector< demo_string_table_entry_t >& Entries );
+
+#endif // DEMOSTRINGTABLES_H
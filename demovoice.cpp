@@ -0,0 +1,480 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "demovoice.h"
+#include "schemacache.h"
+
+#include "generated_proto/netmessages.pb.h"
+#include "generated_proto/flatdecoders.h"
+
+CDemoVoiceWriter::CDemoVoiceWriter()
+	: m_fp( NULL )
+	, m_nFileSize( 0 )
+	, m_bOk( false )
+{
+	memset( &m_Header, 0, sizeof( m_Header ) );
+}
+
+CDemoVoiceWriter::~CDemoVoiceWriter()
+{
+	if( m_fp )
+		fclose( m_fp );
+}
+
+bool CDemoVoiceWriter::Open( const char *filename )
+{
+	m_fp = fopen( filename, "wb" );
+	if( !m_fp )
+	{
+		fprintf( stderr, "CDemoVoiceWriter: couldn't create file %s.\n", filename );
+		return false;
+	}
+
+	// The chunks are written in one piece each, there's nothing for stdio to gather
+	setvbuf( m_fp, NULL, _IONBF, 0 );
+
+	memset( &m_Header, 0, sizeof( m_Header ) );
+	strcpy( m_Header.voicestamp, DEMOVOICE_HEADER_ID );
+	m_Header.version = DEMOVOICE_VERSION;
+
+	m_bOk = fwrite( &m_Header, sizeof( m_Header ), 1, m_fp ) == 1;
+	m_nFileSize = sizeof( m_Header );
+	return m_bOk;
+}
+
+void CDemoVoiceWriter::SetCodec( const std::string& codec, int quality )
+{
+	memset( m_Header.codec, 0, sizeof( m_Header.codec ) );
+	strncpy( m_Header.codec, codec.c_str(), sizeof( m_Header.codec ) - 1 );
+	m_Header.quality = quality;
+}
+
+/**
+ * Appends the packet to the track of its speaker, writing the track's chunk once it is full
+ */ 
+bool CDemoVoiceWriter::AddVoiceData( int tick, const CFlat_CSVCMsg_VoiceData& VoiceData )
+{
+	std::pair< int32, uint64 > Key( VoiceData.client(), VoiceData.xuid() );
+	std::map< std::pair< int32, uint64 >, int >::iterator it = m_trackIndex.find( Key );
+
+	if( it == m_trackIndex.end() )
+	{
+		track_t Track;
+
+		memset( &Track.Track, 0, sizeof( Track.Track ) );
+		Track.Track.xuid = VoiceData.xuid();
+		Track.Track.client = VoiceData.client();
+		Track.Track.first_tick = tick;
+		Track.nBufferedPackets = 0;
+
+		it = m_trackIndex.insert( std::make_pair( Key, ( int )m_tracks.size() ) ).first;
+		m_tracks.push_back( std::move( Track ) );
+	}
+
+	track_t& Track = m_tracks[ it->second ];
+	std::string_view data = VoiceData.voice_data();
+	demovoicepacket_t Packet;
+
+	Packet.tick = tick;
+	Packet.size = ( uint32 )data.size();
+	Packet.audible_mask = VoiceData.audible_mask();
+	Packet.proximity = VoiceData.proximity();
+
+	Track.packets.push_back( Packet );
+	Track.buffer.append( data.data(), data.size() );
+	Track.nBufferedPackets++;
+	Track.Track.last_tick = tick;
+	Track.Track.data_size += data.size();
+
+	if( Track.buffer.size() >= DEMOVOICE_CHUNK_SIZE )
+		return FlushTrack( Track );
+	return m_bOk;
+}
+
+bool CDemoVoiceWriter::FlushTrack( track_t& Track )
+{
+	if( !Track.nBufferedPackets )
+		return m_bOk;
+
+	demovoicechunk_t Chunk;
+
+	Chunk.offset = m_nFileSize;
+	Chunk.size = ( uint32 )Track.buffer.size();
+	Chunk.num_packets = Track.nBufferedPackets;
+
+	m_bOk = m_bOk && ( Track.buffer.empty() || fwrite( Track.buffer.data(), 1, Track.buffer.size(), m_fp ) == Track.buffer.size() );
+	m_nFileSize += Track.buffer.size();
+
+	Track.chunks.push_back( Chunk );
+	Track.buffer.clear();
+	Track.nBufferedPackets = 0;
+	return m_bOk;
+}
+
+/**
+ * Writes the rest of every track and the tables, then the header
+ */ 
+bool CDemoVoiceWriter::Close()
+{
+	if( !m_fp )
+		return false;
+
+	std::vector< demovoicetrack_t > tracks;
+	std::vector< demovoicechunk_t > chunks;
+	std::vector< demovoicepacket_t > packets;
+
+	for( size_t i = 0; i < m_tracks.size(); i++ )
+	{
+		track_t& Track = m_tracks[ i ];
+
+		FlushTrack( Track );
+		Track.buffer.shrink_to_fit();
+
+		Track.Track.first_chunk = ( uint32 )chunks.size();
+		Track.Track.num_chunks = ( uint32 )Track.chunks.size();
+		Track.Track.first_packet = ( uint32 )packets.size();
+		Track.Track.num_packets = ( uint32 )Track.packets.size();
+
+		tracks.push_back( Track.Track );
+		chunks.insert( chunks.end(), Track.chunks.begin(), Track.chunks.end() );
+		packets.insert( packets.end(), Track.packets.begin(), Track.packets.end() );
+	}
+
+	m_Header.num_tracks = ( uint32 )tracks.size();
+	m_Header.num_chunks = ( uint32 )chunks.size();
+	m_Header.num_packets = ( uint32 )packets.size();
+	m_Header.tables_offset = m_nFileSize;
+
+	bool bOk = m_bOk;
+	bOk = bOk && ( tracks.empty() || fwrite( tracks.data(), sizeof( demovoicetrack_t ), tracks.size(), m_fp ) == tracks.size() );
+	bOk = bOk && ( chunks.empty() || fwrite( chunks.data(), sizeof( demovoicechunk_t ), chunks.size(), m_fp ) == chunks.size() );
+	bOk = bOk && ( packets.empty() || fwrite( packets.data(), sizeof( demovoicepacket_t ), packets.size(), m_fp ) == packets.size() );
+	bOk = bOk && fseek( m_fp, 0, SEEK_SET ) == 0;
+	bOk = bOk && fwrite( &m_Header, sizeof( m_Header ), 1, m_fp ) == 1;
+	bOk = ( fclose( m_fp ) == 0 ) && bOk;
+
+	m_fp = NULL;
+	m_tracks.clear();
+	m_trackIndex.clear();
+
+	if( !bOk )
+	{
+		fprintf( stderr, "CDemoVoiceWriter: write failed.\n" );
+	}
+	return bOk;
+}
+
+CDemoVoiceFile::CDemoVoiceFile()
+	: m_fp( NULL )
+{
+	memset( &m_Header, 0, sizeof( m_Header ) );
+}
+
+CDemoVoiceFile::~CDemoVoiceFile()
+{
+	Close();
+}
+
+void CDemoVoiceFile::Close()
+{
+	if( m_fp )
+		fclose( m_fp );
+	m_fp = NULL;
+
+	m_tracks.clear();
+	m_chunks.clear();
+	m_packets.clear();
+}
+
+/**
+ * Reads the header and the tables, the chunks are read by ReadTrack()
+ */ 
+bool CDemoVoiceFile::Open( const char *filename )
+{
+	Close();
+
+	m_fp = fopen( filename, "rb" );
+	if( !m_fp )
+	{
+		fprintf( stderr, "CDemoVoiceFile: couldn't open file %s.\n", filename );
+		return false;
+	}
+
+	bool bOk = fread( &m_Header, sizeof( m_Header ), 1, m_fp ) == 1 &&
+		!memcmp( m_Header.voicestamp, DEMOVOICE_HEADER_ID, sizeof( m_Header.voicestamp ) ) && m_Header.version == DEMOVOICE_VERSION;
+
+	// Counts come from the file, the tables have to be what is after tables_offset before they are allocated
+	if( bOk )
+	{
+		fseek( m_fp, 0, SEEK_END );
+		uint64 nFileSize = ftell( m_fp );
+
+		uint64 nTablesSize = ( uint64 )m_Header.num_tracks * sizeof( demovoicetrack_t ) +
+			( uint64 )m_Header.num_chunks * sizeof( demovoicechunk_t ) + ( uint64 )m_Header.num_packets * sizeof( demovoicepacket_t );
+		bOk = m_Header.tables_offset >= sizeof( m_Header ) && m_Header.tables_offset <= nFileSize &&
+			nTablesSize == nFileSize - m_Header.tables_offset;
+	}
+
+	if( bOk )
+	{
+		m_tracks.resize( m_Header.num_tracks );
+		m_chunks.resize( m_Header.num_chunks );
+		m_packets.resize( m_Header.num_packets );
+
+		bOk = fseek( m_fp, ( long )m_Header.tables_offset, SEEK_SET ) == 0;
+		bOk = bOk && ( m_tracks.empty() || fread( m_tracks.data(), sizeof( demovoicetrack_t ), m_tracks.size(), m_fp ) == m_tracks.size() );
+		bOk = bOk && ( m_chunks.empty() || fread( m_chunks.data(), sizeof( demovoicechunk_t ), m_chunks.size(), m_fp ) == m_chunks.size() );
+		bOk = bOk && ( m_packets.empty() || fread( m_packets.data(), sizeof( demovoicepacket_t ), m_packets.size(), m_fp ) == m_packets.size() );
+	}
+
+	// The tables have to agree with each other before ReadTrack() can trust them
+	for( size_t i = 0; bOk && i < m_tracks.size(); i++ )
+	{
+		const demovoicetrack_t& Track = m_tracks[ i ];
+		uint64 nPackets = 0;
+		uint64 nDataSize = 0;
+
+		bOk = ( uint64 )Track.first_chunk + Track.num_chunks <= m_chunks.size() &&
+			( uint64 )Track.first_packet + Track.num_packets <= m_packets.size();
+
+		for( uint32 j = 0; bOk && j < Track.num_chunks; j++ )
+		{
+			const demovoicechunk_t& Chunk = m_chunks[ Track.first_chunk + j ];
+			uint64 nChunkSize = 0;
+
+			bOk = Chunk.offset + Chunk.size <= m_Header.tables_offset && nPackets + Chunk.num_packets <= Track.num_packets;
+			for( uint32 k = 0; bOk && k < Chunk.num_packets; k++ )
+				nChunkSize += m_packets[ Track.first_packet + nPackets + k ].size;
+
+			bOk = bOk && nChunkSize == Chunk.size;
+			nPackets += Chunk.num_packets;
+			nDataSize += Chunk.size;
+		}
+
+		// ReadTrack() allocates data_size up front, it can't be more than the chunks hold
+		bOk = bOk && nPackets == Track.num_packets && nDataSize == Track.data_size && nDataSize <= m_Header.tables_offset;
+	}
+
+	if( !bOk )
+	{
+		fprintf( stderr, "CDemoVoiceFile: %s is not a valid voice file.\n", filename );
+		Close();
+	}
+	return bOk;
+}
+
+bool CDemoVoiceFile::ReadTrack( int nTrack, std::vector< demovoicepacket_t >& packets, std::string& data )
+{
+	const demovoicetrack_t& Track = m_tracks[ nTrack ];
+
+	packets.assign( m_packets.begin() + Track.first_packet, m_packets.begin() + Track.first_packet + Track.num_packets );
+	data.resize( Track.data_size );
+
+	size_t nDataPos = 0;
+	bool bOk = true;
+
+	for( uint32 i = 0; bOk && i < Track.num_chunks; i++ )
+	{
+		const demovoicechunk_t& Chunk = m_chunks[ Track.first_chunk + i ];
+
+		bOk = nDataPos + Chunk.size <= data.size() && fseek( m_fp, ( long )Chunk.offset, SEEK_SET ) == 0 &&
+			( !Chunk.size || fread( &data[ nDataPos ], 1, Chunk.size, m_fp ) == Chunk.size );
+		nDataPos += Chunk.size;
+	}
+
+	return bOk && nDataPos == data.size();
+}
+
+/**
+ * Adds the voice data of a packet to the tracks
+ */ 
+static bool AddPacketVoice( CDemoVoiceWriter& Writer, const char *pData, int size, int tick )
+{
+	CFlatReader reader( pData, size );
+	bool bOk = true;
+
+	while( bOk && !reader.AtEnd() )
+	{
+		uint64_t Cmd;
+		std::string_view msg;
+
+		if( !reader.ReadVarint64( &Cmd ) || !reader.ReadBytes( &msg ) )
+			break;
+
+		if( Cmd == svc_VoiceData )
+		{
+			CFlat_CSVCMsg_VoiceData VoiceData;
+
+			if( VoiceData.Decode( msg.data(), ( int )msg.size() ) )
+				bOk = Writer.AddVoiceData( tick, VoiceData );
+		}
+		else if( Cmd == svc_VoiceInit )
+		{
+			CSVCMsg_VoiceInit VoiceInit;
+
+			if( VoiceInit.ParseFromArray( msg.data(), ( int )msg.size() ) )
+				Writer.SetCodec( VoiceInit.codec(), VoiceInit.quality() );
+		}
+	}
+
+	return bOk;
+}
+
+bool ExtractDemoVoice( const char *filename, const char *outname )
+{
+	CDemoFile demofile;
+	CDemoVoiceWriter Writer;
+
+	if( !demofile.Open( filename ) || !Writer.Open( outname ) )
+		return false;
+
+	bool bOk = true;
+
+	while( bOk && !demofile.IsDone() )
+	{
+		int tick = 0;
+		bool bCompressed;
+		bool bFrameOk = false;
+		size_t nFramePos = demofile.GetPos();
+		const char *pData;
+		int DataSize;
+
+		EDemoCommands DemoCommand = demofile.ReadMessageType( &tick, &bCompressed );
+
+		switch( DemoCommand )
+		{
+		case DEM_Packet:
+		case DEM_SignonPacket:
+			{
+				CFlat_CDemoPacket Packet;
+
+				bFrameOk = demofile.ReadMessageData( bCompressed, &pData, &DataSize ) && Packet.Decode( pData, DataSize );
+				if( bFrameOk )
+					bOk = AddPacketVoice( Writer, Packet.data().data(), ( int )Packet.data().size(), tick );
+			}
+			break;
+
+		case DEM_FullPacket:
+			{
+				StringTableList_t Tables;
+				CDemoPacket Packet;
+
+				bFrameOk = demofile.ReadMessageData( bCompressed, &pData, &DataSize ) && ParseFullPacketInterned( pData, DataSize, Tables, Packet );
+				if( bFrameOk )
+					bOk = AddPacketVoice( Writer, Packet.data().data(), ( int )Packet.data().size(), tick );
+			}
+			break;
+
+		case DEM_Error:
+			break;
+
+		default:
+			bFrameOk = demofile.ReadRawMessage( NULL, NULL );
+			break;
+		}
+
+		if( !bFrameOk && !demofile.Resync( nFramePos ) )
+			break;
+	}
+
+	int nTracks = Writer.GetTrackCount();
+	bOk = Writer.Close() && bOk;
+
+	fprintf( stderr, "%s: %d voice tracks.\n", filename, nTracks );
+	return bOk;
+}
+
+/**
+ * Without xuid prints the tracks. Otherwise writes the packets of that player to outname, each as its
+ * demovoicepacket_t followed by the encoded voice data.
+ */ 
+bool DumpDemoVoiceTrack( const char *filename, const char *xuid, const char *outname )
+{
+	CDemoVoiceFile VoiceFile;
+
+	if( !VoiceFile.Open( filename ) )
+		return false;
+
+	if( !xuid )
+	{
+		const demovoiceheader_t& Header = VoiceFile.GetHeader();
+
+		printf( "codec: %.*s quality: %d\n", DEMOVOICE_MAX_CODEC, Header.codec, Header.quality );
+		for( int i = 0; i < VoiceFile.GetTrackCount(); i++ )
+		{
+			const demovoicetrack_t& Track = VoiceFile.GetTrack( i );
+
+			printf( "xuid: %llu client: %d ticks: %d-%d packets: %u bytes: %llu\n", ( unsigned long long )Track.xuid, Track.client,
+				Track.first_tick, Track.last_tick, Track.num_packets, ( unsigned long long )Track.data_size );
+		}
+		return true;
+	}
+
+	// A player that got another client slot has a track for each, they are written in order
+	uint64 nXuid = strtoull( xuid, NULL, 10 );
+	std::vector< demovoicepacket_t > packets;
+	std::string data;
+	std::string out;
+	bool bFound = false;
+
+	for( int i = 0; i < VoiceFile.GetTrackCount(); i++ )
+	{
+		if( VoiceFile.GetTrack( i ).xuid != nXuid )
+			continue;
+
+		if( !VoiceFile.ReadTrack( i, packets, data ) )
+		{
+			fprintf( stderr, "Couldn't read track %d of %s.\n", i, filename );
+			return false;
+		}
+
+		size_t nDataPos = 0;
+		for( size_t j = 0; j < packets.size(); j++ )
+		{
+			out.append( ( const char * )&packets[ j ], sizeof( demovoicepacket_t ) );
+			out.append( data, nDataPos, packets[ j ].size );
+			nDataPos += packets[ j ].size;
+		}
+		bFound = true;
+	}
+
+	if( !bFound )
+	{
+		fprintf( stderr, "No voice track for xuid %s in %s.\n", xuid, filename );
+		return false;
+	}
+
+	FILE *fp = fopen( outname, "wb" );
+	bool bOk = fp && fwrite( out.data(), 1, out.size(), fp ) == out.size();
+
+	if( fp )
+		bOk = ( fclose( fp ) == 0 ) && bOk;
+	if( !bOk )
+		fprintf( stderr, "Couldn't write %s.\n", outname );
+	return bOk;
+}
@@ -0,0 +1,162 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+
+#ifndef DEMOVOICE_H
+#define DEMOVOICE_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "demofile.h"
+
+//-----------------------------------------------------------------------------
+// Voice tracks. The svc_VoiceData payloads of a demo are copied, still
+// encoded, into one track per speaker with the tick of every packet, so a
+// single player's voice can be read without parsing the demo again.
+//
+// Every track collects its packets in memory and writes them out as one
+// chunk once there are DEMOVOICE_CHUNK_SIZE bytes. The track, chunk and
+// packet tables follow the chunks at the end of the file, the header is
+// rewritten last with where they are.
+//-----------------------------------------------------------------------------
+
+#define DEMOVOICE_HEADER_ID			"DEMOVOX"
+#define DEMOVOICE_VERSION			1
+#define DEMOVOICE_CHUNK_SIZE		( 256 * 1024 )
+#define DEMOVOICE_MAX_CODEC			32
+
+struct demovoiceheader_t
+{
+	char voicestamp[ 8 ];		// DEMOVOICE_HEADER_ID
+	int32 version;
+	int32 quality;				// from svc_VoiceInit
+	char codec[ DEMOVOICE_MAX_CODEC ];
+
+	uint32 num_tracks;			// demovoicetrack_t
+	uint32 num_chunks;			// demovoicechunk_t
+	uint32 num_packets;			// demovoicepacket_t
+	uint64 tables_offset;		// the three tables, one after the other
+};
+
+// The packets of a track are num_packets entries of the packet table from
+// first_packet on, and their data is in the chunks from first_chunk on
+struct demovoicetrack_t
+{
+	uint64 xuid;
+	int32 client;
+	int32 first_tick;
+	int32 last_tick;
+	uint32 first_chunk;
+	uint32 num_chunks;
+	uint32 first_packet;
+	uint32 num_packets;
+	uint64 data_size;
+};
+
+struct demovoicechunk_t
+{
+	uint64 offset;				// in the file
+	uint32 size;
+	uint32 num_packets;			// the next num_packets packets of the track, their data is back to back
+};
+
+struct demovoicepacket_t
+{
+	int32 tick;
+	uint32 size;
+	int32 audible_mask;
+	uint32 proximity;
+};
+
+struct CFlat_CSVCMsg_VoiceData;
+
+class CDemoVoiceWriter
+{
+public:
+	CDemoVoiceWriter();
+	~CDemoVoiceWriter();
+
+	bool	Open( const char *filename );
+	bool	Close();
+
+	void	SetCodec( const std::string& codec, int quality );
+	bool	AddVoiceData( int tick, const CFlat_CSVCMsg_VoiceData& VoiceData );
+
+	int		GetTrackCount() const			{ return ( int )m_tracks.size(); }
+
+private:
+	struct track_t
+	{
+		demovoicetrack_t Track;
+		std::string buffer;					// packets that aren't in a chunk yet
+		uint32 nBufferedPackets;
+		std::vector< demovoicechunk_t > chunks;
+		std::vector< demovoicepacket_t > packets;
+	};
+
+	bool	FlushTrack( track_t& Track );
+
+	FILE *m_fp;
+	uint64 m_nFileSize;
+	bool m_bOk;
+	demovoiceheader_t m_Header;
+
+	std::vector< track_t > m_tracks;
+	std::map< std::pair< int32, uint64 >, int > m_trackIndex;	// by client and xuid
+};
+
+class CDemoVoiceFile
+{
+public:
+	CDemoVoiceFile();
+	~CDemoVoiceFile();
+
+	bool	Open( const char *filename );
+	void	Close();
+
+	const demovoiceheader_t& GetHeader() const		{ return m_Header; }
+	int		GetTrackCount() const					{ return ( int )m_tracks.size(); }
+	const demovoicetrack_t& GetTrack( int nTrack ) const	{ return m_tracks[ nTrack ]; }
+
+	// Reads the packets of a track, their data is back to back in data
+	bool	ReadTrack( int nTrack, std::vector< demovoicepacket_t >& packets, std::string& data );
+
+private:
+	FILE *m_fp;
+	demovoiceheader_t m_Header;
+	std::vector< demovoicetrack_t > m_tracks;
+	std::vector< demovoicechunk_t > m_chunks;
+	std::vector< demovoicepacket_t > m_packets;
+};
+
+// The -voice mode, writes the voice tracks of a demo to outname
+bool	ExtractDemoVoice( const char *filename, const char *outname );
+
+// The -voicetrack mode, lists the tracks or writes one player's packets to outname
+bool	DumpDemoVoiceTrack( const char *filename, const char *xuid, const char *outname );
+
+#endif // DEMOVOICE_H
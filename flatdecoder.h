@@ -0,0 +1,194 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef FLATDECODER_H
+#define FLATDECODER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+//-----------------------------------------------------------------------------
+// Support code for the decoders in generated_proto/flatdecoders.h, which are
+// generated by tools/flatdecgen from the .proto files.
+//
+// A flat decoder fills a plain struct straight from the wire format: strings
+// and bytes are string_views into the caller's buffer, repeated fields live
+// in fixed size inline arrays, nothing is allocated. The buffer has to
+// outlive the struct. Decode() returns false for data it can't represent
+// (malformed input, missing required fields, more repeated elements than fit
+// inline); callers then fall back to the libprotobuf classes.
+//-----------------------------------------------------------------------------
+
+/**
+ * Inline array with room for N elements
+ */ 
+template < class T, int N >
+class CFlatRepeated
+{
+public:
+	CFlatRepeated() : m_nCount( 0 ) {}
+
+	void		Clear()						{ m_nCount = 0; }
+	int			size() const				{ return m_nCount; }
+	const T&	operator[]( int i ) const	{ return m_elements[ i ]; }
+	T&			operator[]( int i )			{ return m_elements[ i ]; }
+
+	// Returns NULL when full
+	T *Add()
+	{
+		return ( m_nCount < N ) ? &m_elements[ m_nCount++ ] : NULL;
+	}
+
+private:
+	int m_nCount;
+	T m_elements[ N ];
+};
+
+/**
+ * Reads the protobuf wire format from a buffer, every method returns false if the data is bad
+ */ 
+class CFlatReader
+{
+public:
+	CFlatReader( const char *pData, int size ) :
+		m_pPos( ( const unsigned char * )pData ), m_pEnd( ( const unsigned char * )pData + size ) {}
+
+	bool AtEnd() const { return m_pPos >= m_pEnd; }
+
+	bool ReadVarint64( uint64_t *pValue )
+	{
+		uint64_t result = 0;
+
+		for( int shift = 0; shift < 64; shift += 7 )
+		{
+			if( m_pPos >= m_pEnd )
+				return false;
+
+			uint64_t b = *m_pPos++;
+			result |= ( b & 0x7F ) << shift;
+
+			if( !( b & 0x80 ) )
+			{
+				*pValue = result;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Tags are at most 5 bytes, extra bits in the last one are dropped the same way libprotobuf does
+	bool ReadTag( uint32_t *pTag )
+	{
+		// Fast path for the one byte tags that make up most of the data
+		if( m_pPos < m_pEnd && !( *m_pPos & 0x80 ) )
+		{
+			*pTag = *m_pPos++;
+			return true;
+		}
+
+		uint32_t result = 0;
+
+		for( int shift = 0; shift < 35; shift += 7 )
+		{
+			if( m_pPos >= m_pEnd )
+				return false;
+
+			uint32_t b = *m_pPos++;
+			result |= ( b & 0x7F ) << shift;
+
+			if( !( b & 0x80 ) )
+			{
+				*pTag = result;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool ReadFixed32( uint32_t *pValue )
+	{
+		if( m_pEnd - m_pPos < 4 )
+			return false;
+
+		memcpy( pValue, m_pPos, 4 );
+		m_pPos += 4;
+		return true;
+	}
+
+	bool ReadFixed64( uint64_t *pValue )
+	{
+		if( m_pEnd - m_pPos < 8 )
+			return false;
+
+		memcpy( pValue, m_pPos, 8 );
+		m_pPos += 8;
+		return true;
+	}
+
+	bool ReadBytes( std::string_view *pValue )
+	{
+		uint64_t size;
+
+		if( !ReadVarint64( &size ) || size > ( uint64_t )( m_pEnd - m_pPos ) )
+			return false;
+
+		*pValue = std::string_view( ( const char * )m_pPos, size );
+		m_pPos += size;
+		return true;
+	}
+
+	bool SkipField( uint32_t tag )
+	{
+		uint64_t value;
+		std::string_view bytes;
+
+		switch( tag & 7 )
+		{
+		case 0:		return ReadVarint64( &value );
+		case 1:		return ReadFixed64( &value );
+		case 2:		return ReadBytes( &bytes );
+		case 5:		{ uint32_t fixed; return ReadFixed32( &fixed ); }
+		default:	return false;	// groups aren't used by any of our protos
+		}
+	}
+
+private:
+	const unsigned char *m_pPos;
+	const unsigned char *m_pEnd;
+};
+
+inline int32_t FlatZigZagDecode32( uint32_t n ) { return ( int32_t )( ( n >> 1 ) ^ ( ~( n & 1 ) + 1 ) ); }
+inline int64_t FlatZigZagDecode64( uint64_t n ) { return ( int64_t )( ( n >> 1 ) ^ ( ~( n & 1 ) + 1 ) ); }
+
+inline float FlatFloatFromBits( uint32_t bits ) { float f; memcpy( &f, &bits, sizeof( f ) ); return f; }
+inline double FlatDoubleFromBits( uint64_t bits ) { double d; memcpy( &d, &bits, sizeof( d ) ); return d; }
+
+// Compares floating point values bit for bit, which is what "decoded the same" means here
+inline bool FlatSameBits( float a, float b ) { return !memcmp( &a, &b, sizeof( a ) ); }
+inline bool FlatSameBits( double a, double b ) { return !memcmp( &a, &b, sizeof( a ) ); }
+
+#endif // FLATDECODER_H
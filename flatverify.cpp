@@ -0,0 +1,200 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <stdio.h>
+#include <chrono>
+#include "demofile.h"
+#include "flatverify.h"
+#include "generated_proto/flatdecoders.h"
+
+// Each corpus is decoded this many times for the timings
+#define FLATVERIFY_TIMING_PASSES	10
+
+struct flatverify_corpus_t
+{
+	std::vector< std::string > GameEvents;
+	std::vector< std::string > UserMessages;
+	std::vector< std::string > CombatLogData;
+	std::vector< std::string > PacketEntities;
+};
+
+/**
+ * Splits a packet into its net messages and keeps the ones the flat decoders handle
+ */ 
+static void CollectPacket( const std::string& buf, flatverify_corpus_t& Corpus )
+{
+	size_t index = 0;
+
+	while( index < buf.size() )
+	{
+		bool bError = false;
+		int Cmd = ReadVarInt32( buf, index, &bError );
+		uint32 Size = ReadVarInt32( buf, index, &bError );
+
+		if( bError || Size > buf.size() - index )
+			return;
+
+		std::string msg = buf.substr( index, Size );
+		index += Size;
+
+		if( Cmd == svc_GameEvent )
+		{
+			Corpus.GameEvents.push_back( msg );
+		}
+		else if( Cmd == svc_PacketEntities )
+		{
+			Corpus.PacketEntities.push_back( msg );
+		}
+		else if( Cmd == svc_UserMessage )
+		{
+			CSVCMsg_UserMessage userMessage;
+
+			if( userMessage.ParseFromString( msg ) && userMessage.msg_type() == DOTA_UM_CombatLogData )
+				Corpus.CombatLogData.push_back( userMessage.msg_data() );
+
+			Corpus.UserMessages.push_back( msg );
+		}
+	}
+}
+
+static bool CollectDemo( const char *filename, flatverify_corpus_t& Corpus )
+{
+	CDemoFile DemoFile;
+
+	if( !DemoFile.Open( filename ) )
+	{
+		fprintf( stderr, "Couldn't open '%s'\n", filename );
+		return false;
+	}
+
+	while( !DemoFile.IsDone() )
+	{
+		int tick = 0;
+		bool bCompressed;
+		EDemoCommands DemoCommand = DemoFile.ReadMessageType( &tick, &bCompressed );
+
+		if( DemoCommand == DEM_Error )
+			break;
+
+		if( DemoCommand == DEM_Packet || DemoCommand == DEM_SignonPacket )
+		{
+			CDemoPacket_t Packet;
+
+			if( DemoFile.ReadMessage( &Packet, bCompressed ) )
+				CollectPacket( Packet.data(), Corpus );
+		}
+		else if( DemoCommand == DEM_FullPacket )
+		{
+			CDemoFullPacket_t FullPacket;
+
+			if( DemoFile.ReadMessage( &FullPacket, bCompressed ) )
+				CollectPacket( FullPacket.packet().data(), Corpus );
+		}
+		else if( !DemoFile.ReadRawMessage( NULL, NULL ) )
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Compares both decoders on one corpus, messages the flat decoder can't hold count as fallbacks
+ */ 
+template < class TFlat, class TMsg >
+static bool VerifyCorpus( const std::vector< std::string >& Corpus )
+{
+	TFlat flat;
+	TMsg msg;
+	int nMismatches = 0;
+	int nFallbacks = 0;
+	size_t nBytes = 0;
+
+	for( size_t i = 0; i < Corpus.size(); i++ )
+	{
+		const std::string& buf = Corpus[ i ];
+		bool bFlatOk = flat.Decode( buf.data(), ( int )buf.size() );
+		bool bMsgOk = msg.ParseFromString( buf );
+
+		nBytes += buf.size();
+
+		if( bFlatOk && bMsgOk && !FlatEquals( flat, msg ) )
+		{
+			nMismatches++;
+		}
+		else if( bFlatOk != bMsgOk )
+		{
+			if( bMsgOk )
+				nFallbacks++;
+			else
+				nMismatches++;
+		}
+	}
+
+	// Both decoders reuse their object between messages, which is how the dump uses them
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for( int pass = 0; pass < FLATVERIFY_TIMING_PASSES; pass++ )
+	{
+		for( size_t i = 0; i < Corpus.size(); i++ )
+			flat.Decode( Corpus[ i ].data(), ( int )Corpus[ i ].size() );
+	}
+
+	std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+	for( int pass = 0; pass < FLATVERIFY_TIMING_PASSES; pass++ )
+	{
+		for( size_t i = 0; i < Corpus.size(); i++ )
+			msg.ParseFromString( Corpus[ i ] );
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	double flatMs = std::chrono::duration< double, std::milli >( mid - start ).count();
+	double msgMs = std::chrono::duration< double, std::milli >( end - mid ).count();
+
+	printf( "%-28s %8d msgs %10zu bytes %6d mismatches %5d fallbacks  flat %8.2f ms  libprotobuf %8.2f ms  %5.1fx\n",
+		msg.GetTypeName().c_str(), ( int )Corpus.size(), nBytes, nMismatches, nFallbacks,
+		flatMs, msgMs, flatMs > 0.0 ? msgMs / flatMs : 0.0 );
+
+	return nMismatches == 0;
+}
+
+bool VerifyFlatDecoders( int nFiles, char **ppFiles )
+{
+	flatverify_corpus_t Corpus;
+
+	for( int i = 0; i < nFiles; i++ )
+	{
+		if( !CollectDemo( ppFiles[ i ], Corpus ) )
+			return false;
+	}
+
+	printf( "Timings are for %d passes over each corpus\n", FLATVERIFY_TIMING_PASSES );
+
+	bool bOk = VerifyCorpus< CFlat_CSVCMsg_GameEvent, CSVCMsg_GameEvent >( Corpus.GameEvents );
+	bOk &= VerifyCorpus< CFlat_CSVCMsg_UserMessage, CSVCMsg_UserMessage >( Corpus.UserMessages );
+	bOk &= VerifyCorpus< CFlat_CDOTAUserMsg_CombatLogData, CDOTAUserMsg_CombatLogData >( Corpus.CombatLogData );
+	bOk &= VerifyCorpus< CFlat_CSVCMsg_PacketEntities, CSVCMsg_PacketEntities >( Corpus.PacketEntities );
+
+	return bOk;
+}
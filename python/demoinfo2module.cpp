@@ -0,0 +1,432 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+//-----------------------------------------------------------------------------
+// demoinfo2 Python module
+//
+//   import demoinfo2, numpy
+//   replay = demoinfo2.load( "match.dem" )
+//   ticks = numpy.asarray( replay[ "combat_log" ][ "tick" ] )
+//
+// load() parses the demo with CDemoStreams without holding the GIL and
+// returns a dict of streams, each a dict of columns (see demostreams.h). A
+// column exports its std::vector through the buffer protocol with the right
+// item format, so numpy.asarray(), memoryview() and pyarrow.py_buffer() all
+// use the C++ memory directly. Columns keep the parsed demo alive.
+//-----------------------------------------------------------------------------
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "../demostreams.h"
+
+/**
+ * Owns the parsed demo that the columns point into
+ */ 
+struct ReplayObject
+{
+	PyObject_HEAD
+	CDemoStreams *pStreams;
+};
+
+static void Replay_dealloc( ReplayObject *self )
+{
+	delete self->pStreams;
+	Py_TYPE( self )->tp_free( ( PyObject * )self );
+}
+
+static PyTypeObject ReplayType = { PyVarObject_HEAD_INIT( NULL, 0 ) };
+
+/**
+ * Read only, one dimensional view of a column
+ */ 
+struct ColumnObject
+{
+	PyObject_HEAD
+	PyObject *pOwner;
+	const void *pData;
+	Py_ssize_t count;
+	Py_ssize_t itemsize;
+	const char *format;
+};
+
+static void Column_dealloc( ColumnObject *self )
+{
+	Py_XDECREF( self->pOwner );
+	Py_TYPE( self )->tp_free( ( PyObject * )self );
+}
+
+static Py_ssize_t Column_length( ColumnObject *self )
+{
+	return self->count;
+}
+
+static int Column_getbuffer( ColumnObject *self, Py_buffer *view, int flags )
+{
+	if( flags & PyBUF_WRITABLE )
+	{
+		PyErr_SetString( PyExc_BufferError, "demoinfo2 columns are read only" );
+		view->obj = NULL;
+		return -1;
+	}
+
+	view->buf = ( void * )self->pData;
+	view->obj = ( PyObject * )self;
+	view->len = self->count * self->itemsize;
+	view->readonly = 1;
+	view->itemsize = self->itemsize;
+	view->format = ( flags & PyBUF_FORMAT ) ? ( char * )self->format : NULL;
+	view->ndim = 1;
+	view->shape = ( flags & PyBUF_ND ) ? &self->count : NULL;
+	view->strides = ( flags & PyBUF_STRIDES ) == PyBUF_STRIDES ? &self->itemsize : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	Py_INCREF( self );
+	return 0;
+}
+
+static PySequenceMethods ColumnSequenceMethods = { ( lenfunc )Column_length };
+static PyBufferProcs ColumnBufferProcs = { ( getbufferproc )Column_getbuffer, NULL };
+static PyTypeObject ColumnType = { PyVarObject_HEAD_INIT( NULL, 0 ) };
+
+template < class T > const char *GetColumnFormat();
+template <> const char *GetColumnFormat< uint8_t >()	{ return "B"; }
+template <> const char *GetColumnFormat< int32 >()		{ return "i"; }
+template <> const char *GetColumnFormat< uint32 >()		{ return "I"; }
+template <> const char *GetColumnFormat< int64_t >()	{ return "q"; }
+template <> const char *GetColumnFormat< uint64 >()		{ return "Q"; }
+template <> const char *GetColumnFormat< float >()		{ return "f"; }
+
+/**
+ * Adds a column for data to dict, returns false with a Python error set on failure
+ */ 
+static bool AddColumn( PyObject *dict, const char *name, PyObject *pOwner, const void *pData, size_t count, size_t itemsize, const char *format )
+{
+	// Empty vectors have no storage, but a buffer needs a valid pointer
+	static const uint64 s_empty = 0;
+
+	ColumnObject *pColumn = PyObject_New( ColumnObject, &ColumnType );
+	if( !pColumn )
+		return false;
+
+	Py_INCREF( pOwner );
+	pColumn->pOwner = pOwner;
+	pColumn->pData = count ? pData : &s_empty;
+	pColumn->count = count;
+	pColumn->itemsize = itemsize;
+	pColumn->format = format;
+
+	int result = PyDict_SetItemString( dict, name, ( PyObject * )pColumn );
+	Py_DECREF( pColumn );
+	return result == 0;
+}
+
+template < class T >
+static bool AddColumn( PyObject *dict, const char *name, PyObject *pOwner, const std::vector< T >& column )
+{
+	return AddColumn( dict, name, pOwner, column.data(), column.size(), sizeof( T ), GetColumnFormat< T >() );
+}
+
+/**
+ * Adds a new dict for a stream to replay, returns it as a borrowed reference
+ */ 
+static PyObject *AddStream( PyObject *replay, const char *name )
+{
+	PyObject *dict = PyDict_New();
+
+	if( !dict || PyDict_SetItemString( replay, name, dict ) )
+	{
+		Py_XDECREF( dict );
+		return NULL;
+	}
+
+	Py_DECREF( dict );
+	return dict;
+}
+
+#define ADD_COLUMN( _stream, _field )	if( !AddColumn( pStream, #_field, pOwner, Streams._stream._field ) ) return false
+
+static bool BuildStreams( PyObject *replay, PyObject *pOwner, const demo_streams_t& Streams )
+{
+	PyObject *pStream;
+
+	if( !( pStream = AddStream( replay, "frames" ) ) )
+		return false;
+	ADD_COLUMN( frames, tick );
+	ADD_COLUMN( frames, command );
+	ADD_COLUMN( frames, offset );
+	ADD_COLUMN( frames, size );
+
+	if( !( pStream = AddStream( replay, "game_events" ) ) )
+		return false;
+	ADD_COLUMN( game_events, tick );
+	ADD_COLUMN( game_events, eventid );
+	ADD_COLUMN( game_events, first_key );
+	ADD_COLUMN( game_events, num_keys );
+
+	if( !( pStream = AddStream( replay, "game_event_keys" ) ) )
+		return false;
+	ADD_COLUMN( game_event_keys, type );
+	ADD_COLUMN( game_event_keys, val_int );
+	ADD_COLUMN( game_event_keys, val_float );
+	ADD_COLUMN( game_event_keys, str_offset );
+	ADD_COLUMN( game_event_keys, str_length );
+
+	if( !( pStream = AddStream( replay, "combat_log" ) ) )
+		return false;
+	ADD_COLUMN( combat_log, tick );
+	ADD_COLUMN( combat_log, type );
+	ADD_COLUMN( combat_log, target_name );
+	ADD_COLUMN( combat_log, attacker_name );
+	ADD_COLUMN( combat_log, inflictor_name );
+	ADD_COLUMN( combat_log, attacker_illusion );
+	ADD_COLUMN( combat_log, target_illusion );
+	ADD_COLUMN( combat_log, value );
+	ADD_COLUMN( combat_log, health );
+	ADD_COLUMN( combat_log, time );
+
+	if( !( pStream = AddStream( replay, "hero_positions" ) ) )
+		return false;
+	ADD_COLUMN( hero_positions, tick );
+	ADD_COLUMN( hero_positions, index );
+	ADD_COLUMN( hero_positions, time );
+	ADD_COLUMN( hero_positions, x );
+	ADD_COLUMN( hero_positions, y );
+	ADD_COLUMN( hero_positions, health );
+
+	if( !( pStream = AddStream( replay, "modifiers" ) ) )
+		return false;
+	ADD_COLUMN( modifiers, parent );
+	ADD_COLUMN( modifiers, name );
+	ADD_COLUMN( modifiers, start_tick );
+	ADD_COLUMN( modifiers, end_tick );
+	ADD_COLUMN( modifiers, max_end_tick );
+	ADD_COLUMN( modifiers, serial_num );
+	ADD_COLUMN( modifiers, caster );
+	ADD_COLUMN( modifiers, ability );
+	ADD_COLUMN( modifiers, ability_level );
+	ADD_COLUMN( modifiers, stack_count );
+	ADD_COLUMN( modifiers, creation_time );
+	ADD_COLUMN( modifiers, duration );
+
+	if( !( pStream = AddStream( replay, "particles" ) ) )
+		return false;
+	ADD_COLUMN( particles, index );
+	ADD_COLUMN( particles, name );
+	ADD_COLUMN( particles, entity_handle );
+	ADD_COLUMN( particles, attach_type );
+	ADD_COLUMN( particles, start_tick );
+	ADD_COLUMN( particles, destroy_tick );
+	ADD_COLUMN( particles, end_tick );
+	ADD_COLUMN( particles, destroy_immediately );
+	ADD_COLUMN( particles, num_updates );
+	ADD_COLUMN( particles, control_points );
+	ADD_COLUMN( particles, origin_cp );
+	ADD_COLUMN( particles, origin_x );
+	ADD_COLUMN( particles, origin_y );
+	ADD_COLUMN( particles, origin_z );
+
+	if( !( pStream = AddStream( replay, "projectiles" ) ) )
+		return false;
+	ADD_COLUMN( projectiles, handle );
+	ADD_COLUMN( projectiles, entindex );
+	ADD_COLUMN( projectiles, particle_index );
+	ADD_COLUMN( projectiles, start_tick );
+	ADD_COLUMN( projectiles, end_tick );
+	ADD_COLUMN( projectiles, destroyed );
+	ADD_COLUMN( projectiles, latency );
+	ADD_COLUMN( projectiles, origin_x );
+	ADD_COLUMN( projectiles, origin_y );
+	ADD_COLUMN( projectiles, origin_z );
+	ADD_COLUMN( projectiles, velocity_x );
+	ADD_COLUMN( projectiles, velocity_y );
+
+	if( !( pStream = AddStream( replay, "projectile_dodges" ) ) )
+		return false;
+	ADD_COLUMN( projectile_dodges, tick );
+	ADD_COLUMN( projectile_dodges, entindex );
+
+	if( !AddColumn( replay, "game_event_strings", pOwner, Streams.game_event_strings.data(),
+		Streams.game_event_strings.size(), 1, GetColumnFormat< uint8_t >() ) )
+		return false;
+
+	return true;
+}
+
+#undef ADD_COLUMN
+
+static bool AddNameList( PyObject *replay, const char *key, const std::vector< std::string >& Names )
+{
+	PyObject *pNames = PyList_New( Names.size() );
+
+	if( !pNames )
+		return false;
+
+	for( size_t i = 0; i < Names.size(); i++ )
+	{
+		PyObject *pName = PyUnicode_DecodeUTF8( Names[ i ].data(), Names[ i ].size(), "replace" );
+
+		if( !pName )
+		{
+			Py_DECREF( pNames );
+			return false;
+		}
+		PyList_SET_ITEM( pNames, i, pName );
+	}
+
+	int result = PyDict_SetItemString( replay, key, pNames );
+	Py_DECREF( pNames );
+	return result == 0;
+}
+
+/**
+ * The small lookup tables are plain Python objects
+ */ 
+static bool BuildNames( PyObject *replay, const demo_streams_t& Streams )
+{
+	if( !AddNameList( replay, "combat_log_names", Streams.combat_log_names ) ||
+		!AddNameList( replay, "modifier_names", Streams.modifier_names ) ||
+		!AddNameList( replay, "particle_names", Streams.particle_names ) )
+		return false;
+
+	// eventid -> ( name, [ key names ] )
+	PyObject *pEvents = PyDict_New();
+
+	if( !pEvents )
+		return false;
+
+	if( Streams.pGameEventSchema )
+	{
+		const CSVCMsg_GameEventList& List = Streams.pGameEventSchema->m_GameEventList;
+
+		for( int i = 0; i < List.descriptors_size(); i++ )
+		{
+			const CSVCMsg_GameEventList::descriptor_t& Descriptor = List.descriptors( i );
+			PyObject *pKeys = PyList_New( Descriptor.keys_size() );
+
+			for( int j = 0; pKeys && j < Descriptor.keys_size(); j++ )
+			{
+				PyObject *pKeyName = PyUnicode_DecodeUTF8( Descriptor.keys( j ).name().data(), Descriptor.keys( j ).name().size(), "replace" );
+
+				if( !pKeyName )
+				{
+					Py_DECREF( pKeys );
+					pKeys = NULL;
+					break;
+				}
+				PyList_SET_ITEM( pKeys, j, pKeyName );
+			}
+
+			PyObject *pValue = pKeys ? Py_BuildValue( "(s#N)", Descriptor.name().data(), ( Py_ssize_t )Descriptor.name().size(), pKeys ) : NULL;
+			PyObject *pKey = PyLong_FromLong( Descriptor.eventid() );
+
+			if( !pValue || !pKey || PyDict_SetItem( pEvents, pKey, pValue ) )
+			{
+				Py_XDECREF( pKey );
+				Py_XDECREF( pValue );
+				Py_DECREF( pEvents );
+				return false;
+			}
+
+			Py_DECREF( pKey );
+			Py_DECREF( pValue );
+		}
+	}
+
+	int result = PyDict_SetItemString( replay, "game_event_names", pEvents );
+	Py_DECREF( pEvents );
+	return result == 0;
+}
+
+static PyObject *demoinfo2_load( PyObject *module, PyObject *args )
+{
+	const char *filename;
+
+	if( !PyArg_ParseTuple( args, "s:load", &filename ) )
+		return NULL;
+
+	ReplayObject *pOwner = PyObject_New( ReplayObject, &ReplayType );
+	if( !pOwner )
+		return NULL;
+
+	pOwner->pStreams = new CDemoStreams;
+
+	bool bLoaded;
+	Py_BEGIN_ALLOW_THREADS
+	bLoaded = pOwner->pStreams->Load( filename );
+	Py_END_ALLOW_THREADS
+
+	if( !bLoaded )
+	{
+		Py_DECREF( pOwner );
+		return PyErr_Format( PyExc_IOError, "Couldn't open '%s'", filename );
+	}
+
+	const demo_streams_t& Streams = pOwner->pStreams->GetStreams();
+	PyObject *replay = PyDict_New();
+
+	PyObject *pErrorCount = PyLong_FromLong( Streams.error_count );
+
+	if( !replay || !pErrorCount || !BuildStreams( replay, ( PyObject * )pOwner, Streams ) || !BuildNames( replay, Streams ) ||
+		PyDict_SetItemString( replay, "error_count", pErrorCount ) )
+	{
+		Py_XDECREF( pErrorCount );
+		Py_XDECREF( replay );
+		Py_DECREF( pOwner );
+		return NULL;
+	}
+
+	Py_DECREF( pErrorCount );
+	Py_DECREF( pOwner );
+	return replay;
+}
+
+static PyMethodDef demoinfo2Methods[] =
+{
+	{ "load", demoinfo2_load, METH_VARARGS, "load(filename) -> dict of streams, each a dict of zero copy columns" },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyModuleDef demoinfo2Module = { PyModuleDef_HEAD_INIT, "demoinfo2", "Dota 2 demo streams", -1, demoinfo2Methods };
+
+PyMODINIT_FUNC PyInit_demoinfo2()
+{
+	ReplayType.tp_name = "demoinfo2.Replay";
+	ReplayType.tp_basicsize = sizeof( ReplayObject );
+	ReplayType.tp_dealloc = ( destructor )Replay_dealloc;
+	ReplayType.tp_flags = Py_TPFLAGS_DEFAULT;
+
+	ColumnType.tp_name = "demoinfo2.Column";
+	ColumnType.tp_basicsize = sizeof( ColumnObject );
+	ColumnType.tp_dealloc = ( destructor )Column_dealloc;
+	ColumnType.tp_as_sequence = &ColumnSequenceMethods;
+	ColumnType.tp_as_buffer = &ColumnBufferProcs;
+	ColumnType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ColumnType.tp_doc = "Read only column of a demoinfo2 stream, use numpy.asarray() or memoryview() on it";
+
+	if( PyType_Ready( &ReplayType ) < 0 || PyType_Ready( &ColumnType ) < 0 )
+		return NULL;
+
+	return PyModule_Create( &demoinfo2Module );
+}
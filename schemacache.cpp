@@ -0,0 +1,190 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#include <string.h>
+#include "schemacache.h"
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// Event ids above this are looked up with a linear search instead of the index
+#define GAMEEVENT_MAX_INDEXED_ID	4096
+
+bool CGameEventSchema::ParseFromArray( const void *pBuffer, int size )
+{
+	if( !m_GameEventList.ParseFromArray( pBuffer, size ) )
+		return false;
+
+	m_descriptorIndex.clear();
+
+	for( int i = 0; i < m_GameEventList.descriptors().size(); i++ )
+	{
+		int eventid = m_GameEventList.descriptors( i ).eventid();
+
+		if( eventid < 0 || eventid >= GAMEEVENT_MAX_INDEXED_ID )
+			continue;
+
+		if( eventid >= ( int )m_descriptorIndex.size() )
+			m_descriptorIndex.resize( eventid + 1, -1 );
+
+		// First one wins, same as the search the dump used to do
+		if( m_descriptorIndex[ eventid ] < 0 )
+			m_descriptorIndex[ eventid ] = i;
+	}
+
+	return true;
+}
+
+/**
+ * @return the descriptor for a game event id, NULL if the list doesn't have it
+ */ 
+const CSVCMsg_GameEventList::descriptor_t *CGameEventSchema::FindDescriptor( int eventid ) const
+{
+	if( eventid >= 0 && eventid < ( int )m_descriptorIndex.size() )
+	{
+		int index = m_descriptorIndex[ eventid ];
+		return ( index >= 0 ) ? &m_GameEventList.descriptors( index ) : NULL;
+	}
+
+	if( eventid >= 0 && eventid < GAMEEVENT_MAX_INDEXED_ID )
+		return NULL;
+
+	for( int i = 0; i < m_GameEventList.descriptors().size(); i++ )
+	{
+		if( m_GameEventList.descriptors( i ).eventid() == eventid )
+			return &m_GameEventList.descriptors( i );
+	}
+
+	return NULL;
+}
+
+/**
+ * Tables whose contents are specific to one replay or change all the time. Caching them would
+ * only grow the cache, so they are parsed for the caller alone. The name tables grow with what
+ * happens in the match, every snapshot of them is a new copy.
+ */ 
+static bool IsVolatileStringTable( const std::string& name )
+{
+	return name == "ActiveModifiers" || name == "userinfo" || name == "instancebaseline" || name == "EconItems" ||
+		name == "CombatLogNames" || name == "ModifierNames" || name == "ParticleEffectNames";
+}
+
+/**
+ * Parses an encoded CDemoStringTables one table at a time, so that each table can come from the
+ * schema cache when another replay already had an identical one
+ */ 
+bool ParseStringTablesInterned( const void *pBuffer, int size, StringTableList_t& Tables )
+{
+	CodedInputStream stream( ( const unsigned char * )pBuffer, size );
+
+	Tables.clear();
+
+	for( uint32 tag = stream.ReadTag(); tag; tag = stream.ReadTag() )
+	{
+		if( WireFormatLite::GetTagFieldNumber( tag ) != CDemoStringTables::kTablesFieldNumber ||
+			WireFormatLite::GetTagWireType( tag ) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED )
+		{
+			if( !WireFormatLite::SkipField( &stream, tag ) )
+				return false;
+			continue;
+		}
+
+		uint32 Length;
+
+		if( !stream.ReadVarint32( &Length ) || Length > ( uint32 )( size - stream.CurrentPosition() ) )
+			return false;
+
+		const char *pTable = ( const char * )pBuffer + stream.CurrentPosition();
+		CSchemaCache< CDemoStringTables::table_t >::ptr_t pValue = CSchemaCache< CDemoStringTables::table_t >::Find( pTable, Length );
+
+		if( !pValue )
+		{
+			std::shared_ptr< CDemoStringTables::table_t > pParsed( new CDemoStringTables::table_t );
+
+			if( !pParsed->ParseFromArray( pTable, Length ) )
+				return false;
+
+			pValue = pParsed;
+
+			if( !IsVolatileStringTable( pParsed->table_name() ) )
+				pValue = CSchemaCache< CDemoStringTables::table_t >::Insert( pTable, Length, pValue );
+		}
+
+		Tables.push_back( pValue );
+		stream.Skip( Length );
+	}
+
+	return stream.ConsumedEntireMessage();
+}
+
+/**
+ * Parses an encoded CDemoFullPacket, taking its string tables from the schema cache where possible
+ */ 
+bool ParseFullPacketInterned( const void *pBuffer, int size, StringTableList_t& Tables, CDemoPacket& Packet )
+{
+	CodedInputStream stream( ( const unsigned char * )pBuffer, size );
+
+	Tables.clear();
+	Packet.Clear();
+
+	for( uint32 tag = stream.ReadTag(); tag; tag = stream.ReadTag() )
+	{
+		int field = WireFormatLite::GetTagFieldNumber( tag );
+
+		if( ( field != CDemoFullPacket::kStringTableFieldNumber && field != CDemoFullPacket::kPacketFieldNumber ) ||
+			WireFormatLite::GetTagWireType( tag ) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED )
+		{
+			if( !WireFormatLite::SkipField( &stream, tag ) )
+				return false;
+			continue;
+		}
+
+		uint32 Length;
+
+		if( !stream.ReadVarint32( &Length ) || Length > ( uint32 )( size - stream.CurrentPosition() ) )
+			return false;
+
+		const char *pField = ( const char * )pBuffer + stream.CurrentPosition();
+
+		if( field == CDemoFullPacket::kStringTableFieldNumber )
+		{
+			if( !ParseStringTablesInterned( pField, Length, Tables ) )
+				return false;
+		}
+		else
+		{
+			CodedInputStream PacketStream( ( const unsigned char * )pField, Length );
+
+			if( !Packet.MergeFromCodedStream( &PacketStream ) )
+				return false;
+		}
+
+		stream.Skip( Length );
+	}
+
+	return stream.ConsumedEntireMessage();
+}
@@ -0,0 +1,174 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+#ifndef SCHEMACACHE_H
+#define SCHEMACACHE_H
+
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "demofile.h"
+
+#include "generated_proto/netmessages.pb.h"
+
+//-----------------------------------------------------------------------------
+// Process wide cache of parsed schema messages (game event lists, class info,
+// send tables, string tables), keyed by the content of their encoding.
+//
+// Replays of the same game build carry identical copies of these, so every
+// replay after the first gets the already parsed object instead of parsing
+// its own. Cached objects are immutable and can be shared between threads.
+//
+// The cache holds at most SCHEMACACHE_MAX_ENTRIES objects of each type. When
+// it is full the ones no replay holds on to any more are dropped, and if all
+// of them are still in use a new object is handed out without caching it.
+//-----------------------------------------------------------------------------
+
+#define SCHEMACACHE_MAX_ENTRIES		256
+template < class T >
+class CSchemaCache
+{
+public:
+	typedef std::shared_ptr< const T > ptr_t;
+
+	// Returns the cached object for exactly these bytes, or NULL
+	static ptr_t Find( const void *pBuffer, int size );
+
+	// Adds an object parsed from these bytes, returns the one that ends up in the cache (pValue when it is full)
+	static ptr_t Insert( const void *pBuffer, int size, const ptr_t& pValue );
+
+	// Find() and, on a miss, parse with T::ParseFromArray() and Insert()
+	static ptr_t Intern( const void *pBuffer, int size );
+
+private:
+	struct entry_t
+	{
+		std::string data;
+		ptr_t pValue;
+	};
+
+	static std::mutex s_mutex;
+	static std::unordered_multimap< uint64, entry_t > s_entries;
+};
+
+template < class T > std::mutex CSchemaCache< T >::s_mutex;
+template < class T > std::unordered_multimap< uint64, typename CSchemaCache< T >::entry_t > CSchemaCache< T >::s_entries;
+
+template < class T >
+typename CSchemaCache< T >::ptr_t CSchemaCache< T >::Find( const void *pBuffer, int size )
+{
+	uint64 hash = HashBytes64( pBuffer, size );
+	std::lock_guard< std::mutex > lock( s_mutex );
+
+	// Compare the bytes too, a hash collision must never hand out the wrong schema
+	auto range = s_entries.equal_range( hash );
+	for( auto it = range.first; it != range.second; ++it )
+	{
+		if( it->second.data.size() == ( size_t )size && !memcmp( it->second.data.data(), pBuffer, size ) )
+			return it->second.pValue;
+	}
+
+	return ptr_t();
+}
+
+template < class T >
+typename CSchemaCache< T >::ptr_t CSchemaCache< T >::Insert( const void *pBuffer, int size, const ptr_t& pValue )
+{
+	uint64 hash = HashBytes64( pBuffer, size );
+	std::lock_guard< std::mutex > lock( s_mutex );
+
+	// Another thread may have parsed the same bytes in the meantime, keep the first copy
+	auto range = s_entries.equal_range( hash );
+	for( auto it = range.first; it != range.second; ++it )
+	{
+		if( it->second.data.size() == ( size_t )size && !memcmp( it->second.data.data(), pBuffer, size ) )
+			return it->second.pValue;
+	}
+
+	if( s_entries.size() >= SCHEMACACHE_MAX_ENTRIES )
+	{
+		// Only the cache has these, nobody can get at them but through Find() which holds the lock
+		for( auto it = s_entries.begin(); it != s_entries.end(); )
+		{
+			if( it->second.pValue.use_count() == 1 )
+				it = s_entries.erase( it );
+			else
+				++it;
+		}
+
+		if( s_entries.size() >= SCHEMACACHE_MAX_ENTRIES )
+			return pValue;
+	}
+
+	entry_t& Entry = s_entries.insert( std::make_pair( hash, entry_t() ) )->second;
+	Entry.data.assign( ( const char * )pBuffer, size );
+	Entry.pValue = pValue;
+	return pValue;
+}
+
+template < class T >
+typename CSchemaCache< T >::ptr_t CSchemaCache< T >::Intern( const void *pBuffer, int size )
+{
+	ptr_t pValue = Find( pBuffer, size );
+
+	if( !pValue )
+	{
+		// Parse outside of the lock so threads don't wait on each other
+		std::shared_ptr< T > pParsed( new T );
+
+		if( !pParsed->ParseFromArray( pBuffer, size ) )
+			return ptr_t();
+
+		pValue = Insert( pBuffer, size, pParsed );
+	}
+
+	return pValue;
+}
+
+/**
+ * The game event list together with a lookup from event id to descriptor
+ */ 
+class CGameEventSchema
+{
+public:
+	bool ParseFromArray( const void *pBuffer, int size );
+
+	const CSVCMsg_GameEventList::descriptor_t *FindDescriptor( int eventid ) const;
+
+public:
+	CSVCMsg_GameEventList m_GameEventList;
+
+private:
+	// Index into m_GameEventList.descriptors() by event id, -1 for unknown ids
+	std::vector< int > m_descriptorIndex;
+};
+
+typedef std::vector< std::shared_ptr< const CDemoStringTables::table_t > > StringTableList_t;
+
+bool ParseStringTablesInterned( const void *pBuffer, int size, StringTableList_t& Tables );
+bool ParseFullPacketInterned( const void *pBuffer, int size, StringTableList_t& Tables, CDemoPacket& Packet );
+
+#endif // SCHEMACACHE_H
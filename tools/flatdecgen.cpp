@@ -0,0 +1,713 @@
+//====== Copyright (c) 2012, Valve Corporation, All rights reserved. ========//
+//
+// Redistribution and use in source and binary forms, with or without 
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation 
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+// THE POSSIBILITY OF SUCH DAMAGE.
+//===========================================================================//
+
+//-----------------------------------------------------------------------------
+// flatdecgen - writes the flat wire decoders in generated_proto/flatdecoders.h
+//
+//   flatdecgen [-capacity <n>] <descriptor set> <out.h> MessageName...
+//
+// The descriptor set comes from protoc --include_imports --descriptor_set_out
+// over the same .proto files the rest of the build uses. For every named
+// message, and every message type reachable from its fields, this emits a
+// CFlat_<Name> struct with protobuf style accessors, Clear/Merge/Decode and a
+// FlatEquals() that compares it field by field with the libprotobuf class.
+// See flatdecoder.h for the rules the decoders follow.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+
+using google::protobuf::Descriptor;
+using google::protobuf::DescriptorPool;
+using google::protobuf::EnumDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FileDescriptor;
+using google::protobuf::FileDescriptorSet;
+
+// Default room for repeated fields, anything more makes Decode() fail and the caller falls back
+#define FLATDECGEN_DEFAULT_CAPACITY		32
+
+static int g_nCapacity = FLATDECGEN_DEFAULT_CAPACITY;
+
+static void fatal_errorf( const char* fmt, ... )
+{
+	va_list vlist;
+	char buf[ 1024 ];
+
+	va_start( vlist, fmt);
+	vsnprintf( buf, sizeof( buf ), fmt, vlist );
+	buf[ sizeof( buf ) - 1 ] = 0;
+	va_end( vlist );
+
+	fprintf( stderr, "\nERROR: %s\n", buf );
+	exit( -1 );
+}
+
+static std::string StringPrintf( const char *fmt, ... )
+{
+	va_list vlist;
+	char buf[ 1024 ];
+
+	va_start( vlist, fmt);
+	vsnprintf( buf, sizeof( buf ), fmt, vlist );
+	buf[ sizeof( buf ) - 1 ] = 0;
+	va_end( vlist );
+
+	return buf;
+}
+
+/**
+ * Name of the libprotobuf class, nested types are flattened with '_' just like protoc does
+ */ 
+static std::string GetClassName( const Descriptor *pDescriptor )
+{
+	std::string name = pDescriptor->full_name();
+	const std::string& package = pDescriptor->file()->package();
+
+	if( !package.empty() )
+		name = name.substr( package.size() + 1 );
+
+	for( size_t i = 0; i < name.size(); i++ )
+	{
+		if( name[ i ] == '.' )
+			name[ i ] = '_';
+	}
+
+	return name;
+}
+
+static std::string GetQualifiedClassName( const Descriptor *pDescriptor )
+{
+	std::string ns = pDescriptor->file()->package();
+
+	for( size_t pos = 0; ( pos = ns.find( '.', pos ) ) != std::string::npos; )
+		ns.replace( pos, 1, "::" );
+
+	return ns.empty() ? "::" + GetClassName( pDescriptor ) : "::" + ns + "::" + GetClassName( pDescriptor );
+}
+
+static std::string GetFlatName( const Descriptor *pDescriptor )
+{
+	return "CFlat_" + GetClassName( pDescriptor );
+}
+
+static std::string GetFlatEnumValidator( const EnumDescriptor *pEnum )
+{
+	std::string name = pEnum->full_name();
+
+	for( size_t i = 0; i < name.size(); i++ )
+	{
+		if( name[ i ] == '.' )
+			name[ i ] = '_';
+	}
+
+	return "FlatIsValid_" + name;
+}
+
+/**
+ * Type the flat struct stores a single value of the field as
+ */ 
+static std::string GetFieldType( const FieldDescriptor *pField )
+{
+	switch( pField->type() )
+	{
+	case FieldDescriptor::TYPE_INT32:
+	case FieldDescriptor::TYPE_SINT32:
+	case FieldDescriptor::TYPE_SFIXED32:	return "int32_t";
+	case FieldDescriptor::TYPE_UINT32:
+	case FieldDescriptor::TYPE_FIXED32:		return "uint32_t";
+	case FieldDescriptor::TYPE_INT64:
+	case FieldDescriptor::TYPE_SINT64:
+	case FieldDescriptor::TYPE_SFIXED64:	return "int64_t";
+	case FieldDescriptor::TYPE_UINT64:
+	case FieldDescriptor::TYPE_FIXED64:		return "uint64_t";
+	case FieldDescriptor::TYPE_FLOAT:		return "float";
+	case FieldDescriptor::TYPE_DOUBLE:		return "double";
+	case FieldDescriptor::TYPE_BOOL:		return "bool";
+	case FieldDescriptor::TYPE_ENUM:		return "int";
+	case FieldDescriptor::TYPE_STRING:
+	case FieldDescriptor::TYPE_BYTES:		return "std::string_view";
+	case FieldDescriptor::TYPE_MESSAGE:		return GetFlatName( pField->message_type() );
+	default:
+		fatal_errorf( "%s: groups are not supported", pField->full_name().c_str() );
+		return "";
+	}
+}
+
+/**
+ * Wire type a single value of the field is sent with
+ */ 
+static int GetWireType( const FieldDescriptor *pField )
+{
+	switch( pField->type() )
+	{
+	case FieldDescriptor::TYPE_FIXED32:
+	case FieldDescriptor::TYPE_SFIXED32:
+	case FieldDescriptor::TYPE_FLOAT:		return 5;
+	case FieldDescriptor::TYPE_FIXED64:
+	case FieldDescriptor::TYPE_SFIXED64:
+	case FieldDescriptor::TYPE_DOUBLE:		return 1;
+	case FieldDescriptor::TYPE_STRING:
+	case FieldDescriptor::TYPE_BYTES:
+	case FieldDescriptor::TYPE_MESSAGE:		return 2;
+	default:								return 0;
+	}
+}
+
+static std::string EscapeString( const std::string& str )
+{
+	std::string out;
+
+	for( size_t i = 0; i < str.size(); i++ )
+	{
+		unsigned char c = str[ i ];
+
+		if( c == '"' || c == '\\' )
+		{
+			out += '\\';
+			out += c;
+		}
+		else if( c < 0x20 || c >= 0x7F )
+		{
+			out += StringPrintf( "\\%03o", c );
+		}
+		else
+		{
+			out += c;
+		}
+	}
+
+	return out;
+}
+
+static std::string FloatLiteral( double value, bool bFloat )
+{
+	const char *type = bFloat ? "float" : "double";
+
+	if( isnan( value ) )
+		return StringPrintf( "std::numeric_limits< %s >::quiet_NaN()", type );
+	if( isinf( value ) )
+		return StringPrintf( "%sstd::numeric_limits< %s >::infinity()", value < 0 ? "-" : "", type );
+
+	std::string literal = StringPrintf( bFloat ? "%.9g" : "%.17g", value );
+
+	if( literal.find_first_of( ".e" ) == std::string::npos )
+		literal += ".0";
+
+	return bFloat ? literal + "f" : literal;
+}
+
+/**
+ * Value Clear() resets a singular field to, the proto2 [default] if there is one
+ */ 
+static std::string GetDefaultValue( const FieldDescriptor *pField )
+{
+	switch( pField->cpp_type() )
+	{
+	case FieldDescriptor::CPPTYPE_INT32:	return StringPrintf( "%d", pField->default_value_int32() );
+	case FieldDescriptor::CPPTYPE_UINT32:	return StringPrintf( "%uu", pField->default_value_uint32() );
+	case FieldDescriptor::CPPTYPE_INT64:	return StringPrintf( "INT64_C( %lld )", ( long long )pField->default_value_int64() );
+	case FieldDescriptor::CPPTYPE_UINT64:	return StringPrintf( "UINT64_C( %llu )", ( unsigned long long )pField->default_value_uint64() );
+	case FieldDescriptor::CPPTYPE_FLOAT:	return FloatLiteral( pField->default_value_float(), true );
+	case FieldDescriptor::CPPTYPE_DOUBLE:	return FloatLiteral( pField->default_value_double(), false );
+	case FieldDescriptor::CPPTYPE_BOOL:		return pField->default_value_bool() ? "true" : "false";
+	case FieldDescriptor::CPPTYPE_ENUM:		return StringPrintf( "%d", pField->default_value_enum()->number() );
+	case FieldDescriptor::CPPTYPE_STRING:
+	{
+		const std::string& value = pField->default_value_string();
+
+		if( value.empty() )
+			return "std::string_view()";
+
+		return StringPrintf( "std::string_view( \"%s\", %d )", EscapeString( value ).c_str(), ( int )value.size() );
+	}
+	default:
+		return "";
+	}
+}
+
+/**
+ * Code that reads one value of the field from reader into a new local called value
+ */ 
+static std::string GetReadValue( const FieldDescriptor *pField, const char *reader, const char *indent )
+{
+	std::string type = GetFieldType( pField );
+	std::string read;
+	std::string value;
+
+	switch( pField->type() )
+	{
+	case FieldDescriptor::TYPE_FIXED32:
+	case FieldDescriptor::TYPE_SFIXED32:
+	case FieldDescriptor::TYPE_FLOAT:
+		read = StringPrintf( "uint32_t raw;\n%sif( !%s.ReadFixed32( &raw ) )\n%s\treturn false;\n", indent, reader, indent );
+		if( pField->type() == FieldDescriptor::TYPE_FLOAT )
+			value = "FlatFloatFromBits( raw )";
+		else
+			value = "( " + type + " )raw";
+		break;
+
+	case FieldDescriptor::TYPE_FIXED64:
+	case FieldDescriptor::TYPE_SFIXED64:
+	case FieldDescriptor::TYPE_DOUBLE:
+		read = StringPrintf( "uint64_t raw;\n%sif( !%s.ReadFixed64( &raw ) )\n%s\treturn false;\n", indent, reader, indent );
+		if( pField->type() == FieldDescriptor::TYPE_DOUBLE )
+			value = "FlatDoubleFromBits( raw )";
+		else
+			value = "( " + type + " )raw";
+		break;
+
+	case FieldDescriptor::TYPE_STRING:
+	case FieldDescriptor::TYPE_BYTES:
+		return StringPrintf( "std::string_view value;\n%sif( !%s.ReadBytes( &value ) )\n%s\treturn false;\n", indent, reader, indent );
+
+	default:
+		read = StringPrintf( "uint64_t raw;\n%sif( !%s.ReadVarint64( &raw ) )\n%s\treturn false;\n", indent, reader, indent );
+		if( pField->type() == FieldDescriptor::TYPE_SINT32 )
+			value = "FlatZigZagDecode32( ( uint32_t )raw )";
+		else if( pField->type() == FieldDescriptor::TYPE_SINT64 )
+			value = "FlatZigZagDecode64( raw )";
+		else if( pField->type() == FieldDescriptor::TYPE_BOOL )
+			value = "raw != 0";
+		else
+			value = "( " + type + " )raw";
+		break;
+	}
+
+	return read + StringPrintf( "%s%s value = %s;\n", indent, type.c_str(), value.c_str() );
+}
+
+/**
+ * Code that stores value in the field, unknown enum values are dropped like libprotobuf
+ * does with closed enums
+ */ 
+static std::string GetStoreValue( const FieldDescriptor *pField, const char *indent )
+{
+	bool bEnum = pField->type() == FieldDescriptor::TYPE_ENUM;
+	std::string inner = bEnum ? std::string( indent ) + "\t" : indent;
+	std::string store;
+
+	if( pField->is_repeated() )
+	{
+		store = StringPrintf( "%s%s *pValue = %s_.Add();\n", inner.c_str(), GetFieldType( pField ).c_str(), pField->name().c_str() );
+		store += StringPrintf( "%sif( !pValue )\n%s\treturn false;\n", inner.c_str(), inner.c_str() );
+		store += StringPrintf( "%s*pValue = value;\n", inner.c_str() );
+	}
+	else
+	{
+		store = StringPrintf( "%s%s_ = value;\n", inner.c_str(), pField->name().c_str() );
+		store += StringPrintf( "%shas_%s_ = true;\n", inner.c_str(), pField->name().c_str() );
+	}
+
+	if( !bEnum )
+		return store;
+
+	return StringPrintf( "%sif( %s( value ) )\n%s{\n", indent, GetFlatEnumValidator( pField->enum_type() ).c_str(), indent ) +
+		store + StringPrintf( "%s}\n", indent );
+}
+
+/**
+ * Walks the message types reachable from pDescriptor, dependencies end up before the messages using them
+ */ 
+static void CollectMessages( const Descriptor *pDescriptor, std::vector< const Descriptor * >& Messages,
+	std::set< const Descriptor * >& Visiting )
+{
+	if( std::find( Messages.begin(), Messages.end(), pDescriptor ) != Messages.end() )
+		return;
+
+	if( Visiting.count( pDescriptor ) )
+		fatal_errorf( "%s is recursive and can't be stored inline", pDescriptor->full_name().c_str() );
+
+	if( pDescriptor->file()->syntax() != FileDescriptor::SYNTAX_PROTO2 )
+		fatal_errorf( "%s: only proto2 messages are supported", pDescriptor->full_name().c_str() );
+
+	Visiting.insert( pDescriptor );
+
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+
+		if( pField->type() == FieldDescriptor::TYPE_MESSAGE )
+			CollectMessages( pField->message_type(), Messages, Visiting );
+	}
+
+	Visiting.erase( pDescriptor );
+	Messages.push_back( pDescriptor );
+}
+
+static void WriteEnumValidator( FILE *fp, const EnumDescriptor *pEnum )
+{
+	std::set< int > values;
+
+	fprintf( fp, "inline bool %s( int value )\n{\n\tswitch( value )\n\t{\n", GetFlatEnumValidator( pEnum ).c_str() );
+
+	for( int i = 0; i < pEnum->value_count(); i++ )
+	{
+		if( values.insert( pEnum->value( i )->number() ).second )
+			fprintf( fp, "\tcase %d:\n", pEnum->value( i )->number() );
+	}
+
+	fprintf( fp, "\t\treturn true;\n\tdefault:\n\t\treturn false;\n\t}\n}\n\n" );
+}
+
+static void WriteMessage( FILE *fp, const Descriptor *pDescriptor, const std::vector< const Descriptor * >& Messages )
+{
+	std::string name = GetFlatName( pDescriptor );
+
+	fprintf( fp, "struct %s\n{\n", name.c_str() );
+
+	// Nested types are reachable the same way as on the libprotobuf class
+	bool bTypedefs = false;
+	for( int i = 0; i < pDescriptor->nested_type_count(); i++ )
+	{
+		const Descriptor *pNested = pDescriptor->nested_type( i );
+
+		if( std::find( Messages.begin(), Messages.end(), pNested ) != Messages.end() )
+		{
+			fprintf( fp, "\ttypedef %s %s;\n", GetFlatName( pNested ).c_str(), pNested->name().c_str() );
+			bTypedefs = true;
+		}
+	}
+
+	if( bTypedefs )
+		fprintf( fp, "\n" );
+
+	fprintf( fp, "\t%s() { Clear(); }\n\n", name.c_str() );
+
+	// Accessors
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+		std::string type = GetFieldType( pField );
+		const char *field = pField->name().c_str();
+		bool bByRef = pField->type() == FieldDescriptor::TYPE_MESSAGE;
+
+		if( pField->is_repeated() )
+		{
+			fprintf( fp, "\tint %s_size() const { return %s_.size(); }\n", field, field );
+			fprintf( fp, "\t%s%s%s %s( int i ) const { return %s_[ i ]; }\n", bByRef ? "const " : "", type.c_str(), bByRef ? "&" : "", field, field );
+			fprintf( fp, "\tconst CFlatRepeated< %s, %d >& %s() const { return %s_; }\n", type.c_str(), g_nCapacity, field, field );
+		}
+		else
+		{
+			fprintf( fp, "\tbool has_%s() const { return has_%s_; }\n", field, field );
+			fprintf( fp, "\t%s%s%s %s() const { return %s_; }\n", bByRef ? "const " : "", type.c_str(), bByRef ? "&" : "", field, field );
+		}
+	}
+
+	// Clear
+	fprintf( fp, "\n\tvoid Clear()\n\t{\n" );
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+		const char *field = pField->name().c_str();
+
+		if( pField->is_repeated() || pField->type() == FieldDescriptor::TYPE_MESSAGE )
+			fprintf( fp, "\t\t%s_.Clear();\n", field );
+		else
+			fprintf( fp, "\t\t%s_ = %s;\n", field, GetDefaultValue( pField ).c_str() );
+
+		if( !pField->is_repeated() )
+			fprintf( fp, "\t\thas_%s_ = false;\n", field );
+	}
+	fprintf( fp, "\t}\n" );
+
+	// IsInitialized
+	fprintf( fp, "\n\tbool IsInitialized() const\n\t{\n" );
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+		const char *field = pField->name().c_str();
+
+		if( pField->is_required() )
+			fprintf( fp, "\t\tif( !has_%s_ )\n\t\t\treturn false;\n", field );
+
+		if( pField->type() != FieldDescriptor::TYPE_MESSAGE )
+			continue;
+
+		if( pField->is_repeated() )
+			fprintf( fp, "\t\tfor( int i = 0; i < %s_.size(); i++ )\n\t\t\tif( !%s_[ i ].IsInitialized() )\n\t\t\t\treturn false;\n", field, field );
+		else
+			fprintf( fp, "\t\tif( has_%s_ && !%s_.IsInitialized() )\n\t\t\treturn false;\n", field, field );
+	}
+	fprintf( fp, "\t\treturn true;\n\t}\n" );
+
+	// Decode / Merge
+	fprintf( fp, "\n\tbool Decode( const char *pData, int size )\n\t{\n" );
+	fprintf( fp, "\t\tCFlatReader reader( pData, size );\n\n" );
+	fprintf( fp, "\t\tClear();\n\t\treturn Merge( reader ) && IsInitialized();\n\t}\n" );
+
+	fprintf( fp, "\n\tbool Merge( CFlatReader& reader )\n\t{\n" );
+	fprintf( fp, "\t\twhile( !reader.AtEnd() )\n\t\t{\n" );
+	fprintf( fp, "\t\t\tuint32_t tag;\n\n" );
+	fprintf( fp, "\t\t\tif( !reader.ReadTag( &tag ) )\n\t\t\t\treturn false;\n\n" );
+	fprintf( fp, "\t\t\tswitch( tag )\n\t\t\t{\n" );
+
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+		const char *field = pField->name().c_str();
+		int wireType = GetWireType( pField );
+
+		fprintf( fp, "\t\t\tcase ( %d << 3 ) | %d:\n\t\t\t{\n", pField->number(), wireType );
+
+		if( pField->type() == FieldDescriptor::TYPE_MESSAGE )
+		{
+			fprintf( fp, "\t\t\t\tstd::string_view bytes;\n\n" );
+			fprintf( fp, "\t\t\t\tif( !reader.ReadBytes( &bytes ) )\n\t\t\t\t\treturn false;\n\n" );
+			fprintf( fp, "\t\t\t\tCFlatReader subReader( bytes.data(), ( int )bytes.size() );\n" );
+
+			if( pField->is_repeated() )
+			{
+				fprintf( fp, "\t\t\t\t%s *pValue = %s_.Add();\n\n", GetFieldType( pField ).c_str(), field );
+				fprintf( fp, "\t\t\t\tif( !pValue )\n\t\t\t\t\treturn false;\n\n" );
+				fprintf( fp, "\t\t\t\tpValue->Clear();\n" );
+				fprintf( fp, "\t\t\t\tif( !pValue->Merge( subReader ) )\n\t\t\t\t\treturn false;\n" );
+			}
+			else
+			{
+				fprintf( fp, "\t\t\t\tif( !%s_.Merge( subReader ) )\n\t\t\t\t\treturn false;\n", field );
+				fprintf( fp, "\t\t\t\thas_%s_ = true;\n", field );
+			}
+		}
+		else
+		{
+			fprintf( fp, "\t\t\t\t%s", GetReadValue( pField, "reader", "\t\t\t\t" ).c_str() );
+			fprintf( fp, "%s", GetStoreValue( pField, "\t\t\t\t" ).c_str() );
+		}
+
+		fprintf( fp, "\t\t\t\tbreak;\n\t\t\t}\n" );
+
+		// Repeated scalars are accepted both packed and unpacked, whatever the .proto says
+		if( pField->is_repeated() && wireType != 2 )
+		{
+			fprintf( fp, "\t\t\tcase ( %d << 3 ) | 2:\n\t\t\t{\n", pField->number() );
+			fprintf( fp, "\t\t\t\tstd::string_view packed;\n\n" );
+			fprintf( fp, "\t\t\t\tif( !reader.ReadBytes( &packed ) )\n\t\t\t\t\treturn false;\n\n" );
+			fprintf( fp, "\t\t\t\tCFlatReader packedReader( packed.data(), ( int )packed.size() );\n" );
+			fprintf( fp, "\t\t\t\twhile( !packedReader.AtEnd() )\n\t\t\t\t{\n" );
+			fprintf( fp, "\t\t\t\t\t%s", GetReadValue( pField, "packedReader", "\t\t\t\t\t" ).c_str() );
+			fprintf( fp, "%s", GetStoreValue( pField, "\t\t\t\t\t" ).c_str() );
+			fprintf( fp, "\t\t\t\t}\n\t\t\t\tbreak;\n\t\t\t}\n" );
+		}
+	}
+
+	fprintf( fp, "\t\t\tdefault:\n" );
+	fprintf( fp, "\t\t\t\tif( !( tag >> 3 ) || !reader.SkipField( tag ) )\n\t\t\t\t\treturn false;\n" );
+	fprintf( fp, "\t\t\t\tbreak;\n\t\t\t}\n\t\t}\n\n\t\treturn true;\n\t}\n\n" );
+
+	// Storage
+	fprintf( fp, "private:\n" );
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+		const char *field = pField->name().c_str();
+
+		if( pField->is_repeated() )
+		{
+			fprintf( fp, "\tCFlatRepeated< %s, %d > %s_;\n", GetFieldType( pField ).c_str(), g_nCapacity, field );
+		}
+		else
+		{
+			fprintf( fp, "\t%s %s_;\n", GetFieldType( pField ).c_str(), field );
+			fprintf( fp, "\tbool has_%s_;\n", field );
+		}
+	}
+
+	fprintf( fp, "};\n\n" );
+}
+
+/**
+ * Writes the code to compare a single value of the field, flat and msg name the values
+ */ 
+static std::string GetCompareValue( const FieldDescriptor *pField, const std::string& flat, const std::string& msg )
+{
+	switch( pField->type() )
+	{
+	case FieldDescriptor::TYPE_MESSAGE:
+		return "!FlatEquals( " + flat + ", " + msg + " )";
+	case FieldDescriptor::TYPE_FLOAT:
+	case FieldDescriptor::TYPE_DOUBLE:
+		return "!FlatSameBits( " + flat + ", " + msg + " )";
+	case FieldDescriptor::TYPE_ENUM:
+		return flat + " != ( int )" + msg;
+	case FieldDescriptor::TYPE_STRING:
+	case FieldDescriptor::TYPE_BYTES:
+		return flat + " != std::string_view( " + msg + " )";
+	default:
+		return flat + " != " + msg;
+	}
+}
+
+static void WriteEquals( FILE *fp, const Descriptor *pDescriptor )
+{
+	// Messages without fields leave the parameters unnamed, they would be unused
+	bool bEmpty = !pDescriptor->field_count();
+
+	fprintf( fp, "inline bool FlatEquals( const %s&%s, const %s&%s )\n{\n",
+		GetFlatName( pDescriptor ).c_str(), bEmpty ? "" : " flat", GetQualifiedClassName( pDescriptor ).c_str(), bEmpty ? "" : " msg" );
+
+	for( int i = 0; i < pDescriptor->field_count(); i++ )
+	{
+		const FieldDescriptor *pField = pDescriptor->field( i );
+		const char *field = pField->name().c_str();
+
+		if( pField->is_repeated() )
+		{
+			fprintf( fp, "\tif( flat.%s_size() != msg.%s_size() )\n\t\treturn false;\n", field, field );
+			fprintf( fp, "\tfor( int i = 0; i < flat.%s_size(); i++ )\n\t\tif( %s )\n\t\t\treturn false;\n", field,
+				GetCompareValue( pField, StringPrintf( "flat.%s( i )", field ), StringPrintf( "msg.%s( i )", field ) ).c_str() );
+		}
+		else
+		{
+			fprintf( fp, "\tif( flat.has_%s() != msg.has_%s() || %s )\n\t\treturn false;\n", field, field,
+				GetCompareValue( pField, StringPrintf( "flat.%s()", field ), StringPrintf( "msg.%s()", field ) ).c_str() );
+		}
+	}
+
+	fprintf( fp, "\treturn true;\n}\n\n" );
+}
+
+static std::string GetPbHeaderName( const FileDescriptor *pFile )
+{
+	std::string name = pFile->name();
+
+	if( name.size() > 6 && name.compare( name.size() - 6, 6, ".proto" ) == 0 )
+		name.resize( name.size() - 6 );
+
+	return name + ".pb.h";
+}
+
+static void PrintUsage()
+{
+	printf( "flatdecgen [-capacity <n>] <descriptor set> <out.h> MessageName...\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	if( argc >= 3 && !strcmp( argv[ 1 ], "-capacity" ) )
+	{
+		g_nCapacity = atoi( argv[ 2 ] );
+		argc -= 2;
+		argv += 2;
+	}
+
+	if( argc < 4 || g_nCapacity <= 0 )
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	FILE *fp = fopen( argv[ 1 ], "rb" );
+	if( !fp )
+		fatal_errorf( "Couldn't open '%s'", argv[ 1 ] );
+
+	std::string data;
+	char buf[ 64 * 1024 ];
+	size_t nRead;
+
+	while( ( nRead = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+		data.append( buf, nRead );
+	fclose( fp );
+
+	FileDescriptorSet DescriptorSet;
+	if( !DescriptorSet.ParseFromString( data ) )
+		fatal_errorf( "'%s' is not a descriptor set", argv[ 1 ] );
+
+	// --include_imports writes the files in dependency order
+	DescriptorPool pool;
+	for( int i = 0; i < DescriptorSet.file_size(); i++ )
+	{
+		if( !pool.BuildFile( DescriptorSet.file( i ) ) )
+			fatal_errorf( "Couldn't build '%s'", DescriptorSet.file( i ).name().c_str() );
+	}
+
+	std::vector< const Descriptor * > Messages;
+	std::set< const Descriptor * > Visiting;
+
+	for( int i = 3; i < argc; i++ )
+	{
+		const Descriptor *pDescriptor = pool.FindMessageTypeByName( argv[ i ] );
+
+		if( !pDescriptor )
+			fatal_errorf( "Unknown message '%s'", argv[ i ] );
+
+		CollectMessages( pDescriptor, Messages, Visiting );
+	}
+
+	std::vector< std::string > Headers;
+	std::vector< const EnumDescriptor * > Enums;
+
+	for( size_t i = 0; i < Messages.size(); i++ )
+	{
+		std::string header = GetPbHeaderName( Messages[ i ]->file() );
+
+		if( std::find( Headers.begin(), Headers.end(), header ) == Headers.end() )
+			Headers.push_back( header );
+
+		for( int j = 0; j < Messages[ i ]->field_count(); j++ )
+		{
+			const EnumDescriptor *pEnum = Messages[ i ]->field( j )->enum_type();
+
+			if( pEnum && std::find( Enums.begin(), Enums.end(), pEnum ) == Enums.end() )
+				Enums.push_back( pEnum );
+		}
+	}
+
+	fp = fopen( argv[ 2 ], "wb" );
+	if( !fp )
+		fatal_errorf( "Couldn't open '%s'", argv[ 2 ] );
+
+	fprintf( fp, "// Generated by tools/flatdecgen from %s. DO NOT EDIT!\n\n", argv[ 1 ] );
+	fprintf( fp, "#ifndef FLATDECODERS_H\n#define FLATDECODERS_H\n\n" );
+	fprintf( fp, "#include <limits>\n#include \"../flatdecoder.h\"\n" );
+	for( size_t i = 0; i < Headers.size(); i++ )
+		fprintf( fp, "#include \"%s\"\n", Headers[ i ].c_str() );
+	fprintf( fp, "\n" );
+
+	for( size_t i = 0; i < Enums.size(); i++ )
+		WriteEnumValidator( fp, Enums[ i ] );
+
+	for( size_t i = 0; i < Messages.size(); i++ )
+		WriteMessage( fp, Messages[ i ], Messages );
+
+	for( size_t i = 0; i < Messages.size(); i++ )
+		WriteEquals( fp, Messages[ i ] );
+
+	fprintf( fp, "#endif // FLATDECODERS_H\n" );
+
+	if( fclose( fp ) )
+		fatal_errorf( "Couldn't write '%s'", argv[ 2 ] );
+
+	return 0;
+}